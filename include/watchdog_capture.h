@@ -0,0 +1,161 @@
+/**
+ * @file watchdog_capture.h
+ * @brief Captures targets' stdout/stderr into size-rotated log files.
+ *
+ * Each captured target writes into a pipe; a pump thread moves the data
+ * from the pipe into `<WD_CAPTURE>/<name>.log` with `splice`, so it never
+ * passes through user space. When the log reaches `WD_CAPTURE_MAX` bytes
+ * it is renamed to `<name>.log.1` (older files shift up to
+ * `<name>.log.<WD_CAPTURE_KEEP>`, the oldest is dropped) and a new one is
+ * started. With `WD_CAPTURE_TEE=1` the output is also mirrored, with
+ * `tee`, to wherever stdout pointed before; if the mirror falls behind,
+ * it drops output rather than slow down the log.
+ *
+ * The pump runs in its own thread: a slow log disk delays only the pump
+ * (and, once the 1 MiB pipe is full, the writing target), never the
+ * scheduler tasks that exchange heartbeats.
+ *
+ * The pipe outlives the targets, so the log stays continuous across
+ * revives and what a killed target wrote last is still logged:
+ *  - Children spawned by `WdSpawnTarget` (e.g. by the supervisor) get the
+ *    pipe of `WdCaptureAttach` as stdout/stderr; the spawning process
+ *    keeps both ends and pumps.
+ *  - A client/watchdog pair shares one pipe: `WdCaptureRedirect` in the
+ *    first client points its stdout/stderr at it and exports the read end
+ *    in `WD_CAPTURE_FD`. Both processes inherit both ends across `fork`
+ *    and `execv` (a revived client keeps the pipe as its stdout), and the
+ *    watchdog process pumps it (`WdCaptureFromEnv`). A client that is
+ *    itself a captured child (`WD_CAPTURED`) keeps the pipe it was given.
+ *
+ * Only the watchdog process drains the pair's pipe, so while it is stopped
+ * or being revived the pipe can fill up. The library's own diagnostics
+ * (`WdCaptureDiag`, the heartbeat handler) therefore never go through it:
+ * they go, without blocking, to where stdout pointed before the capture
+ * (`WD_CAPTURE_DIAG_FD`), and the watchdog threads keep running whatever
+ * the app's output does.
+ */
+
+#ifndef __WATCHDOG_CAPTURE_H__
+#define __WATCHDOG_CAPTURE_H__
+
+#include <stddef.h>             /* using size_t   */
+#include <stdint.h>             /* using uint64_t */
+
+#include "watchdog_utils.h"     /* using wd_ty */
+
+#define WD_CAPTURE_ENV          "WD_CAPTURE"        /* log directory */
+#define WD_CAPTURE_FD_ENV       "WD_CAPTURE_FD"     /* pair's read end */
+#define WD_CAPTURE_MAX_ENV      "WD_CAPTURE_MAX"    /* bytes per log file */
+#define WD_CAPTURE_KEEP_ENV     "WD_CAPTURE_KEEP"   /* rotated files kept */
+#define WD_CAPTURE_TEE_ENV      "WD_CAPTURE_TEE"    /* 1 to mirror */
+#define WD_CAPTURE_MIRROR_ENV   "WD_CAPTURE_MIRROR_FD"
+#define WD_CAPTURE_DIAG_ENV     "WD_CAPTURE_DIAG_FD" /* stdout before */
+#define WD_CAPTURED_ENV         "WD_CAPTURED"       /* pid pumping stdout */
+#define WD_CAPTURE_DEFAULT_MAX  (10ul << 20)
+#define WD_CAPTURE_DEFAULT_KEEP (5)
+#define WD_CAPTURE_PIPE_SIZE    (1 << 20)
+#define WD_CAPTURE_MAX_STREAMS  (64)
+#define WD_CAPTURE_PATH_MAX     (256)
+
+/**
+ * @typedef wd_capture_ty
+ * @brief Set of captured streams served by one pump thread.
+ */
+typedef struct wd_capture wd_capture_ty;
+
+/**
+ * @struct wd_capture_stats
+ * @brief Counters of one stream.
+ */
+typedef struct wd_capture_stats
+{
+	uint64_t        bytes;          /**< Written to the log */
+	unsigned long   rotations;
+	uint64_t        mirrored;       /**< Copied to the mirror */
+	uint64_t        mirror_drops;   /**< Logged but not mirrored */
+	int             is_closed;      /**< Every writer is gone */
+} wd_capture_stats_ty;
+
+/**
+ * @brief Creates an empty set and starts its pump thread.
+ *
+ * @return New set, or NULL on failure.
+ */
+wd_capture_ty* WdCaptureCreate(void);
+
+/**
+ * @brief Stops the pump, logs whatever the pipes still hold and closes
+ *        the logs. Pipes created by `WdCaptureAttach` are closed too.
+ */
+void WdCaptureDestroy(wd_capture_ty* capture);
+
+/**
+ * @brief Starts pumping `read_fd` into a rotated log.
+ *
+ * If the log cannot be opened, the output is discarded rather than left
+ * to fill the pipe.
+ *
+ * @param capture Set to add to.
+ * @param read_fd Read end of the target's pipe; the set does not close it.
+ * @param path Log file.
+ * @param mirror_fd Where to mirror the output, or -1.
+ * @return Stream index, or -1 on failure.
+ */
+int WdCaptureAdd(wd_capture_ty* capture, int read_fd, const char* path,
+                 int mirror_fd);
+
+/**
+ * @brief Captures the output of targets that `wd` spawns.
+ *
+ * Creates the target's pipe and sets `wd->out_fd`, which `WdSpawnTarget`
+ * makes the child's stdout and stderr, and marks the child's environment
+ * (`WD_CAPTURED`) so that it does not capture itself again. Logs to
+ * `<WD_CAPTURE>/<name>.log`.
+ *
+ * @return Stream index, or -1 if capture is off or failed.
+ */
+int WdCaptureAttach(wd_capture_ty* capture, wd_ty* wd, const char* name);
+
+/**
+ * @brief Points the calling process' stdout/stderr at the pair's pipe.
+ *
+ * Called by the first client of a pair (`MakeMeImmortal`) when
+ * `WD_CAPTURE` is set; a revived client already writes into the pipe, and
+ * a captured child (`WD_CAPTURED`) into its capturer's pipe. Saves the
+ * previous stdout for `WdCaptureDiagFd`.
+ *
+ * @return 0 if output is captured, non-zero otherwise.
+ */
+int WdCaptureRedirect(void);
+
+/**
+ * @brief Creates a set pumping the pair's pipe (`WD_CAPTURE_FD`), for the
+ *        watchdog process.
+ *
+ * @param name Log name, e.g. the client's program name.
+ * @return New set, or NULL if the pair's output is not captured.
+ */
+wd_capture_ty* WdCaptureFromEnv(const char* name);
+
+/**
+ * @brief Returns where the library's diagnostics go: a non-blocking
+ *        description of stdout as it was before `WdCaptureRedirect`, or
+ *        STDOUT_FILENO while output is not captured.
+ */
+int WdCaptureDiagFd(void);
+
+/**
+ * @brief printf to `WdCaptureDiagFd`, for code on the watchdog threads.
+ *
+ * Output that the descriptor cannot take right away is dropped.
+ */
+int WdCaptureDiag(const char* format, ...)
+        __attribute__((format(printf, 1, 2)));
+
+/**
+ * @brief Copies the counters of a stream.
+ */
+void WdCaptureGetStats(const wd_capture_ty* capture, int i,
+                       wd_capture_stats_ty* stats);
+
+#endif  /* __WATCHDOG_CAPTURE_H__ */
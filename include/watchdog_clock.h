@@ -0,0 +1,57 @@
+/**
+ * @file watchdog_clock.h
+ * @brief Pluggable clock and sleep interface for the Watchdog system.
+ *
+ * Every watchdog context reads time and sleeps through a `wd_clock_ty`.
+ * The real clock uses CLOCK_MONOTONIC and `nanosleep`; the virtual clock
+ * only advances when slept on, which lets the simulation harness
+ * (`watchdog_sim`) run hours of detector activity in milliseconds.
+ */
+
+#ifndef __WATCHDOG_CLOCK_H__
+#define __WATCHDOG_CLOCK_H__
+
+#include <stdint.h>     /* using uint64_t */
+
+#define WD_NS_PER_SEC (1000000000ull)
+
+/**
+ * @struct wd_clock
+ * @brief A time source together with a way to wait on it.
+ */
+typedef struct wd_clock
+{
+	uint64_t (*now_ns)(const struct wd_clock* clock);       /**< Current time */
+	void     (*sleep_ns)(struct wd_clock* clock, uint64_t ns); /**< Wait ns */
+	uint64_t virtual_ns;        /**< Current time of a virtual clock */
+} wd_clock_ty;
+
+/**
+ * @brief Returns the process-wide real (monotonic) clock.
+ *
+ * @return Pointer to a shared clock instance; never NULL.
+ */
+wd_clock_ty* WdClockReal(void);
+
+/**
+ * @brief Initializes a virtual clock that starts at `start_ns`.
+ *
+ * Sleeping on a virtual clock returns immediately after moving its time
+ * forward by the requested amount.
+ *
+ * @param clock Clock to initialize.
+ * @param start_ns Initial virtual time in nanoseconds.
+ */
+void WdClockInitVirtual(wd_clock_ty* clock, uint64_t start_ns);
+
+/**
+ * @brief Returns the current time of `clock` in nanoseconds.
+ */
+uint64_t WdClockNow(const wd_clock_ty* clock);
+
+/**
+ * @brief Waits `ns` nanoseconds on `clock`.
+ */
+void WdClockSleep(wd_clock_ty* clock, uint64_t ns);
+
+#endif  /* __WATCHDOG_CLOCK_H__ */
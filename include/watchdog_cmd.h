@@ -0,0 +1,159 @@
+/**
+ * @file watchdog_cmd.h
+ * @brief Lock-free command queue for changing a watchdog from any thread.
+ *
+ * The scheduler is not thread-safe: only the thread running `SchedRun`
+ * may add or remove tasks. Other threads submit commands instead (add,
+ * remove, reschedule or run a task once, stop the scheduler). Producers
+ * only swap a pointer (an intrusive multi-producer single-consumer queue)
+ * and signal an eventfd; nothing on the dispatch path takes a lock.
+ *
+ * The scheduler thread applies pending commands:
+ *  - before every task dispatch (`WdDispatchTSK` drains the watchdog's
+ *    queue; an empty queue costs one atomic load);
+ *  - whenever its event loop sees `WdCmdGetFd` readable, for loops that
+ *    wait on descriptors and can call `WdCmdDrain` right away.
+ *
+ * Commands name the watchdog context they apply to, or NULL for the
+ * context that drains them, so one queue can serve every context on a
+ * shared scheduler.
+ */
+
+#ifndef __WATCHDOG_CMD_H__
+#define __WATCHDOG_CMD_H__
+
+#include <stdint.h>             /* using uint64_t */
+
+#include "watchdog_utils.h"     /* using wd_ty */
+
+/**
+ * @typedef wd_cmd_queue_ty
+ * @brief Opaque command queue.
+ */
+typedef struct wd_cmd_queue wd_cmd_queue_ty;
+
+/**
+ * @enum wd_cmd_op
+ * @brief What a command does on the scheduler thread.
+ */
+typedef enum wd_cmd_op
+{
+	WD_CMD_ADD,         /**< `WdAddNamedTask(wd, task, name, interval)` */
+	WD_CMD_REMOVE,      /**< Cancels every slot running `task` */
+	WD_CMD_RESCHEDULE,  /**< Remove, then add with the new interval */
+	WD_CMD_RUN,         /**< Runs `task(wd)` once, right away */
+	WD_CMD_STOP         /**< `WdStop(wd)` */
+} wd_cmd_op_ty;
+
+/**
+ * @struct wd_cmd
+ * @brief A command as submitted.
+ */
+typedef struct wd_cmd
+{
+	wd_cmd_op_ty    op;
+	wd_ty*          wd;             /**< Target, or NULL for the drainer */
+	int             (*task)(void*);
+	const char*     name;           /**< Trace name for WD_CMD_ADD/RESCHEDULE */
+	unsigned long   interval;       /**< Seconds, for WD_CMD_ADD/RESCHEDULE */
+} wd_cmd_ty;
+
+/**
+ * @struct wd_cmd_stats
+ * @brief Counters of a queue.
+ */
+typedef struct wd_cmd_stats
+{
+	unsigned long   submitted;
+	unsigned long   applied;
+	uint64_t        max_latency_ns;     /**< Submit to apply */
+	uint64_t        total_latency_ns;
+} wd_cmd_stats_ty;
+
+/**
+ * @brief Creates an empty queue.
+ *
+ * @return New queue, or NULL on failure.
+ */
+wd_cmd_queue_ty* WdCmdCreate(void);
+
+/**
+ * @brief Frees the queue and any command still pending.
+ *
+ * No thread may submit to the queue afterwards.
+ */
+void WdCmdDestroy(wd_cmd_queue_ty* queue);
+
+/**
+ * @brief Submits a command. Safe from any thread, lock-free.
+ *
+ * @return 0 on success, non-zero if out of memory.
+ */
+int WdCmdSubmit(wd_cmd_queue_ty* queue, const wd_cmd_ty* cmd);
+
+/**
+ * @brief Applies every pending command; scheduler thread only.
+ *
+ * @param queue Queue to drain.
+ * @param wd Context for commands that name none.
+ * @return Number of commands applied.
+ */
+int WdCmdDrain(wd_cmd_queue_ty* queue, wd_ty* wd);
+
+/**
+ * @brief Keeps a drain point every second; always returns 1.
+ *
+ * For watchdogs whose own tasks run less often than the scheduler's
+ * one-second tick; the draining itself happens in `WdDispatchTSK`.
+ */
+int WdCmdTSK(void* args);
+
+/**
+ * @brief Returns the queue's eventfd, readable while commands are pending.
+ */
+int WdCmdGetFd(const wd_cmd_queue_ty* queue);
+
+/**
+ * @brief Copies the queue's counters.
+ */
+void WdCmdGetStats(const wd_cmd_queue_ty* queue, wd_cmd_stats_ty* stats);
+
+/**
+ * @brief Submits `WD_CMD_ADD`; the task's name is its expression.
+ */
+#define WdCmdAdd(queue, wd, task, interval) \
+        WdCmdSubmitOp((queue), WD_CMD_ADD, (wd), (task), #task, (interval))
+
+/**
+ * @brief Submits `WD_CMD_RESCHEDULE`; the task's name is its expression.
+ */
+#define WdCmdReschedule(queue, wd, task, interval) \
+        WdCmdSubmitOp((queue), WD_CMD_RESCHEDULE, (wd), (task), #task, \
+                      (interval))
+
+/**
+ * @brief Submits `WD_CMD_REMOVE`.
+ */
+#define WdCmdRemove(queue, wd, task) \
+        WdCmdSubmitOp((queue), WD_CMD_REMOVE, (wd), (task), NULL, 0)
+
+/**
+ * @brief Submits `WD_CMD_RUN`.
+ */
+#define WdCmdRun(queue, wd, task) \
+        WdCmdSubmitOp((queue), WD_CMD_RUN, (wd), (task), #task, 0)
+
+/**
+ * @brief Submits `WD_CMD_STOP`.
+ */
+#define WdCmdStop(queue, wd) \
+        WdCmdSubmitOp((queue), WD_CMD_STOP, (wd), NULL, NULL, 0)
+
+/**
+ * @brief Builds and submits a command; see the macros above.
+ */
+int WdCmdSubmitOp(wd_cmd_queue_ty* queue, wd_cmd_op_ty op, wd_ty* wd,
+                  int (*task)(void*), const char* name,
+                  unsigned long interval);
+
+#endif  /* __WATCHDOG_CMD_H__ */
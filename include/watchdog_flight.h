@@ -0,0 +1,123 @@
+/**
+ * @file watchdog_flight.h
+ * @brief Lock-free flight recorder dumped by the watchdog when the app dies.
+ *
+ * The application records fixed-size events into a ring in shared memory
+ * (`/dev/shm/wd_flight.<pid>`). Recording is a relaxed atomic increment
+ * plus a few stores, with no lock and no system call, so it can stay on
+ * in hot paths. The app never writes the ring to disk itself.
+ *
+ * `watchdog_exec` maps the same ring by the target's pid and writes it to
+ * `<WD_FLIGHT>/wd_flight.<pid>.<reason>.log` right before reviving the
+ * target (`ReviveIfErrorTSK`), or as soon as the target exits (pidfd).
+ *
+ * Enabled by setting `WD_FLIGHT` to an existing directory; otherwise the
+ * recording calls return after a single branch.
+ *
+ * Usage in the application:
+ *      MakeMeImmortal(argc, argv, 6, 4);
+ *      WdFlightNote("loaded config");
+ *      WdFlightRecord(REQ_DONE, req_id, latency_ns);
+ */
+
+#ifndef __WATCHDOG_FLIGHT_H__
+#define __WATCHDOG_FLIGHT_H__
+
+#include <stdint.h>         /* using uint64_t */
+#include <sys/types.h>      /* using pid_t    */
+
+#define WD_FLIGHT_MAGIC     (0x57444652u)   /* "WDFR" */
+#define WD_FLIGHT_VERSION   (1u)
+#define WD_FLIGHT_CAPACITY  (8192u)         /* events; a power of 2 */
+#define WD_FLIGHT_TEXT_LEN  (24)
+
+/**
+ * @struct wd_flight_event
+ * @brief One flight recorder event (64 bytes).
+ */
+typedef struct wd_flight_event
+{
+	uint64_t seq;                       /**< Position + 1, 0 while written */
+	uint64_t ts_ns;                     /**< CLOCK_MONOTONIC timestamp */
+	uint32_t tid;                       /**< Recording thread */
+	uint32_t code;                      /**< Application-defined event code */
+	uint64_t a;                         /**< Application-defined argument */
+	uint64_t b;                         /**< Application-defined argument */
+	char     text[WD_FLIGHT_TEXT_LEN];  /**< Optional short note */
+} wd_flight_event_ty;
+
+/**
+ * @struct wd_flight_ring
+ * @brief Shared-memory layout of the ring.
+ */
+typedef struct wd_flight_ring
+{
+	uint32_t magic;                     /**< WD_FLIGHT_MAGIC */
+	uint32_t version;                   /**< WD_FLIGHT_VERSION */
+	uint32_t capacity;                  /**< WD_FLIGHT_CAPACITY */
+	uint32_t pid;                       /**< Recording process */
+	uint64_t mono_at_create_ns;         /**< CLOCK_MONOTONIC at creation */
+	uint64_t real_at_create_ns;         /**< CLOCK_REALTIME at creation */
+	uint64_t head;                      /**< Events ever claimed */
+	char     pad[24];                   /**< Keeps `head` off event lines */
+	wd_flight_event_ty events[WD_FLIGHT_CAPACITY];
+} wd_flight_ring_ty;
+
+/**
+ * @brief The calling process' ring, or NULL while disabled.
+ */
+extern wd_flight_ring_ty* g_wd_flight;
+
+/**
+ * @brief Creates this process' ring if `WD_FLIGHT` is set.
+ *
+ * Called by `MakeMeImmortal`.
+ *
+ * @return 0 on success or when disabled, non-zero on failure.
+ */
+int WdFlightCreate(void);
+
+/**
+ * @brief Removes this process' ring (e.g. on an intentional exit).
+ *
+ * Only unlinks it: threads still recording keep writing into the mapping,
+ * which goes away with the process.
+ */
+void WdFlightRemove(void);
+
+/**
+ * @brief Records an event with a code and two arguments.
+ *
+ * Safe to call from any thread, and from signal handlers.
+ */
+void WdFlightRecord(unsigned int code, uint64_t a, uint64_t b);
+
+/**
+ * @brief Records a short text note (truncated to WD_FLIGHT_TEXT_LEN - 1).
+ */
+void WdFlightNote(const char* text);
+
+/**
+ * @brief Writes the ring of process `pid` to disk and removes it.
+ *
+ * Called by the watchdog; does nothing if `WD_FLIGHT` is unset or `pid`
+ * has no ring (e.g. it was already dumped).
+ *
+ * @param pid Process whose ring to dump.
+ * @param reason Short word used in the file name ("revive", "exit").
+ * @return 0 if a dump was written, non-zero otherwise.
+ */
+int WdFlightDump(pid_t pid, const char* reason);
+
+/**
+ * @brief Watchdog task: dumps the target's ring as soon as it exits.
+ *
+ * Watches a pidfd of `wd->target_pid`; needs Linux 5.3 or later and
+ * stops itself where pidfds are unavailable.
+ *
+ * @param args Pointer to `wd_ty` structure.
+ * @return 0 once the target exited, 1 otherwise (continue).
+ */
+int WdFlightWatchTSK(void* args);
+
+#endif  /* __WATCHDOG_FLIGHT_H__ */
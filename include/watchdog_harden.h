@@ -0,0 +1,53 @@
+/**
+ * @file watchdog_harden.h
+ * @brief Optional hardened runtime mode for the watchdog.
+ *
+ * When the host is thrashing, the watchdog itself can be paged out or
+ * starved and detect failures late. The hardened mode keeps it responsive:
+ *  - prefaults its stack and heap pool, then locks its memory
+ *  - raises its scheduling priority (SCHED_RR, falling back to nice -10)
+ *  - optionally pins it to a CPU
+ *  - lowers its OOM score and raises the target's
+ *
+ * Every step is best effort: a missing privilege prints a note and the
+ * watchdog carries on unhardened for that step.
+ *
+ * Configured through the environment, so both processes of the pair see it:
+ *  - WD_HARDEN=1            enable the mode
+ *  - WD_HARDEN_CPU=<n>      pin the watchdog to CPU n
+ *  - WD_HARDEN_PRIO=<1..99> real-time priority (default 10)
+ */
+
+#ifndef __WATCHDOG_HARDEN_H__
+#define __WATCHDOG_HARDEN_H__
+
+#define WD_HARDEN_OOM_ADJ_WATCHDOG  (-1000)
+#define WD_HARDEN_OOM_ADJ_TARGET    (500)
+
+/**
+ * @brief Hardens the standalone watchdog process (`watchdog_exec`).
+ *
+ * Locks all current and future memory with `mlockall` after prefaulting.
+ * Does nothing unless `WD_HARDEN` is set.
+ */
+void WdHardenProcess(void);
+
+/**
+ * @brief Hardens the calling watchdog thread inside the client process.
+ *
+ * Only the thread's stack is locked, so the application's own memory is
+ * left alone; the client process gets the target OOM score.
+ * Does nothing unless `WD_HARDEN` is set.
+ */
+void WdHardenThread(void);
+
+/**
+ * @brief Undoes the watchdog settings before `execv` of the target.
+ *
+ * Scheduling policy, CPU affinity and OOM score survive `execv`; the
+ * revived target must not inherit the watchdog's.
+ * Does nothing unless `WD_HARDEN` is set.
+ */
+void WdHardenResetForTarget(void);
+
+#endif  /* __WATCHDOG_HARDEN_H__ */
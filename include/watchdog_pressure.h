@@ -0,0 +1,66 @@
+/**
+ * @file watchdog_pressure.h
+ * @brief Load-aware detection using Linux pressure stall information (PSI).
+ *
+ * During a host-wide CPU, memory or IO stall every target misses its
+ * heartbeats at once. Killing them all on the usual `max_fails` makes the
+ * overload worse and turns a brownout into an outage. With this option the
+ * watchdog reads `/proc/pressure/{cpu,memory,io}` and, while the highest
+ * "some avg10" value is at or above a threshold:
+ *  - stretches the detection deadline: `max_fails` is multiplied by
+ *    1 + pressure / threshold, at most WD_PRESSURE_MAX_STRETCH;
+ *  - staggers revives: each due revive waits a random delay of up to
+ *    WD_PRESSURE_STAGGER_S seconds, which spreads the watchdog processes
+ *    of a host apart, and the revives of one process are at least
+ *    WD_PRESSURE_REVIVE_GAP_S seconds apart.
+ *
+ * The three files are opened once and re-read with `pread` at most once a
+ * second, so sampling costs three small reads. Hosts without PSI (or
+ * without permission to read it) behave as if the option were off.
+ *
+ * Configured through the environment, so both processes of the pair see it:
+ *  - WD_PRESSURE=<percent>     enable, with this threshold (e.g. 20)
+ *  - WD_PRESSURE_DIR=<dir>     read the files from dir (default /proc/pressure)
+ */
+
+#ifndef __WATCHDOG_PRESSURE_H__
+#define __WATCHDOG_PRESSURE_H__
+
+#include "watchdog_utils.h"     /* using wd_ty */
+
+#define WD_PRESSURE_ENV             "WD_PRESSURE"
+#define WD_PRESSURE_DIR_ENV         "WD_PRESSURE_DIR"
+#define WD_PRESSURE_DIR             "/proc/pressure"
+#define WD_PRESSURE_MAX_STRETCH     (4)
+#define WD_PRESSURE_STAGGER_S       (10)
+#define WD_PRESSURE_REVIVE_GAP_S    (2)
+
+/**
+ * @brief Returns the highest "some avg10" pressure (percent) of cpu,
+ *        memory and io, sampled at most once a second.
+ *
+ * @return Pressure in percent, or -1 if the option is off or PSI is
+ *         unavailable.
+ */
+double WdPressureGet(void);
+
+/**
+ * @brief Returns the missed checks that trigger a revive under the current
+ *        pressure: `wd->max_fails`, stretched while pressure is high unless
+ *        the peer process already exited.
+ */
+unsigned long WdPressureMaxFails(const wd_ty* wd);
+
+/**
+ * @brief Decides whether a due revive has to wait for its turn.
+ *
+ * Called by `ReviveIfErrorTSK` every time it finds the peer failed; the
+ * revive goes ahead on the first call that returns 0. A peer process that
+ * exited is revived right away, without a stagger or a turn.
+ *
+ * @param wd Watchdog context about to revive its peer.
+ * @return Non-zero to wait, 0 to revive now.
+ */
+int WdPressureDeferRevive(wd_ty* wd);
+
+#endif  /* __WATCHDOG_PRESSURE_H__ */
@@ -0,0 +1,146 @@
+/**
+ * @file watchdog_probe.h
+ * @brief Application-level health probes over Unix sockets or loopback TCP.
+ *
+ * A process that answers SIGUSR1 can still have a wedged request path. A
+ * probe exercises the service itself: it connects to the peer's endpoint,
+ * sends a configured request and expects a reply starting with a
+ * configured prefix within a timeout.
+ *
+ * Probes are grouped in a set that owns one epoll instance. Every probe is
+ * a non-blocking socket driven by a small state machine (connect, send,
+ * receive), so thousands of them are in flight at once and
+ * `WdProbeTSK` never blocks the scheduler. The set's descriptor
+ * (`WdProbeGetFd`) becomes readable whenever a probe can make progress,
+ * for loops that want to call `WdProbePump` sooner than once a second.
+ *
+ * A failed probe (refused, reset, wrong reply or timeout) counts as a
+ * missed check in the same `wd->fails` that `CheckSolTSK` maintains, so
+ * `ReviveIfErrorTSK` revives a peer whose request path is wedged. A
+ * heartbeat does not clear failures counted by probes; the next successful
+ * probe does. Probes wait while the peer is starting up.
+ *
+ * The standalone watchdog process probes its client when `WD_PROBE` is set:
+ *      WD_PROBE=unix:/run/app.sock | tcp:127.0.0.1:8080
+ *      WD_PROBE_SEND="PING\n"          request; \n, \r, \t, \\ are escapes
+ *      WD_PROBE_EXPECT="PONG"          reply prefix; any reply when unset
+ *      WD_PROBE_TIMEOUT_MS=1000        WD_PROBE_INTERVAL=5 (seconds)
+ */
+
+#ifndef __WATCHDOG_PROBE_H__
+#define __WATCHDOG_PROBE_H__
+
+#include <stddef.h>             /* using size_t */
+
+#include "watchdog_utils.h"     /* using wd_ty */
+
+#define WD_PROBE_ENV                "WD_PROBE"
+#define WD_PROBE_SEND_ENV           "WD_PROBE_SEND"
+#define WD_PROBE_EXPECT_ENV         "WD_PROBE_EXPECT"
+#define WD_PROBE_TIMEOUT_ENV        "WD_PROBE_TIMEOUT_MS"
+#define WD_PROBE_INTERVAL_ENV       "WD_PROBE_INTERVAL"
+#define WD_PROBE_TIMEOUT_MS         (1000)
+#define WD_PROBE_INTERVAL_S         (5)
+#define WD_PROBE_REPLY_MAX          (256)   /* longest expected prefix */
+
+/**
+ * @typedef wd_probe_ty
+ * @brief Opaque set of probes sharing one epoll instance.
+ */
+typedef struct wd_probe wd_probe_ty;
+
+/**
+ * @struct wd_probe_spec
+ * @brief What to probe and what counts as healthy.
+ */
+typedef struct wd_probe_spec
+{
+	const char*     endpoint;       /**< "unix:<path>" or "tcp:<ipv4>:<port>" */
+	const char*     request;        /**< Sent after connecting, or NULL */
+	size_t          request_len;
+	const char*     expect;         /**< Reply prefix, or NULL for any reply;
+	                                     with no request either, connecting
+	                                     is enough */
+	unsigned long   timeout_ms;     /**< Connect to reply */
+	unsigned long   interval;       /**< Seconds between probe starts */
+} wd_probe_spec_ty;
+
+/**
+ * @struct wd_probe_stats
+ * @brief Counters of a probe set.
+ */
+typedef struct wd_probe_stats
+{
+	unsigned long   started;
+	unsigned long   succeeded;
+	unsigned long   failed;         /**< Refused, reset or wrong reply */
+	unsigned long   timed_out;
+	unsigned long   in_flight;
+	unsigned long   max_in_flight;
+} wd_probe_stats_ty;
+
+/**
+ * @brief Creates an empty probe set.
+ *
+ * @return New set, or NULL on failure.
+ */
+wd_probe_ty* WdProbeCreate(void);
+
+/**
+ * @brief Closes every probe socket and frees the set.
+ *
+ * Watchdogs attached to the set must not be probed afterwards.
+ */
+void WdProbeDestroy(wd_probe_ty* probes);
+
+/**
+ * @brief Adds a probe of `wd`'s peer to the set.
+ *
+ * The spec's strings are copied.
+ *
+ * @param probes Set to add to.
+ * @param wd Watchdog context whose fail counter the probe feeds.
+ * @param spec Endpoint, request, expected reply and timing.
+ * @return 0 on success, non-zero on failure (e.g. a malformed endpoint).
+ */
+int WdProbeAttach(wd_probe_ty* probes, wd_ty* wd,
+                  const wd_probe_spec_ty* spec);
+
+/**
+ * @brief Creates a set probing `wd`'s peer as configured by `WD_PROBE`.
+ *
+ * @return New set, or NULL when `WD_PROBE` is unset or on failure.
+ */
+wd_probe_ty* WdProbeFromEnv(wd_ty* wd);
+
+/**
+ * @brief Scheduler task: starts due probes, advances the ones in flight
+ *        and fails the ones past their timeout.
+ *
+ * Never blocks; should run every second on the watchdogs' scheduler.
+ *
+ * @param args Pointer to the `wd_probe_ty` set.
+ * @return Always returns 1 (continue).
+ */
+int WdProbeTSK(void* args);
+
+/**
+ * @brief Advances every probe whose socket is ready, without blocking.
+ *
+ * @param probes Set to pump.
+ * @return Number of probes that completed (succeeded or failed).
+ */
+int WdProbePump(wd_probe_ty* probes);
+
+/**
+ * @brief Returns the set's epoll descriptor, readable when `WdProbePump`
+ *        has work to do.
+ */
+int WdProbeGetFd(const wd_probe_ty* probes);
+
+/**
+ * @brief Copies the set's counters.
+ */
+void WdProbeGetStats(const wd_probe_ty* probes, wd_probe_stats_ty* stats);
+
+#endif  /* __WATCHDOG_PROBE_H__ */
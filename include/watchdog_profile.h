@@ -0,0 +1,151 @@
+/**
+ * @file watchdog_profile.h
+ * @brief Revive critical-path profiler: where the time of a revive goes.
+ *
+ * Every revive is timed phase by phase, on CLOCK_MONOTONIC:
+ *      detected        `ReviveIfErrorTSK` decided to revive
+ *      kill sent       SIGKILL delivered to the failed peer
+ *      exit confirmed  the peer is gone (reaped if it is our child)
+ *      spawned         `fork` returned in the new child (none on the
+ *                      exec path, where the watchdog process becomes the
+ *                      client)
+ *      exec done       the new image was loaded (library constructor)
+ *      main entered    `MakeMeImmortal`, or main of the watchdog process
+ *      ready           `WdNotifyReady`
+ *      first heartbeat the watcher got the new instance's first heartbeat
+ *
+ * The first four timestamps are taken by the reviver and cross `execv` in
+ * `WD_REVIVE`, set in the new instance's environment only (see
+ * `WdSetChildEnv`); "spawned" is written into that variable in place by
+ * the forked child, since it must not allocate between `fork` and `execv`.
+ * "Exit confirmed" is checked without blocking right after the kill and,
+ * if the peer was still exiting, once more when the revive task runs.
+ * The new instance adds its own timestamps and publishes the record in
+ * the shared pair state; the watcher closes it on the first heartbeat and
+ * folds the phase durations into a ring of the last WD_PROFILE_RING
+ * revives per role, which `WdProfileSummarize` (and the
+ * `watchdog_profile_dump` tool) turns into per-phase last/p50/mean/max
+ * while the pair runs.
+ */
+
+#ifndef __WATCHDOG_PROFILE_H__
+#define __WATCHDOG_PROFILE_H__
+
+#include <stdint.h>     /* using uint64_t */
+
+#define WD_PROFILE_ENV          "WD_REVIVE"
+#define WD_PROFILE_RING         (32)
+#define WD_PROFILE_SKIPPED      (UINT64_MAX)    /* phase not reached */
+
+struct wd;
+
+/**
+ * @enum wd_phase
+ * @brief Phases of a revive, in critical-path order.
+ */
+typedef enum wd_phase
+{
+	WD_PHASE_DETECTED,
+	WD_PHASE_KILL_SENT,
+	WD_PHASE_EXIT_CONFIRMED,
+	WD_PHASE_SPAWNED,
+	WD_PHASE_EXEC_DONE,
+	WD_PHASE_MAIN,
+	WD_PHASE_READY,
+	WD_PHASE_FIRST_HEARTBEAT,
+	WD_PHASES
+} wd_phase_ty;
+
+/**
+ * @struct wd_profile
+ * @brief Revive timings of one role, kept in the shared pair state.
+ */
+typedef struct wd_profile
+{
+	uint32_t generation;                /**< Instance `cur` belongs to */
+	uint32_t revives;                   /**< Revives folded into `ring` */
+	uint64_t cur[WD_PHASES];            /**< Timestamps of the latest revive,
+	                                         0 for phases not reached */
+	uint64_t ring[WD_PROFILE_RING][WD_PHASES];  /**< Time spent reaching
+	                                         each phase, WD_PROFILE_SKIPPED
+	                                         if skipped; the reached ones
+	                                         add up to the DETECTED total */
+} wd_profile_ty;
+
+/**
+ * @struct wd_profile_summary
+ * @brief Rolling statistics of one phase.
+ */
+typedef struct wd_profile_summary
+{
+	unsigned long   count;      /**< Revives that went through the phase */
+	uint64_t        last_ns;
+	uint64_t        p50_ns;
+	uint64_t        mean_ns;
+	uint64_t        max_ns;
+} wd_profile_summary_ty;
+
+/**
+ * @brief Records a reviver-side phase (detected, kill sent, exit confirmed).
+ */
+void WdProfileMark(struct wd* wd, wd_phase_ty phase);
+
+/**
+ * @brief Records a phase of the calling instance itself (main, ready).
+ */
+void WdProfileMarkSelf(wd_phase_ty phase);
+
+/**
+ * @brief Checks, without blocking, whether the killed peer has exited;
+ *        if so, reaps it when it is our child and records "exit confirmed".
+ *
+ * @return 0 once the peer is gone, non-zero while it is still exiting or
+ *         on failure.
+ */
+int WdProfileCheckExit(struct wd* wd);
+
+/**
+ * @brief Exports the reviver's timestamps in `WD_REVIVE` for the peer about
+ *        to be forked or exec'd; does nothing if no revive is in progress.
+ *
+ * First finishes the exit check of a peer that was still exiting when
+ * `ReviveIfErrorTSK` killed it.
+ */
+void WdProfileExport(struct wd* wd);
+
+/**
+ * @brief Withdraws `WD_REVIVE` once the child was forked.
+ */
+void WdProfileUnexport(struct wd* wd);
+
+/**
+ * @brief Stamps "spawned" into the child's copy of `WD_REVIVE`, in place.
+ *
+ * Async-signal-safe; called by the child between `fork` and `execv`.
+ */
+void WdProfileStampChild(struct wd* wd);
+
+/**
+ * @brief Publishes the calling instance's revive record in the pair state.
+ */
+void WdProfilePublish(struct wd* wd);
+
+/**
+ * @brief Closes the peer's revive record on its first heartbeat.
+ *
+ * Called by `CheckSolTSK` on every heartbeat; only the first one after a
+ * revive is recorded.
+ */
+void WdProfileHeartbeat(struct wd* wd);
+
+/**
+ * @brief Computes the rolling per-phase statistics of a role.
+ *
+ * @param profile Role's profile (e.g. from a mapped state block).
+ * @param summary Receives one entry per phase; entry WD_PHASE_DETECTED
+ *                holds the total from detection to first heartbeat.
+ */
+void WdProfileSummarize(const wd_profile_ty* profile,
+                        wd_profile_summary_ty summary[WD_PHASES]);
+
+#endif  /* __WATCHDOG_PROFILE_H__ */
@@ -0,0 +1,120 @@
+/**
+ * @file watchdog_ready.h
+ * @brief Readiness protocol between a started process and whoever watches it.
+ *
+ * A freshly started peer is not checked for missed heartbeats until it
+ * reports ready, or until its startup deadline passes, which then counts
+ * as a failure and revives it. Readiness arrives over one of two channels:
+ *  - an inherited pipe, when the watcher spawned the peer itself: the
+ *    write end is passed in `WD_READY_FD` (set in the child's environment
+ *    only) and the peer calls `WdNotifyReady`, which writes its
+ *    CLOCK_MONOTONIC time of readiness. The library takes the variable
+ *    before `main` runs, so it never reaches the peer's own children;
+ *  - the heartbeat channel, when the peer was exec'd by a watchdog that
+ *    no longer exists (a revived client): it is ready when it publishes
+ *    its time of readiness in the shared state block, or at its first
+ *    heartbeat when there is no block.
+ *
+ * The time from start to ready is traced ("ready", in ms) and, with a
+ * shared state block, kept per role (last, mean, max) across revives.
+ *
+ * A client opts in to reporting its own readiness by setting
+ * `WD_STARTUP_DEADLINE` (seconds): its watchdog thread then sends no
+ * heartbeat until the app calls `WdNotifyReady`. Without it the client is
+ * ready once `MakeMeImmortal` runs. The same deadline (default
+ * WD_STARTUP_DEADLINE_S) applies to a spawned watchdog process.
+ */
+
+#ifndef __WATCHDOG_READY_H__
+#define __WATCHDOG_READY_H__
+
+#include <stdint.h>             /* using uint64_t */
+
+#include "watchdog_utils.h"     /* using wd_ty */
+
+#define WD_READY_FD_ENV             "WD_READY_FD"
+#define WD_STARTUP_DEADLINE_ENV     "WD_STARTUP_DEADLINE"
+#define WD_STARTUP_DEADLINE_S       (30)
+
+/**
+ * @brief Tells whoever started this process that it is ready.
+ *
+ * Safe to call when nobody waits for it; later calls do nothing.
+ *
+ * @return 0 on success or when nobody waits, non-zero on failure.
+ */
+int WdNotifyReady(void);
+
+/**
+ * @brief Returns when this process called `WdNotifyReady` (CLOCK_MONOTONIC
+ *        ns), or 0 if it did not yet.
+ */
+uint64_t WdReadyNs(void);
+
+/**
+ * @brief Returns the startup deadline in seconds (`WD_STARTUP_DEADLINE`,
+ *        or WD_STARTUP_DEADLINE_S when unset).
+ */
+unsigned long WdStartupDeadline(void);
+
+/**
+ * @brief Creates a readiness pipe and exports its write end for the next
+ *        process `wd` spawns (see `WdSetChildEnv`).
+ *
+ * @param wd Watchdog context that spawns the process.
+ * @param fds Receives the read end (fds[0]) and write end (fds[1]).
+ * @return 0 on success, non-zero on failure.
+ */
+int WdReadyExport(wd_ty* wd, int fds[2]);
+
+/**
+ * @brief Withdraws the exported write end once the process was spawned.
+ *
+ * @param wd Watchdog context passed to `WdReadyExport`.
+ * @param fds Pipe from `WdReadyExport`; fds[1] is closed and set to -1.
+ */
+void WdReadyUnexport(wd_ty* wd, int fds[2]);
+
+/**
+ * @brief Reads a readiness report from the read end, without blocking.
+ *
+ * @param fd Read end of the readiness pipe.
+ * @param ready_ns Receives the peer's time of readiness; the time of the
+ *                 read when the report is not a `WdNotifyReady` timestamp.
+ * @return 1 if ready, 0 if not yet, -1 if the pipe closed without a report.
+ */
+int WdReadyRead(int fd, uint64_t* ready_ns);
+
+/**
+ * @brief Spawns the target with a readiness pipe and a startup deadline.
+ *
+ * Like `WdSpawnTarget`, but `CheckSolTSK` ignores missed heartbeats until
+ * the target calls `WdNotifyReady`.
+ *
+ * @param wd Watchdog context.
+ */
+void WdSpawnAwaitingReady(wd_ty* wd);
+
+/**
+ * @brief Waits for the target's first heartbeat before counting misses.
+ *
+ * Forgets the startup of any previous target: no readiness pipe, a new
+ * deadline from now, and readiness taken from the state block or the first
+ * heartbeat. Also used for an instance another peer started (follow).
+ *
+ * @param wd Watchdog context.
+ * @param started_ns When the target was started (CLOCK_MONOTONIC).
+ */
+void WdAwaitHeartbeatReady(wd_ty* wd, uint64_t started_ns);
+
+/**
+ * @brief Advances the target's startup; called by `CheckSolTSK`.
+ *
+ * @param wd Watchdog context.
+ * @param is_heartbeat Non-zero if a heartbeat arrived since the last check.
+ * @return 1 if the target is ready, 0 if it is still starting, -1 if it
+ *         missed its startup deadline (or died before being ready).
+ */
+int WdPollReady(wd_ty* wd, int is_heartbeat);
+
+#endif  /* __WATCHDOG_READY_H__ */
@@ -0,0 +1,187 @@
+/**
+ * @file watchdog_state.h
+ * @brief State block shared by the client and its watchdog across revives.
+ *
+ * Both processes of a pair map one small block in shared memory
+ * (`/dev/shm/wd_state.<pid of the first client>`). Its name travels in
+ * `WD_STATE` through fork and execv, so every later instance of either
+ * role finds it. For each role the block holds:
+ *  - a generation, bumped (compare-and-swap) by whoever starts a new
+ *    instance; only the caller whose swap succeeds may spawn, so two
+ *    racing revives cannot start two instances;
+ *  - the pid and lease of the instance holding that generation; the
+ *    holder renews its lease every second and exits as soon as it sees a
+ *    newer generation (it was superseded), which leaves exactly one live
+ *    instance per role;
+ *  - the missed heartbeats its peer counted, its revive count and the time
+ *    of its last revive and last heartbeat, so a revived peer resumes
+ *    counting where the previous one stopped;
+ *  - when it reported ready, and its time-to-ready over all starts
+ *    (see watchdog_ready.h);
+ *  - the phase timings of its recent revives (see watchdog_profile.h).
+ *
+ * A watchdog context joins the block with `WdStateAttach`; every hook in
+ * the heartbeat tasks is skipped while `wd->state` is NULL.
+ */
+
+#ifndef __WATCHDOG_STATE_H__
+#define __WATCHDOG_STATE_H__
+
+#include <stdint.h>             /* using uint64_t */
+
+#include "watchdog_utils.h"     /* using wd_ty */
+#include "watchdog_profile.h"   /* using wd_profile_ty */
+
+#define WD_STATE_ENV        "WD_STATE"
+#define WD_STATE_MAGIC      (0x57445354u)   /* "WDST" */
+#define WD_STATE_VERSION    (3u)
+#define WD_STATE_LEASE_NS   (3 * WD_NS_PER_SEC)
+
+#define WD_ROLE_CLIENT      (0)
+#define WD_ROLE_WATCHDOG    (1)
+#define WD_ROLES            (2)
+
+/**
+ * @struct wd_state_role
+ * @brief What the block knows about one role.
+ */
+typedef struct wd_state_role
+{
+	uint32_t generation;        /**< Bumped for every new instance */
+	int32_t  pid;               /**< Instance holding `generation` */
+	uint64_t lease_ns;          /**< Holder is alive until (CLOCK_MONOTONIC) */
+	uint64_t fails;             /**< Missed heartbeats counted by the peer */
+	uint64_t revives;           /**< Instances started after the first */
+	uint64_t last_revive_ns;    /**< Start of the current generation */
+	uint64_t last_heartbeat_ns; /**< Last heartbeat the peer got from it */
+	uint64_t ready_at_ns;       /**< When the current instance got ready */
+	uint64_t time_to_ready_ns;  /**< Start to ready, current instance */
+	uint64_t max_time_to_ready_ns;
+	uint64_t total_time_to_ready_ns;
+	uint64_t readies;           /**< Starts that reported ready in time */
+	uint64_t deadline_misses;   /**< Starts that missed the deadline */
+	wd_profile_ty profile;      /**< Phase timings of its revives */
+} wd_state_role_ty;
+
+/**
+ * @struct wd_state
+ * @brief Shared-memory layout of the block.
+ */
+typedef struct wd_state
+{
+	uint32_t         magic;     /**< WD_STATE_MAGIC */
+	uint32_t         version;   /**< WD_STATE_VERSION */
+	uint64_t         created_ns;
+	wd_state_role_ty roles[WD_ROLES];
+} wd_state_ty;
+
+/**
+ * @brief Maps the block named by `WD_STATE`, creating the block if needed.
+ *
+ * The first client of a lineage names the block and exports the name in
+ * `WD_STATE` for its watchdog and every later revive.
+ *
+ * @param may_create Non-zero to name a new block when `WD_STATE` is unset.
+ * @return Mapped block, or NULL on failure or when there is none.
+ */
+wd_state_ty* WdStateOpen(int may_create);
+
+/**
+ * @brief Maps an existing block read-only by name, for inspection.
+ *
+ * @return Mapped block, or NULL if there is none.
+ */
+const wd_state_ty* WdStateOpenByName(const char* name);
+
+/**
+ * @brief Unmaps a block.
+ */
+void WdStateClose(const wd_state_ty* state);
+
+/**
+ * @brief Removes the block of this lineage (e.g. on an intentional exit).
+ */
+void WdStateRemove(void);
+
+/**
+ * @brief Joins `wd` to the block as the current instance of `role`.
+ *
+ * Records the caller's pid for the role's current generation, learns the
+ * peer's generation and pid, and resumes the missed heartbeats of the
+ * peer's current generation.
+ *
+ * @param wd Watchdog context of the calling instance.
+ * @param state Block of the pair.
+ * @param role WD_ROLE_CLIENT or WD_ROLE_WATCHDOG.
+ */
+void WdStateAttach(wd_ty* wd, wd_state_ty* state, int role);
+
+/**
+ * @brief Claims the right to start the next instance of the peer's role.
+ *
+ * Must be called right before spawning or exec-ing the peer.
+ *
+ * @param wd Watchdog context about to start its peer.
+ * @return 0 if the caller owns the new generation and must start it,
+ *         non-zero if another instance already did (`wd` then follows it).
+ */
+int WdStateBeginRevive(wd_ty* wd);
+
+/**
+ * @brief Returns non-zero if a newer instance of `wd`'s own role exists.
+ */
+int WdStateIsSuperseded(const wd_ty* wd);
+
+/**
+ * @brief Returns non-zero if the peer holds a live lease, i.e. its
+ *        watchdog tasks still run even though heartbeats went missing.
+ */
+int WdStateIsTargetLeased(const wd_ty* wd);
+
+/**
+ * @brief Returns non-zero if the peer was replaced since `wd` last looked,
+ *        in which case `wd` now follows the new instance.
+ */
+int WdStateFollowTarget(wd_ty* wd);
+
+/**
+ * @brief Stores the peer's missed heartbeats (and last heartbeat time).
+ *
+ * @param wd Watchdog context.
+ * @param is_heartbeat Non-zero if a heartbeat just arrived.
+ */
+void WdStateSaveFails(wd_ty* wd, int is_heartbeat);
+
+/**
+ * @brief Records when the calling instance got ready.
+ */
+void WdStateSetReadyAt(wd_ty* wd, uint64_t ready_ns);
+
+/**
+ * @brief Returns when the peer got ready, or 0 if unknown.
+ */
+uint64_t WdStateGetTargetReadyAt(const wd_ty* wd);
+
+/**
+ * @brief Returns when the peer's current generation was started, or 0.
+ */
+uint64_t WdStateGetTargetStartedNs(const wd_ty* wd);
+
+/**
+ * @brief Records how the peer's startup went.
+ *
+ * @param wd Watchdog context.
+ * @param time_to_ready_ns Start to ready, if `is_ready`.
+ * @param is_ready Non-zero if ready in time, 0 if the deadline was missed.
+ */
+void WdStateSaveStartup(wd_ty* wd, uint64_t time_to_ready_ns, int is_ready);
+
+/**
+ * @brief Scheduler task: renews the own lease and exits if superseded.
+ *
+ * @param args Pointer to `wd_ty` structure.
+ * @return Always returns 1 (continue).
+ */
+int WdStateLeaseTSK(void* args);
+
+#endif  /* __WATCHDOG_STATE_H__ */
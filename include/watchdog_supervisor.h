@@ -0,0 +1,169 @@
+/**
+ * @file watchdog_supervisor.h
+ * @brief Supervisor of a group of processes with dependencies and restart strategies.
+ *
+ * A supervisor is given a declarative graph of children. Each child names
+ * the children it depends on, and is started only once all of them are
+ * ready, so independent children start in parallel and a full cold start
+ * takes the length of the longest dependency chain rather than the sum of
+ * all startups.
+ *
+ * A child that reports readiness gets the write end of a pipe in
+ * `WD_READY_FD` and calls `WdNotifyReady` once it can serve (see
+ * watchdog_ready.h); other children are ready as soon as they are spawned.
+ *
+ * When a child exits, the supervisor's strategy decides what restarts:
+ *  - `WD_SUP_ONE_FOR_ONE`:  only that child.
+ *  - `WD_SUP_ONE_FOR_ALL`:  every child (the others are killed first).
+ *  - `WD_SUP_REST_FOR_ONE`: that child and every child declared after it.
+ * Restarted children go through the same dependency-ordered startup.
+ *
+ * A child that exits more than `max_restarts` times within `period_s`
+ * seconds is given up on: it stays down, and so do the children that
+ * depend on it. `WdSupStart` also gives up once the cold start exceeds its
+ * timeout. Both limits are set with `WdSupSetLimits`.
+ *
+ * Children are plain processes supervised through their exit; they do not
+ * call `MakeMeImmortal` themselves. A supervisor may itself be a child of
+ * another supervisor (it reports ready after `WdSupStart`), which builds a
+ * supervision tree, or be made immortal with `MakeMeImmortal`.
+ *
+ * Usage:
+ *      static char* db[] = {"./db", NULL};
+ *      static char* api[] = {"./api", NULL};
+ *      wd_child_spec_ty specs[] = {{"db", db, NULL, 1},
+ *                                  {"api", api, "db", 1}};
+ *      wd_sup_ty* sup = WdSupCreate(specs, 2, WD_SUP_REST_FOR_ONE, sched);
+ *      WdSupStart(sup);
+ *      SchedAddTask(sched, WdSupTickTSK, DoNothingTSK, sup, NULL, 1);
+ *      SchedRun(sched);
+ */
+
+#ifndef __WATCHDOG_SUPERVISOR_H__
+#define __WATCHDOG_SUPERVISOR_H__
+
+#include <stddef.h>             /* using size_t   */
+#include <stdint.h>             /* using uint64_t */
+
+#include "scheduler.h"          /* using scheduler_ty  */
+#include "watchdog_ready.h"     /* using WdNotifyReady */
+
+#define WD_SUP_MAX_DEPS         (16)
+#define WD_SUP_MAX_RESTARTS     (5)     /* default restart intensity: */
+#define WD_SUP_RESTART_PERIOD_S (60)    /* restarts per period per child */
+#define WD_SUP_START_TIMEOUT_S  (120)   /* default cold start limit */
+#define WD_SUP_RESTARTS_KEPT    (64)    /* max_restarts is below this */
+
+/**
+ * @enum wd_sup_strategy
+ * @brief What to restart when a child exits.
+ */
+typedef enum wd_sup_strategy
+{
+	WD_SUP_ONE_FOR_ONE,
+	WD_SUP_ONE_FOR_ALL,
+	WD_SUP_REST_FOR_ONE
+} wd_sup_strategy_ty;
+
+/**
+ * @struct wd_child_spec
+ * @brief Declaration of one supervised child.
+ */
+typedef struct wd_child_spec
+{
+	const char* name;           /**< Unique name of the child */
+	char**      args;           /**< NULL-terminated argv; args[0] is the path */
+	const char* depends_on;     /**< Comma-separated names declared earlier, or NULL */
+	int         reports_ready;  /**< Non-zero if the child calls WdNotifyReady */
+} wd_child_spec_ty;
+
+/**
+ * @typedef wd_sup_ty
+ * @brief Opaque supervisor.
+ */
+typedef struct wd_sup wd_sup_ty;
+
+/**
+ * @brief Creates a supervisor for `n` children.
+ *
+ * Dependencies must name children declared earlier in `specs`, so the
+ * declaration order is a valid startup order and the graph has no cycle.
+ * `specs` must outlive the supervisor.
+ *
+ * @param specs Children to supervise.
+ * @param n Number of children.
+ * @param strategy Restart strategy.
+ * @param scheduler Scheduler `WdSupTickTSK` will run on.
+ * @return New supervisor, or NULL on failure or invalid graph.
+ */
+wd_sup_ty* WdSupCreate(const wd_child_spec_ty* specs, size_t n,
+                       wd_sup_strategy_ty strategy, scheduler_ty* scheduler);
+
+/**
+ * @brief Kills every child still running and frees the supervisor.
+ */
+void WdSupDestroy(wd_sup_ty* sup);
+
+/**
+ * @brief Sets the restart intensity and the cold start timeout.
+ *
+ * @param sup Supervisor.
+ * @param max_restarts Restarts of one child tolerated within `period_s`;
+ *        capped below `WD_SUP_RESTARTS_KEPT`.
+ * @param period_s Length of the sliding restart window, in seconds.
+ * @param start_timeout_s Time `WdSupStart` may take, in seconds.
+ */
+void WdSupSetLimits(wd_sup_ty* sup, unsigned long max_restarts,
+                    unsigned long period_s, unsigned long start_timeout_s);
+
+/**
+ * @brief Starts every child, in parallel where dependencies allow.
+ *
+ * Blocks until all children are ready, restarting children that exit on
+ * the way according to the strategy, then reports this supervisor ready
+ * to its own supervisor if it has one. Gives up when a child exceeds the
+ * restart intensity or the cold start exceeds its timeout; the children
+ * already running are left to `WdSupStopAll`/`WdSupDestroy`.
+ *
+ * @param sup Supervisor.
+ * @return 0 once every child is ready, non-zero if the start failed;
+ *         `WdSupGetFailed` names the child it failed on.
+ */
+int WdSupStart(wd_sup_ty* sup);
+
+/**
+ * @brief Returns the name of the child the supervisor gave up on.
+ *
+ * @return The child that exceeded the restart intensity or held up the
+ *         cold start, or NULL if none did.
+ */
+const char* WdSupGetFailed(const wd_sup_ty* sup);
+
+/**
+ * @brief Scheduler task: reaps exited children and restarts them.
+ *
+ * Never blocks; should run every second on the supervisor's scheduler.
+ *
+ * @param args Pointer to the `wd_sup_ty` supervisor.
+ * @return Always returns 1 (continue).
+ */
+int WdSupTickTSK(void* args);
+
+/**
+ * @brief Kills every running child, last declared first.
+ */
+void WdSupStopAll(wd_sup_ty* sup);
+
+/**
+ * @brief Prints each child's pid, state, restarts and last startup time.
+ */
+void WdSupReport(const wd_sup_ty* sup);
+
+/**
+ * @brief Returns the spawn-to-ready time of the last start of child `i`.
+ *
+ * @return Startup time in nanoseconds, 0 if the child was never ready.
+ */
+uint64_t WdSupGetStartupNs(const wd_sup_ty* sup, size_t i);
+
+#endif  /* __WATCHDOG_SUPERVISOR_H__ */
@@ -0,0 +1,126 @@
+/**
+ * @file watchdog_trace.h
+ * @brief Opt-in execution tracing for the Watchdog system.
+ *
+ * Records begin/end events for every scheduler task dispatch and instant
+ * events for every watchdog state change (missed heartbeat, kill sent,
+ * spawn, exec...). Each thread writes into its own binary ring buffer,
+ * which lives in a file-backed shared mapping so the events survive even
+ * when the process is killed with `SIGKILL`.
+ *
+ * Tracing is enabled by setting the `WD_TRACE` environment variable to an
+ * existing directory before the process starts. The variable is inherited
+ * across `fork` and `execv`, so both sides of the watchdog pair are traced.
+ * The ring files can be converted to Chrome trace JSON (viewable in
+ * Perfetto) with the `watchdog_trace_dump` tool.
+ *
+ * While tracing is disabled, every trace point costs a single branch on
+ * `g_wd_trace_on`.
+ */
+
+#ifndef __WATCHDOG_TRACE_H__
+#define __WATCHDOG_TRACE_H__
+
+#include <stdint.h>     /* using uint32_t, uint64_t */
+
+#define WD_TRACE_MAGIC      (0x57445452u)   /* "WDTR" */
+#define WD_TRACE_VERSION    (1u)
+#define WD_TRACE_CAPACITY   (4096u)         /* events per thread ring */
+#define WD_TRACE_NAME_LEN   (32)
+
+/**
+ * @brief Event phases, matching the Chrome trace `ph` field.
+ */
+enum wd_trace_phase
+{
+	WD_TRACE_BEGIN   = 'B',
+	WD_TRACE_END     = 'E',
+	WD_TRACE_INSTANT = 'i'
+};
+
+/**
+ * @struct wd_trace_event
+ * @brief A single fixed-size trace record (64 bytes).
+ */
+typedef struct wd_trace_event
+{
+	uint64_t ts_ns;                     /**< CLOCK_MONOTONIC timestamp */
+	int64_t  arg;                       /**< Free-form event argument */
+	uint32_t phase;                     /**< One of `wd_trace_phase` */
+	uint32_t reserved;
+	char     name[WD_TRACE_NAME_LEN];   /**< NUL-terminated event name */
+	uint64_t seq;                       /**< Write sequence, 1-based */
+} wd_trace_event_ty;
+
+/**
+ * @struct wd_trace_hdr
+ * @brief Header at the start of every per-thread ring file.
+ */
+typedef struct wd_trace_hdr
+{
+	uint32_t magic;                     /**< WD_TRACE_MAGIC */
+	uint32_t version;                   /**< WD_TRACE_VERSION */
+	uint32_t capacity;                  /**< Number of event slots */
+	uint32_t pid;                       /**< Writing process */
+	uint32_t tid;                       /**< Writing thread */
+	uint32_t reserved;
+	uint64_t head;                      /**< Total events ever written */
+} wd_trace_hdr_ty;
+
+/**
+ * @brief Non-zero when tracing is enabled for this process.
+ *
+ * Read directly by the trace macros; do not modify.
+ */
+extern int g_wd_trace_on;
+
+/**
+ * @brief Enables tracing if the `WD_TRACE` environment variable is set.
+ *
+ * Safe to call more than once; only the first call has an effect.
+ */
+void WdTraceInit(void);
+
+/**
+ * @brief Appends an event to the calling thread's ring buffer.
+ *
+ * Prefer the `WD_TRACE_*` macros, which skip the call while disabled.
+ * The ring is created lazily on the first event of each thread.
+ *
+ * @param phase One of `wd_trace_phase`.
+ * @param name Event name (truncated to WD_TRACE_NAME_LEN - 1).
+ * @param arg Free-form argument (pid, fail count, signal...).
+ */
+void WdTraceRecord(int phase, const char* name, long arg);
+
+/**
+ * @brief Finds the most recent event called `name` in a ring file.
+ *
+ * Lets an external observer (e.g. the chaos harness) follow a live
+ * process without stopping it.
+ *
+ * @param path Path of a `wd_trace.<pid>.<tid>.bin` file.
+ * @param name Event name to look for.
+ * @return CLOCK_MONOTONIC timestamp in ns, or 0 if not found.
+ */
+uint64_t WdTraceLastEventNs(const char* path, const char* name);
+
+#define WD_TRACE_B(name, arg)                               \
+        do {                                                \
+            if (g_wd_trace_on)                              \
+                WdTraceRecord(WD_TRACE_BEGIN, (name), (arg));  \
+        } while (0)
+
+#define WD_TRACE_E(name, arg)                               \
+        do {                                                \
+            if (g_wd_trace_on)                              \
+                WdTraceRecord(WD_TRACE_END, (name), (arg));    \
+        } while (0)
+
+#define WD_TRACE_I(name, arg)                               \
+        do {                                                \
+            if (g_wd_trace_on)                              \
+                WdTraceRecord(WD_TRACE_INSTANT, (name), (arg)); \
+        } while (0)
+
+#endif  /* __WATCHDOG_TRACE_H__ */
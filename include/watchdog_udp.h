@@ -0,0 +1,127 @@
+/**
+ * @file watchdog_udp.h
+ * @brief UDP heartbeat transport for cross-host peer watchdogs.
+ *
+ * A hub owns one non-blocking UDP socket that serves any number of peers.
+ * Each peer is a watchdog context (`wd_ty`) whose `sol_ops` are replaced
+ * by the hub's, so the usual `SendSolTSK`/`CheckSolTSK`/`ReviveIfErrorTSK`
+ * work unchanged:
+ *  - `SendSolTSK` queues a sequence-numbered heartbeat entry; entries for
+ *    the same remote address are batched into one datagram.
+ *  - `CheckSolTSK` drains the socket and reports whether the peer's
+ *    heartbeat arrived since the previous check. Duplicated or reordered
+ *    entries are dropped and gaps are counted as losses.
+ *
+ * Every hub stamps its datagrams with an epoch drawn when it is created.
+ * A peer whose epoch changes was restarted and counts from 1 again, so its
+ * sequence is followed afresh. `WdClearTasks` (e.g. on revive) forgets the
+ * peer's sequence too.
+ *
+ * Batches go out when full and from `WdUdpFlushTSK`, which should run on
+ * the same scheduler every second.
+ *
+ * Signals other than the heartbeat cannot cross hosts; the peer's
+ * `revive_task` decides what a lost remote peer means.
+ *
+ * Wire format (network byte order):
+ *      header: magic(4) version(2) count(2) epoch(4)
+ *      entry:  from_id(4) to_id(4) seq(4)      x count
+ */
+
+#ifndef __WATCHDOG_UDP_H__
+#define __WATCHDOG_UDP_H__
+
+#include <stdint.h>             /* using uint32_t */
+
+#include "watchdog_utils.h"     /* using wd_ty */
+
+#define WD_UDP_MAGIC        (0x57444842u)   /* "WDHB" */
+#define WD_UDP_VERSION      (2)
+#define WD_UDP_MAX_PAYLOAD  (1400)          /* stay below a typical MTU */
+
+/**
+ * @typedef wd_udp_ty
+ * @brief Opaque UDP heartbeat hub.
+ */
+typedef struct wd_udp wd_udp_ty;
+
+/**
+ * @struct wd_udp_stats
+ * @brief Transport counters of a hub.
+ */
+typedef struct wd_udp_stats
+{
+	unsigned long   datagrams_sent;
+	unsigned long   datagrams_received;
+	unsigned long   entries_sent;
+	unsigned long   entries_received;
+	unsigned long   entries_lost;       /**< Sequence gaps */
+	unsigned long   entries_dropped;    /**< Duplicate, stale or unknown */
+	unsigned long   peer_restarts;      /**< Epoch changes of known peers */
+} wd_udp_stats_ty;
+
+/**
+ * @brief Creates a hub listening on `bind_ip`:`port`.
+ *
+ * @param bind_ip Local IPv4 address to bind, e.g. "127.0.0.1" or "0.0.0.0".
+ * @param port Local UDP port (0 for an ephemeral one).
+ * @return New hub, or NULL on failure.
+ */
+wd_udp_ty* WdUdpCreate(const char* bind_ip, unsigned short port);
+
+/**
+ * @brief Closes the socket and frees the hub.
+ *
+ * Watchdogs attached to the hub must not run afterwards.
+ */
+void WdUdpDestroy(wd_udp_ty* hub);
+
+/**
+ * @brief Returns the local port the hub is bound to.
+ */
+unsigned short WdUdpGetPort(const wd_udp_ty* hub);
+
+/**
+ * @brief Attaches a watchdog to a remote peer reachable through the hub.
+ *
+ * Replaces `wd->sol_ops`/`wd->sol_ctx`. The pair (local_id, remote_id)
+ * identifies the supervision relation on both hosts: the remote side
+ * attaches the mirror pair (remote_id, local_id).
+ *
+ * @param hub Hub to use.
+ * @param wd Watchdog context supervising the peer.
+ * @param remote_ip IPv4 address of the peer's hub.
+ * @param remote_port UDP port of the peer's hub.
+ * @param local_id Identity of this side.
+ * @param remote_id Identity of the peer.
+ * @return 0 on success, non-zero on failure.
+ */
+int WdUdpAttach(wd_udp_ty* hub, wd_ty* wd, const char* remote_ip,
+                unsigned short remote_port, uint32_t local_id,
+                uint32_t remote_id);
+
+/**
+ * @brief Scheduler task: sends every pending heartbeat batch.
+ *
+ * @param args Pointer to the `wd_udp_ty` hub.
+ * @return Always returns 1 (continue).
+ */
+int WdUdpFlushTSK(void* args);
+
+/**
+ * @brief Receives and applies every datagram waiting on the socket.
+ *
+ * Called by `CheckSolTSK` through the hub's `sol_ops`; may also be called
+ * directly, e.g. when the socket becomes readable.
+ *
+ * @param hub Hub to drain.
+ * @return Number of datagrams received.
+ */
+int WdUdpPump(wd_udp_ty* hub);
+
+/**
+ * @brief Copies the hub's transport counters.
+ */
+void WdUdpGetStats(const wd_udp_ty* hub, wd_udp_stats_ty* stats);
+
+#endif  /* __WATCHDOG_UDP_H__ */
@@ -1,177 +1,360 @@
-/**
- * @brief Creates and initializes a new watchdog context.
- *
- * Parses the arguments passed to the watchdog, extracts the monitoring
- * interval and failure limit, and allocates memory for the internal structure.
- *
- * @param args Argument array: [path, interval, max_fails, program args...]
- * @return Pointer to a new `wd_ty` structure, or NULL on failure.
- */
-wd_ty* WdCreate(char** args);
-
-/**
- * @brief Frees all resources associated with the watchdog.
- *
- * Destroys the internal scheduler and releases memory allocated for the watchdog.
- *
- * @param wd Pointer to the watchdog instance to destroy.
- */
-void WdDestroy(wd_ty* wd);
-
-/**
- * @brief Adds a task to the watchdog's internal scheduler.
- *
- * The task will be executed periodically at the given interval.
- *
- * @param wd Pointer to the watchdog instance.
- * @param task Function pointer to the task to run.
- * @param interval Time interval in seconds between executions.
- * @return 0 on success, non-zero on failure.
- */
-int WdAddTask(wd_ty* wd, int (*task)(void *), unsigned long interval);
-
-/**
- * @brief Clears all scheduled tasks from the watchdog's scheduler.
- *
- * This is usually called before shutting down the scheduler or restarting tasks.
- *
- * @param wd Pointer to the watchdog instance.
- */
-void WdClearTasks(wd_ty* wd);
-
-/**
- * @brief Starts the watchdog's internal scheduler loop.
- *
- * Begins execution of all added tasks based on their configured intervals.
- *
- * @param wd Pointer to the watchdog instance.
- */
-void WdStart(wd_ty* wd);
-
-/**
- * @brief Stops the watchdog's scheduler.
- *
- * Can be called to terminate the loop from outside (e.g., on shutdown).
- *
- * @param wd Pointer to the watchdog instance.
- */
-void WdStop(wd_ty* wd);
-
-/**
- * @brief Sends a signal to the monitored target process.
- *
- * Used to either test the process' responsiveness or terminate it.
- *
- * @param wd Pointer to the watchdog instance.
- * @param sig_num Signal number to send (e.g., SIGKILL, SIGUSR1).
- */
-void WdSendSignal(wd_ty* wd, int sig_num);
-
-/**
- * @brief Executes the target program (replaces current process).
- *
- * Uses `execv()` to replace the child process with the original client program.
- *
- * @param wd Pointer to the watchdog instance.
- */
-void WdExecTarget(wd_ty* wd);
-
-/**
- * @brief Spawns a new child process to run the monitored target.
- *
- * Uses `fork()` to create a new process, which immediately calls `WdExecTarget()`.
- * The PID of the child is stored in the watchdog context.
- *
- * @param wd Pointer to the watchdog instance.
- */
-void WdSpawnTarget(wd_ty* wd);
-
-/**
- * @brief Waits for the target process to terminate.
- *
- * Blocks until the monitored process exits, unless interrupted by a signal.
- *
- * @param wd Pointer to the watchdog instance.
- * @return 0 on success, 1 on failure or interruption.
- */
-int WdWaitPid(wd_ty* wd);
-
-/**
- * @brief Watchdog task: sends a heartbeat signal to the target.
- *
- * Sends `SIGUSR1` to the monitored process as a "ping" to verify it's alive.
- *
- * @param args Pointer to `wd_ty` structure.
- * @return Always returns 1 (continue).
- */
-int SendSolTSK(void* args);
-
-/**
- * @brief Watchdog task: checks for heartbeat response.
- *
- * Verifies if the target responded with `SIGUSR1`. If not, increments
- * the internal failure counter.
- *
- * @param args Pointer to `wd_ty` structure.
- * @return Always returns 1 (continue).
- */
-int CheckSolTSK(void* args);
-
-/**
- * @brief Watchdog task: revives the process if failure limit was reached.
- *
- * If the failure count equals `max_fails`, terminates the target,
- * clears all tasks, and schedules the revive task again.
- *
- * @param args Pointer to `wd_ty` structure.
- * @return Always returns 1 (continue).
- */
-int ReviveIfErrorTSK(void* args);
-
-/**
- * @brief No-op task function (used for scheduler fallback).
- *
- * @param args Ignored.
- */
-void DoNothingTSK(void* args);
-
-/**
- * @brief Sets the signal mask for the current thread.
- *
- * Allows blocking or unblocking a specific signal using `pthread_sigmask`.
- *
- * @param sig_num Signal number to modify.
- * @param val Either SIG_BLOCK or SIG_UNBLOCK.
- * @return 0 on success, non-zero on failure.
- */
-int SetSignalMask(int sig_num, int val);
-
-/**
- * @brief Registers a signal handler for a given signal.
- *
- * Sets a custom handler using `sigaction`.
- *
- * @param sig_num Signal number to handle.
- * @param handler Function to be called on signal reception.
- * @return 0 on success, non-zero on failure.
- */
-int SetSignalHandler(int sig_num, void (*handler)(int));
-
-/**
- * @brief Signal handler for SIGUSR1.
- *
- * Sets the internal heartbeat received flag to indicate the target is alive.
- *
- * @param sig_num Signal number (expected to be SIGUSR1).
- */
-void SIGUSR1Handler(int sig_num);
-
-/**
- * @brief Returns whether a heartbeat signal was received.
- *
- * @return 1 if SIGUSR1 was received since last check, 0 otherwise.
- */
-int GetSol(void);
-
-#endif /* __WATCHDOG_UTILS_H__ */
-
+/**
+ * @file watchdog_utils.h
+ * @brief Internal interface of the Watchdog system.
+ *
+ * Declares the watchdog context (`wd_ty`) shared by the in-process watchdog
+ * thread (`watchdog.c`) and the standalone watchdog process
+ * (`watchdog_exec.c`), together with the scheduler tasks, process control
+ * helpers and signal utilities both sides are built from.
+ */
+
+#ifndef __WATCHDOG_UTILS_H__
+#define __WATCHDOG_UTILS_H__
+
+#include <stddef.h>         /* using size_t   */
+#include <stdint.h>         /* using uint32_t */
+#include <sys/types.h>      /* using pid_t    */
+
+#include "scheduler.h"      /* using scheduler_ty */
+#include "watchdog_clock.h" /* using wd_clock_ty  */
+#include "watchdog_profile.h" /* using WD_PHASE_SPAWNED */
+
+#define WD_MAX_TASKS (16)
+#define WD_CHILD_ENV_MAX (3)
+#define WD_CHILD_ENV_LEN (128)
+
+struct wd;
+struct wd_state;
+struct wd_cmd_queue;
+
+/**
+ * @struct wd_task
+ * @brief A task registered through `WdAddTask`.
+ *
+ * The scheduler runs `WdDispatchTSK` with a pointer to this slot, which
+ * traces the dispatch and forwards to `task` with the owning watchdog.
+ */
+typedef struct wd_task
+{
+	int         (*task)(void*);     /**< Task to run, NULL if slot is free */
+	const char* name;               /**< Task name used in traces */
+	struct wd*  wd;                 /**< Owning watchdog */
+	size_t      seq;                /**< Registration number of this slot */
+	unsigned long interval;         /**< Seconds between runs */
+	uid_ty      uid;                /**< Scheduler task of this slot */
+	int         is_cancelled;       /**< Cleared on a shared scheduler; freed
+	                                     at its next dispatch */
+} wd_task_ty;
+
+/**
+ * @struct wd_sol_ops
+ * @brief How a watchdog talks to its peer.
+ *
+ * The default operations use `kill()` and the SIGUSR1 flag set by
+ * `SIGUSR1Handler`; the simulation harness plugs in simulated peers.
+ */
+typedef struct wd_sol_ops
+{
+	int (*signal)(struct wd* wd, int sig_num);  /**< Deliver a signal to peer */
+	int (*poll)(struct wd* wd);     /**< 1 if a sign of life arrived since
+	                                     the last poll, 0 otherwise */
+	void (*reset)(struct wd* wd);   /**< Forgets what was heard from the
+	                                     peer so far; may be NULL */
+} wd_sol_ops_ty;
+
+/**
+ * @struct wd
+ * @brief Watchdog context: the monitored peer and how to watch it.
+ */
+typedef struct wd
+{
+	scheduler_ty*   scheduler;              /**< Runs the watchdog tasks */
+	int             owns_scheduler;         /**< 0 if shared with other wds */
+	unsigned long   interval;               /**< Interval given by the client */
+	unsigned long   max_fails;              /**< Missed checks before revive */
+	unsigned long   fails;                  /**< Consecutive missed checks */
+	unsigned long   probe_fails;            /**< Part of `fails` counted by
+	                                             failed app probes */
+	pid_t           target_pid;             /**< Monitored peer */
+	char**          target_args;            /**< execv() args of the peer */
+	int             out_fd;                 /**< stdout/stderr of spawned
+	                                             peers, or -1 to inherit */
+	int             (*revive_task)(void*);  /**< Task that brings peer back */
+	wd_task_ty      tasks[WD_MAX_TASKS];    /**< Slots of registered tasks */
+	size_t          task_seq;               /**< Last slot registration number */
+	wd_clock_ty*    clock;                  /**< Time source of the tasks */
+	const wd_sol_ops_ty* sol_ops;           /**< Peer communication */
+	void*           sol_ctx;                /**< Data for `sol_ops` */
+	struct wd_state* state;                 /**< Block shared with the peer,
+	                                             or NULL */
+	int             role;                   /**< Own role in `state` */
+	uint32_t        generation;             /**< Own generation in `state` */
+	uint32_t        target_generation;      /**< Peer's generation in `state` */
+	int             is_target_ready;        /**< 0 while the peer starts up */
+	int             ready_fd;               /**< Readiness pipe, or -1 */
+	uint64_t        target_started_ns;      /**< When the peer was started */
+	uint64_t        ready_deadline_ns;      /**< Startup deadline of the peer */
+	uint64_t        revive_after_ns;        /**< Staggered revive waits until,
+	                                             or 0 */
+	uint64_t        revive_ns[WD_PHASE_SPAWNED]; /**< Reviver-side phases of
+	                                             the revive in progress */
+	struct wd_cmd_queue* cmds;              /**< Commands from other threads,
+	                                             drained on dispatch, or NULL */
+	char            child_env[WD_CHILD_ENV_MAX][WD_CHILD_ENV_LEN];
+	                                        /**< "NAME=value" set for the next
+	                                             spawned or exec'd peer, or "" */
+	int             child_fd;               /**< Inherited by the next peer
+	                                             only, or -1; CLOEXEC here */
+} wd_ty;
+
+/**
+ * @brief Creates and initializes a new watchdog context.
+ *
+ * Parses the arguments passed to the watchdog, extracts the monitoring
+ * interval and failure limit, and allocates memory for the internal structure.
+ *
+ * @param args Argument array: [path, interval, max_fails, program args...]
+ * @return Pointer to a new `wd_ty` structure, or NULL on failure.
+ */
+wd_ty* WdCreate(char** args);
+
+/**
+ * @brief Creates a watchdog context that runs on an existing scheduler.
+ *
+ * Lets a single scheduler (and thread) supervise many peers, e.g. remote
+ * peers over the UDP transport. `WdClearTasks` then only cancels this
+ * watchdog's own tasks. Destroy such contexts only after the shared
+ * scheduler has stopped.
+ *
+ * @param args Argument array: [path, interval, max_fails, program args...]
+ * @param scheduler Scheduler to add tasks to; not destroyed by `WdDestroy`.
+ * @return Pointer to a new `wd_ty` structure, or NULL on failure.
+ */
+wd_ty* WdCreateShared(char** args, scheduler_ty* scheduler);
+
+/**
+ * @brief Frees all resources associated with the watchdog.
+ *
+ * Destroys the internal scheduler and releases memory allocated for the watchdog.
+ *
+ * @param wd Pointer to the watchdog instance to destroy.
+ */
+void WdDestroy(wd_ty* wd);
+
+/**
+ * @brief Adds a named task to the watchdog's internal scheduler.
+ *
+ * The task will be executed periodically at the given interval, through
+ * `WdDispatchTSK`, until it returns 0 or the tasks are cleared.
+ *
+ * @param wd Pointer to the watchdog instance.
+ * @param task Function pointer to the task to run.
+ * @param name Task name shown in execution traces.
+ * @param interval Time interval in seconds between executions.
+ * @return 0 on success, non-zero on failure.
+ */
+int WdAddNamedTask(wd_ty* wd, int (*task)(void *), const char* name,
+                   unsigned long interval);
+
+/**
+ * @brief Adds a task to the watchdog's internal scheduler.
+ *
+ * Same as `WdAddNamedTask`, using the task expression as its name.
+ */
+#define WdAddTask(wd, task, interval) \
+        WdAddNamedTask((wd), (task), #task, (interval))
+
+/**
+ * @brief Scheduler trampoline for tasks added with `WdAddTask`.
+ *
+ * Brackets the task with trace begin/end events and releases its slot
+ * when the task asks not to be rescheduled.
+ *
+ * @param args Pointer to the task's `wd_task_ty` slot.
+ * @return The wrapped task's return value.
+ */
+int WdDispatchTSK(void* args);
+
+/**
+ * @brief Clears all scheduled tasks from the watchdog's scheduler.
+ *
+ * This is usually called before shutting down the scheduler or restarting tasks.
+ *
+ * On a shared scheduler (`WdCreateShared`) only this watchdog's own tasks
+ * are cancelled. Whatever was heard from the peer so far is forgotten
+ * (`sol_ops->reset`), so the next instance starts with a clean slate.
+ *
+ * @param wd Pointer to the watchdog instance.
+ */
+void WdClearTasks(wd_ty* wd);
+
+/**
+ * @brief Starts the watchdog's internal scheduler loop.
+ *
+ * Begins execution of all added tasks based on their configured intervals.
+ *
+ * @param wd Pointer to the watchdog instance.
+ */
+void WdStart(wd_ty* wd);
+
+/**
+ * @brief Stops the watchdog's scheduler.
+ *
+ * Can be called to terminate the loop from outside (e.g., on shutdown).
+ *
+ * @param wd Pointer to the watchdog instance.
+ */
+void WdStop(wd_ty* wd);
+
+/**
+ * @brief Sends a signal to the monitored target process.
+ *
+ * Used to either test the process' responsiveness or terminate it.
+ * Delivered through `wd->sol_ops`.
+ *
+ * @param wd Pointer to the watchdog instance.
+ * @param sig_num Signal number to send (e.g., SIGKILL, SIGUSR1).
+ */
+void WdSendSignal(wd_ty* wd, int sig_num);
+
+/**
+ * @brief Executes the target program (replaces current process).
+ *
+ * Uses `execve()` to replace the child process with the original client
+ * program, with this process' environment plus `wd->child_env`, and with
+ * `wd->child_fd` kept open across exec.
+ *
+ * @param wd Pointer to the watchdog instance.
+ */
+void WdExecTarget(wd_ty* wd);
+
+/**
+ * @brief Sets an environment variable for the peers `wd` spawns or execs.
+ *
+ * Only the peer's environment gets it: this process' own environment, which
+ * other threads may be reading, is left alone. Scheduler thread only.
+ *
+ * @param wd Pointer to the watchdog instance.
+ * @param name Variable name.
+ * @param value Variable value.
+ * @return The stored value, or NULL if no slot is free or it does not fit.
+ */
+char* WdSetChildEnv(wd_ty* wd, const char* name, const char* value);
+
+/**
+ * @brief Returns the value of a variable set by `WdSetChildEnv`, which a
+ *        forked child may rewrite in place before exec, or NULL.
+ *
+ * @param wd Pointer to the watchdog instance.
+ * @param name Variable name.
+ */
+char* WdGetChildEnv(wd_ty* wd, const char* name);
+
+/**
+ * @brief Withdraws a variable set by `WdSetChildEnv`.
+ *
+ * @param wd Pointer to the watchdog instance.
+ * @param name Variable name.
+ */
+void WdUnsetChildEnv(wd_ty* wd, const char* name);
+
+/**
+ * @brief Spawns a new child process to run the monitored target.
+ *
+ * Uses `fork()` to create a new process, which immediately calls `WdExecTarget()`.
+ * The PID of the child is stored in the watchdog context.
+ *
+ * @param wd Pointer to the watchdog instance.
+ */
+void WdSpawnTarget(wd_ty* wd);
+
+/**
+ * @brief Waits for the target process to terminate.
+ *
+ * Blocks until the monitored process exits, unless interrupted by a signal.
+ *
+ * @param wd Pointer to the watchdog instance.
+ * @return 0 on success, 1 on failure or interruption.
+ */
+int WdWaitPid(wd_ty* wd);
+
+/**
+ * @brief Watchdog task: sends a heartbeat signal to the target.
+ *
+ * Sends `SIGUSR1` to the monitored process as a "ping" to verify it's alive.
+ *
+ * @param args Pointer to `wd_ty` structure.
+ * @return Always returns 1 (continue).
+ */
+int SendSolTSK(void* args);
+
+/**
+ * @brief Watchdog task: checks for heartbeat response.
+ *
+ * Verifies if the target responded with `SIGUSR1`. If not, increments
+ * the internal failure counter.
+ *
+ * @param args Pointer to `wd_ty` structure.
+ * @return Always returns 1 (continue).
+ */
+int CheckSolTSK(void* args);
+
+/**
+ * @brief Watchdog task: revives the process if failure limit was reached.
+ *
+ * If the failure count reaches `max_fails` (stretched under host pressure,
+ * see watchdog_pressure.h), terminates the target, clears all tasks, and
+ * schedules the revive task again.
+ *
+ * @param args Pointer to `wd_ty` structure.
+ * @return Always returns 1 (continue).
+ */
+int ReviveIfErrorTSK(void* args);
+
+/**
+ * @brief No-op task function (used for scheduler fallback).
+ *
+ * @param args Ignored.
+ */
+void DoNothingTSK(void* args);
+
+/**
+ * @brief Sets the signal mask for the current thread.
+ *
+ * Allows blocking or unblocking a specific signal using `pthread_sigmask`.
+ *
+ * @param sig_num Signal number to modify.
+ * @param val Either SIG_BLOCK or SIG_UNBLOCK.
+ * @return 0 on success, non-zero on failure.
+ */
+int SetSignalMask(int sig_num, int val);
+
+/**
+ * @brief Registers a signal handler for a given signal.
+ *
+ * Sets a custom handler using `sigaction`.
+ *
+ * @param sig_num Signal number to handle.
+ * @param handler Function to be called on signal reception.
+ * @return 0 on success, non-zero on failure.
+ */
+int SetSignalHandler(int sig_num, void (*handler)(int));
+
+/**
+ * @brief Signal handler for SIGUSR1.
+ *
+ * Sets the internal heartbeat received flag to indicate the target is alive.
+ *
+ * @param sig_num Signal number (expected to be SIGUSR1).
+ */
+void SIGUSR1Handler(int sig_num);
+
+/**
+ * @brief Returns whether a heartbeat signal was received.
+ *
+ * @return 1 if SIGUSR1 was received since last check, 0 otherwise.
+ */
+int GetSol(void);
+
+#endif /* __WATCHDOG_UTILS_H__ */
+
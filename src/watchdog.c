@@ -1,184 +1,296 @@
-/**
- * @file watchdog.c
- * @brief Core implementation of the Watchdog system.
- *
- * This module provides functionality to turn a process into an "immortal"
- * one by spawning a watchdog thread that monitors it and restarts it
- * when necessary.
- *
- * The watchdog operates using a scheduler-based mechanism and communicates
- * via signals. This file creates the watchdog arguments, spawns the thread,
- * and defines the recovery logic.
- *
- * Dependencies:
- *  - pthread
- *  - POSIX system headers (unistd.h, sys/types.h, etc.)
- *  - Custom utilities: watchdog_utils.h, utils.h
- */
- 
-#define _POSIX_C_SOURCE 200809L
-
-#include <stddef.h>     /* using size_t                 */
-#include <stdlib.h>     /* using malloc                 */
-#include <stdio.h>      /* using sprintf                */
-#include <string.h>     /* using memcpy, strlen         */
-#include <unistd.h>     /* using fork                   */
-#include <sys/types.h>  /* using pid_t                  */
-#include <sys/wait.h>   /* using wait                   */
-#include <pthread.h>    /* pthread_create, pthread_t    */
-
-#include "watchdog.h"
-#include "watchdog_utils.h"
-#include "utils.h"
-
-#define WD_PATH "./watchdog_exec"
-
-static void            AssignIntToString    (char* dest_str, int num);
-static char*           CreateString         (size_t n);
-static char**          CreateStrings        (size_t n);
-static void            HandleWatchdogSignal (int signal);
-static char**          CreateWdArgs         (unsigned int interval,
-                                            unsigned int max_fails,
-                                            int argc,
-                                            char* args[]);
-void*                  WdThread             (void* args);
-static void            DestroyWdArgs        (char** wd_args);
-void                   SIGUSR2Handler       (int sig_num);
-                                             
-static volatile int          g_is_dnr_req  = 0;
-static          pthread_t    g_wd_thread;
-
-
-int MakeMeImmortal(int argc, char* argv[], const unsigned long interval,
-                   const int max_fails)
-{
-    char** wd_args = CreateWdArgs(interval, max_fails, argc, argv);
-    printf("ps in watchdog.c MMI\n");
-    system("ps");
-	
-	if (pthread_create(&g_wd_thread, NULL, WdThread, wd_args))
-	{
-		DestroyWdArgs(wd_args);
-		perror("Failed to create scheduler thread");
-        /* exit(0); */
-	}
-
-    return (0);
-}
-
-
-static int TerminateIfDNRTSK(void* args)
-{
-	wd_ty* wd = (wd_ty*) args;
-	
-	if (g_is_dnr_req)
-	{	
-		WdSendSignal(wd, SIGKILL);
-		WdWaitPid(wd);
-		WdStop(wd);
-		g_is_dnr_req = 0;
-		
-		return (0);
-	}
-	return (1);
-}
-
-static int SpawnTargetTSK(void* args)
-{
-	wd_ty* wd = (wd_ty*) args;
-	
-	printf("ps in watchdog.c SpawnTargetTSK\n");
-    system("ps");
-
-	WdSpawnTarget(wd);
-	WdAddTask(wd, TerminateIfDNRTSK, 1);
-	WdAddTask(wd, SendSolTSK, 10);
-	WdAddTask(wd, CheckSolTSK, 5);
-	WdAddTask(wd, ReviveIfErrorTSK, 5);
-		
-	return (0);
-}
-
-void* WdThread(void* args)
-{
-	wd_ty* wd = NULL;
-
-	SetSignalMask(SIGUSR1, SIG_BLOCK);
-	SetSignalHandler(SIGUSR1, SIGUSR1Handler);
-	SetSignalMask(SIGUSR1, SIG_UNBLOCK);
-	wd = WdCreate(args);
-	wd->revive_task = SpawnTargetTSK;
-	WdAddTask(wd, SpawnTargetTSK, 1);
-	WdStart(wd);
-	DestroyWdArgs(args);
-	WdDestroy(wd);
-
-	pthread_exit(NULL);
-}
-
-static char** CreateWdArgs(unsigned int interval, unsigned int max_fails, int argc, char* args[])
-{
-	char** wd_args = NULL;
-	int wd_argc = 3 + argc + 1;
-	int i;
-	
-	wd_args = CreateStrings(wd_argc * sizeof(char*));
-	
-    wd_args[0] = CreateString(strlen(WD_PATH) + 1);
-    memcpy(wd_args[0], WD_PATH, strlen(WD_PATH));
-
-    wd_args[1] = CreateString(sizeof(int));
-    AssignIntToString(wd_args[1], interval);
-
-    wd_args[2] = CreateString(sizeof(int));
-    AssignIntToString(wd_args[2], max_fails);
-
-    for (i = 0; i < argc; ++i)
-    {
-        wd_args[i+3] = CreateString(strlen(args[i]) + 1);
-        memcpy(wd_args[i+3], args[i], strlen(args[i]));
-    }
-    wd_args[i+3] = NULL;
-	
-	for(i = 0; i < argc + 4; ++i)
-		printf("wd_args[%d] = %s\n,", i, wd_args[i]);
-	return (wd_args);
-}
-
-int DoNotResuscitate()
-{
-	g_is_dnr_req = 1;
-    return (0);
-}
-
-static void DestroyWdArgs(char** wd_args)
-{
-    unsigned int i = 0;
-
-    while (wd_args[i] != NULL)
-    {
-        free(wd_args[i]);
-        ++i;
-    }
-    free(wd_args);
-}
-
-static void AssignIntToString(char* dest_str, int num)
-{
-    ExitIfBad(sprintf(dest_str, "%d", num) > 0, "sprintf error",
-                      EXIT_FAILURE);
-}
-
-static char* CreateString(size_t n)
-{
-    char* string = (char*) malloc(n * sizeof(char));
-    ExitIfBad(string != NULL, "malloc error", EXIT_FAILURE); 
-    return (string);
-}
-
-static char** CreateStrings(size_t n)
-{
-    char** strings = (char**) malloc(n * sizeof(char*));
-    ExitIfBad(strings != NULL, "malloc error", EXIT_FAILURE); 
-    return (strings);
-}
+/**
+ * @file watchdog.c
+ * @brief Core implementation of the Watchdog system.
+ *
+ * This module provides functionality to turn a process into an "immortal"
+ * one by spawning a watchdog thread that monitors it and restarts it
+ * when necessary.
+ *
+ * The watchdog operates using a scheduler-based mechanism and communicates
+ * via signals. This file creates the watchdog arguments, spawns the thread,
+ * and defines the recovery logic.
+ *
+ * Dependencies:
+ *  - pthread
+ *  - POSIX system headers (unistd.h, sys/types.h, etc.)
+ *  - Custom utilities: watchdog_utils.h, utils.h
+ */
+ 
+#define _POSIX_C_SOURCE 200809L
+
+#include <stddef.h>     /* using size_t                 */
+#include <stdlib.h>     /* using malloc, getenv         */
+#include <stdio.h>      /* using sprintf                */
+#include <string.h>     /* using memcpy, strlen         */
+#include <errno.h>      /* using errno                  */
+#include <signal.h>     /* using pthread_kill, kill     */
+#include <unistd.h>     /* using fork                   */
+#include <sys/types.h>  /* using pid_t                  */
+#include <sys/wait.h>   /* using wait                   */
+#include <pthread.h>    /* pthread_create, pthread_t    */
+
+#include "watchdog.h"
+#include "watchdog_utils.h"
+#include "utils.h"
+#include "watchdog_trace.h"
+#include "watchdog_harden.h"
+#include "watchdog_flight.h"
+#include "watchdog_state.h"
+#include "watchdog_ready.h"
+#include "watchdog_profile.h"
+#include "watchdog_cmd.h"
+#include "watchdog_capture.h"
+
+#define WD_PATH "./watchdog_exec"
+
+static void            AssignIntToString    (char* dest_str, int num);
+static char*           CreateString         (size_t n);
+static char**          CreateStrings        (size_t n);
+static void            HandleWatchdogSignal (int signal);
+static char**          CreateWdArgs         (unsigned int interval,
+                                            unsigned int max_fails,
+                                            int argc,
+                                            char* args[]);
+void*                  WdThread             (void* args);
+static void            DestroyWdArgs        (char** wd_args);
+void                   SIGUSR2Handler       (int sig_num);
+                                             
+static volatile sig_atomic_t     g_is_dnr_req  = 0;
+static volatile sig_atomic_t     g_is_wd_thread = 0;
+static          pthread_t        g_wd_thread;
+static          wd_ty* volatile  g_wd          = NULL;
+static          wd_state_ty*     g_state       = NULL;
+static          wd_cmd_queue_ty* g_cmds        = NULL;
+
+
+int MakeMeImmortal(int argc, char* argv[], const unsigned long interval,
+                   const int max_fails)
+{
+    char** wd_args = NULL;
+
+    WdProfileMarkSelf(WD_PHASE_MAIN);
+    /* before anything is printed, so the whole pair's output is logged */
+    WdCaptureRedirect();
+    wd_args = CreateWdArgs(interval, max_fails, argc, argv);
+    WdFlightCreate();
+    WdFlightNote("MakeMeImmortal");
+    g_state = WdStateOpen(1);
+    g_cmds = WdCmdCreate();
+    /* without a startup deadline the app is ready as soon as it asks */
+    if (NULL == getenv(WD_STARTUP_DEADLINE_ENV))
+    {
+        WdNotifyReady();
+    }
+	
+	if (pthread_create(&g_wd_thread, NULL, WdThread, wd_args))
+	{
+		DestroyWdArgs(wd_args);
+		perror("Failed to create scheduler thread");
+        /* exit(0); */
+	}
+	else
+	{
+		g_is_wd_thread = 1;
+	}
+
+    return (0);
+}
+
+
+/* Finishes what `SIGUSR2Handler` started; also the fallback if the wakeup
+ * was missed (e.g. it arrived in the middle of a task). */
+static int TerminateIfDNRTSK(void* args)
+{
+	wd_ty* wd = (wd_ty*) args;
+	
+	if (g_is_dnr_req)
+	{	
+		WD_TRACE_I("do not resuscitate", wd->target_pid);
+		WdSendSignal(wd, SIGKILL);
+		WdWaitPid(wd);
+		WdStop(wd);
+		
+		return (0);
+	}
+	return (1);
+}
+
+/* `DoNotResuscitate` wakes the scheduler thread with SIGUSR2: SchedRun goes
+ * back to sleep until its next task, but the watchdog process is killed
+ * here, so nothing can revive the app from this point on. Only a child that
+ * was not reaped yet is killed, so a recycled pid never is. */
+void SIGUSR2Handler(int sig_num)
+{
+	wd_ty* wd = g_wd;
+	siginfo_t info;
+	int saved_errno = errno;
+
+	(void) sig_num;
+
+	if (g_is_dnr_req && NULL != wd && wd->target_pid > 0)
+	{
+		info.si_pid = 0;
+		if (0 == waitid(P_PID, (id_t) wd->target_pid, &info,
+		                WEXITED | WNOHANG | WNOWAIT) && 0 == info.si_pid)
+		{
+			kill(wd->target_pid, SIGKILL);
+		}
+	}
+	errno = saved_errno;
+}
+
+/* Heartbeats start only once the app reported ready. */
+static int SendSolIfReadyTSK(void* args)
+{
+	return (0 != WdReadyNs() ? SendSolTSK(args) : 1);
+}
+
+/* Publishes the app's readiness to the watchdog process, which may then
+ * count missed heartbeats before the first one arrives. */
+static int PublishReadyTSK(void* args)
+{
+	wd_ty* wd = (wd_ty*) args;
+	uint64_t ready_ns = WdReadyNs();
+
+	if (0 == ready_ns)
+	{
+		return (1);
+	}
+	WdStateSetReadyAt(wd, ready_ns);
+	WdProfilePublish(wd);
+
+	return (0);
+}
+
+static int SpawnTargetTSK(void* args)
+{
+	wd_ty* wd = (wd_ty*) args;
+	
+	/* asked not to come back while the watchdog was down */
+	if (g_is_dnr_req)
+	{
+		return (TerminateIfDNRTSK(wd));
+	}
+
+	/* if another instance already started a watchdog, follow that one */
+	if (NULL == wd->state || 0 == WdStateBeginRevive(wd))
+	{
+		WdSpawnAwaitingReady(wd);
+	}
+	else
+	{
+		WdAwaitHeartbeatReady(wd, WdStateGetTargetStartedNs(wd));
+	}
+	if (NULL != wd->state)
+	{
+		WdAddTask(wd, WdStateLeaseTSK, 1);
+		WdAddTask(wd, PublishReadyTSK, 1);
+	}
+	if (NULL != wd->cmds)
+	{
+		WdAddTask(wd, WdCmdTSK, 1);
+	}
+	WdAddTask(wd, TerminateIfDNRTSK, 1);
+	WdAddTask(wd, SendSolIfReadyTSK, 10);
+	WdAddTask(wd, CheckSolTSK, 5);
+	WdAddTask(wd, ReviveIfErrorTSK, 5);
+		
+	return (0);
+}
+
+void* WdThread(void* args)
+{
+	wd_ty* wd = NULL;
+
+	WdHardenThread();
+	SetSignalMask(SIGUSR1, SIG_BLOCK);
+	SetSignalHandler(SIGUSR1, SIGUSR1Handler);
+	SetSignalMask(SIGUSR1, SIG_UNBLOCK);
+	SetSignalHandler(SIGUSR2, SIGUSR2Handler);
+	wd = WdCreate(args);
+	if (NULL != g_state)
+	{
+		WdStateAttach(wd, g_state, WD_ROLE_CLIENT);
+	}
+	wd->cmds = g_cmds;
+	wd->revive_task = SpawnTargetTSK;
+	WdAddTask(wd, SpawnTargetTSK, 1);
+	g_wd = wd;
+	WdStart(wd);
+	g_wd = NULL;
+	DestroyWdArgs(args);
+	WdDestroy(wd);
+
+	pthread_exit(NULL);
+}
+
+static char** CreateWdArgs(unsigned int interval, unsigned int max_fails, int argc, char* args[])
+{
+	char** wd_args = NULL;
+	int wd_argc = 3 + argc + 1;
+	int i;
+	
+	wd_args = CreateStrings(wd_argc * sizeof(char*));
+	
+    wd_args[0] = CreateString(strlen(WD_PATH) + 1);
+    memcpy(wd_args[0], WD_PATH, strlen(WD_PATH));
+
+    wd_args[1] = CreateString(sizeof(int));
+    AssignIntToString(wd_args[1], interval);
+
+    wd_args[2] = CreateString(sizeof(int));
+    AssignIntToString(wd_args[2], max_fails);
+
+    for (i = 0; i < argc; ++i)
+    {
+        wd_args[i+3] = CreateString(strlen(args[i]) + 1);
+        memcpy(wd_args[i+3], args[i], strlen(args[i]));
+    }
+    wd_args[i+3] = NULL;
+
+	return (wd_args);
+}
+
+int DoNotResuscitate()
+{
+	g_is_dnr_req = 1;
+	if (g_is_wd_thread)
+	{
+		pthread_kill(g_wd_thread, SIGUSR2);
+	}
+	WdFlightRemove();
+	WdStateRemove();
+    return (0);
+}
+
+static void DestroyWdArgs(char** wd_args)
+{
+    unsigned int i = 0;
+
+    while (wd_args[i] != NULL)
+    {
+        free(wd_args[i]);
+        ++i;
+    }
+    free(wd_args);
+}
+
+static void AssignIntToString(char* dest_str, int num)
+{
+    ExitIfBad(sprintf(dest_str, "%d", num) > 0, "sprintf error",
+                      EXIT_FAILURE);
+}
+
+static char* CreateString(size_t n)
+{
+    char* string = (char*) malloc(n * sizeof(char));
+    ExitIfBad(string != NULL, "malloc error", EXIT_FAILURE); 
+    return (string);
+}
+
+static char** CreateStrings(size_t n)
+{
+    char** strings = (char**) malloc(n * sizeof(char*));
+    ExitIfBad(strings != NULL, "malloc error", EXIT_FAILURE); 
+    return (strings);
+}
@@ -0,0 +1,602 @@
+/**
+ * @file watchdog_capture.c
+ * @brief Pump thread splicing captured pipes into rotated logs.
+ *
+ * The pump waits on every stream's read end with one epoll set and moves
+ * at most WD_CAPTURE_CHUNK bytes per `splice`, WD_CAPTURE_ROUNDS times per
+ * wakeup, so one chatty target cannot starve the others. Mirroring `tee`s
+ * the same bytes into a private pipe first and splices that pipe into a
+ * non-blocking description of the mirror, so a stalled terminal only
+ * costs mirrored output. The pump thread never writes to stdout: in a
+ * captured pair stdout is the very pipe it drains. Diagnostics take the
+ * same kind of private non-blocking description of the previous stdout.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>         /* using calloc, getenv     */
+#include <stdio.h>          /* using sprintf, vdprintf  */
+#include <stdarg.h>         /* using va_list            */
+#include <string.h>         /* using strrchr            */
+#include <errno.h>          /* using errno              */
+#include <fcntl.h>          /* using splice, tee, open  */
+#include <signal.h>         /* using sigfillset         */
+#include <unistd.h>         /* using pipe2, dup2        */
+#include <pthread.h>        /* using pthread_create     */
+#include <sys/stat.h>       /* using fstat              */
+#include <sys/epoll.h>      /* using epoll_wait         */
+#include <sys/eventfd.h>    /* using eventfd            */
+
+#include "watchdog_capture.h"
+#include "watchdog_trace.h"
+
+#define WD_CAPTURE_CHUNK    (64 * 1024)
+#define WD_CAPTURE_ROUNDS   (16)
+#define WD_CAPTURE_EVENTS   (16)
+#define WD_CAPTURE_SUFFIX   (16)    /* room for ".log" and ".<keep>" */
+
+#define LOAD(p)         __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE(p, v)     __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+typedef struct wd_capture_stream
+{
+	int                 read_fd;
+	int                 pipe_fds[2];    /* from WdCaptureAttach, or -1 */
+	int                 log_fd;
+	int                 mirror_fd;
+	int                 mirror[2];      /* tee'd bytes waiting for mirror_fd */
+	char                path[WD_CAPTURE_PATH_MAX + WD_CAPTURE_SUFFIX];
+	size_t              size;
+	wd_capture_stats_ty stats;          /* pump writes, anyone reads */
+} wd_capture_stream_ty;
+
+struct wd_capture
+{
+	pthread_t               thread;
+	int                     epoll_fd;
+	int                     stop_fd;
+	int                     is_stopping;
+	int                     n_streams;
+	size_t                  max;
+	int                     keep;
+	wd_capture_stream_ty    streams[WD_CAPTURE_MAX_STREAMS];
+};
+
+static void     TakeDiagFd  (void) __attribute__((constructor));
+static void*    PumpThread  (void* args);
+static void     Pump        (wd_capture_ty* capture,
+                             wd_capture_stream_ty* stream);
+static void     FlushMirror (wd_capture_stream_ty* stream);
+static void     Rotate      (wd_capture_ty* capture,
+                             wd_capture_stream_ty* stream);
+static void     OpenLog     (wd_capture_stream_ty* stream, int flags);
+static void     Close       (wd_capture_ty* capture,
+                             wd_capture_stream_ty* stream);
+static int      OpenMirror  (int fd);
+static int      OpenDiag    (int fd);
+static int      IsCaptured  (void);
+static int      BuildPath   (char* path, const char* name);
+static void     CloseFd     (int* fd);
+
+static int g_diag_fd = STDOUT_FILENO;
+
+wd_capture_ty* WdCaptureCreate(void)
+{
+	wd_capture_ty* capture = NULL;
+	const char* val = NULL;
+	struct epoll_event event;
+	sigset_t all;
+	sigset_t old;
+
+	capture = (wd_capture_ty*) calloc(1, sizeof(wd_capture_ty));
+	if (NULL == capture)
+	{
+		WdCaptureDiag("malloc failed\n");
+		return (NULL);
+	}
+
+	val = getenv(WD_CAPTURE_MAX_ENV);
+	capture->max = NULL != val ? strtoul(val, NULL, 10) :
+	                             WD_CAPTURE_DEFAULT_MAX;
+	val = getenv(WD_CAPTURE_KEEP_ENV);
+	capture->keep = NULL != val ? atoi(val) : WD_CAPTURE_DEFAULT_KEEP;
+
+	capture->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	capture->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	if (capture->epoll_fd < 0 || capture->stop_fd < 0 ||
+	    epoll_ctl(capture->epoll_fd, EPOLL_CTL_ADD, capture->stop_fd, &event))
+	{
+		WdCaptureDiag("epoll setup failed\n");
+		CloseFd(&capture->epoll_fd);
+		CloseFd(&capture->stop_fd);
+		free(capture);
+		return (NULL);
+	}
+
+	/* heartbeat signals keep going to the threads that expect them */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	if (pthread_create(&capture->thread, NULL, PumpThread, capture))
+	{
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+		WdCaptureDiag("pthread_create failed\n");
+		close(capture->epoll_fd);
+		close(capture->stop_fd);
+		free(capture);
+		return (NULL);
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	return (capture);
+}
+
+void WdCaptureDestroy(wd_capture_ty* capture)
+{
+	uint64_t one = 1;
+	int i;
+
+	STORE(&capture->is_stopping, 1);
+	if (sizeof(one) != write(capture->stop_fd, &one, sizeof(one)))
+	{
+		WdCaptureDiag("write() failed\n");
+	}
+	pthread_join(capture->thread, NULL);
+
+	for (i = 0; i < capture->n_streams; ++i)
+	{
+		wd_capture_stream_ty* stream = &capture->streams[i];
+
+		CloseFd(&stream->log_fd);
+		CloseFd(&stream->mirror_fd);
+		CloseFd(&stream->mirror[0]);
+		CloseFd(&stream->mirror[1]);
+		CloseFd(&stream->pipe_fds[0]);
+		CloseFd(&stream->pipe_fds[1]);
+	}
+	close(capture->epoll_fd);
+	close(capture->stop_fd);
+	free(capture);
+}
+
+int WdCaptureAdd(wd_capture_ty* capture, int read_fd, const char* path,
+                 int mirror_fd)
+{
+	wd_capture_stream_ty* stream = NULL;
+	struct epoll_event event;
+	int i = capture->n_streams;
+
+	if (WD_CAPTURE_MAX_STREAMS == i)
+	{
+		WdCaptureDiag("WdCaptureAdd failed: too many streams\n");
+		return (-1);
+	}
+
+	stream = &capture->streams[i];
+	stream->read_fd = read_fd;
+	stream->pipe_fds[0] = -1;
+	stream->pipe_fds[1] = -1;
+	stream->mirror[0] = -1;
+	stream->mirror[1] = -1;
+	stream->mirror_fd = -1;
+	snprintf(stream->path, sizeof(stream->path), "%.*s",
+	         WD_CAPTURE_PATH_MAX - 1, path);
+	OpenLog(stream, 0);
+	if (0 != capture->max && stream->size >= capture->max)
+	{
+		Rotate(capture, stream);
+	}
+
+	if (mirror_fd >= 0)
+	{
+		stream->mirror_fd = OpenMirror(mirror_fd);
+		if (stream->mirror_fd < 0 ||
+		    pipe2(stream->mirror, O_NONBLOCK | O_CLOEXEC))
+		{
+			WdCaptureDiag("mirror setup failed, logging only\n");
+			CloseFd(&stream->mirror_fd);
+		}
+	}
+
+	/* the pump only learns about the stream once it is complete */
+	STORE(&capture->n_streams, i + 1);
+	event.events = EPOLLIN;
+	event.data.ptr = stream;
+	if (epoll_ctl(capture->epoll_fd, EPOLL_CTL_ADD, read_fd, &event))
+	{
+		WdCaptureDiag("epoll_ctl() failed\n");
+		STORE(&stream->stats.is_closed, 1);
+		return (-1);
+	}
+
+	return (i);
+}
+
+int WdCaptureAttach(wd_capture_ty* capture, wd_ty* wd, const char* name)
+{
+	char path[WD_CAPTURE_PATH_MAX];
+	char pid_str[16];
+	int fds[2] = {-1, -1};
+	int i = 0;
+
+	if (BuildPath(path, name))
+	{
+		return (-1);
+	}
+
+	if (pipe2(fds, O_CLOEXEC))
+	{
+		WdCaptureDiag("pipe2() failed\n");
+		return (-1);
+	}
+	fcntl(fds[1], F_SETPIPE_SZ, WD_CAPTURE_PIPE_SIZE);
+
+	i = WdCaptureAdd(capture, fds[0], path,
+	                 NULL != getenv(WD_CAPTURE_TEE_ENV) ? STDOUT_FILENO : -1);
+	if (i < 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		return (-1);
+	}
+
+	/* both ends stay open here, so the pipe outlives every revive */
+	capture->streams[i].pipe_fds[0] = fds[0];
+	capture->streams[i].pipe_fds[1] = fds[1];
+	wd->out_fd = fds[1];
+	sprintf(pid_str, "%d", (int) getpid());
+	WdSetChildEnv(wd, WD_CAPTURED_ENV, pid_str);
+
+	return (i);
+}
+
+int WdCaptureRedirect(void)
+{
+	char fd_str[16];
+	int fds[2] = {-1, -1};
+
+	if (NULL == getenv(WD_CAPTURE_ENV))
+	{
+		return (1);
+	}
+
+	/* a revived client inherited the pair's pipe as stdout, a captured
+	 * child its capturer's */
+	if (NULL != getenv(WD_CAPTURE_FD_ENV) || IsCaptured())
+	{
+		setvbuf(stdout, NULL, _IOLBF, 0);
+		return (0);
+	}
+
+	/* no O_CLOEXEC: both ends are inherited by the whole pair */
+	if (pipe(fds))
+	{
+		WdCaptureDiag("pipe() failed\n");
+		return (1);
+	}
+	fcntl(fds[1], F_SETPIPE_SZ, WD_CAPTURE_PIPE_SIZE);
+
+	/* the previous stdout stays the diagnostics' (and the mirror's) */
+	g_diag_fd = OpenDiag(STDOUT_FILENO);
+	sprintf(fd_str, "%d", g_diag_fd);
+	setenv(WD_CAPTURE_DIAG_ENV, fd_str, 1);
+	if (NULL != getenv(WD_CAPTURE_TEE_ENV))
+	{
+		setenv(WD_CAPTURE_MIRROR_ENV, fd_str, 1);
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	dup2(fds[1], STDOUT_FILENO);
+	dup2(fds[1], STDERR_FILENO);
+	close(fds[1]);
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	sprintf(fd_str, "%d", fds[0]);
+	setenv(WD_CAPTURE_FD_ENV, fd_str, 1);
+
+	return (0);
+}
+
+wd_capture_ty* WdCaptureFromEnv(const char* name)
+{
+	const char* fd_str = getenv(WD_CAPTURE_FD_ENV);
+	const char* mirror_str = getenv(WD_CAPTURE_MIRROR_ENV);
+	const char* base = strrchr(name, '/');
+	char path[WD_CAPTURE_PATH_MAX];
+	wd_capture_ty* capture = NULL;
+
+	if (NULL == fd_str || BuildPath(path, NULL != base ? base + 1 : name))
+	{
+		return (NULL);
+	}
+
+	capture = WdCaptureCreate();
+	if (NULL == capture)
+	{
+		return (NULL);
+	}
+	if (WdCaptureAdd(capture, atoi(fd_str), path,
+	                 NULL != mirror_str ? atoi(mirror_str) : -1) < 0)
+	{
+		WdCaptureDestroy(capture);
+		return (NULL);
+	}
+
+	return (capture);
+}
+
+int WdCaptureDiagFd(void)
+{
+	return (g_diag_fd);
+}
+
+int WdCaptureDiag(const char* format, ...)
+{
+	va_list args;
+	int n = 0;
+
+	va_start(args, format);
+	n = vdprintf(g_diag_fd, format, args);
+	va_end(args);
+
+	return (n);
+}
+
+void WdCaptureGetStats(const wd_capture_ty* capture, int i,
+                       wd_capture_stats_ty* stats)
+{
+	const wd_capture_stats_ty* src = &capture->streams[i].stats;
+
+	stats->bytes = LOAD(&src->bytes);
+	stats->rotations = LOAD(&src->rotations);
+	stats->mirrored = LOAD(&src->mirrored);
+	stats->mirror_drops = LOAD(&src->mirror_drops);
+	stats->is_closed = LOAD(&src->is_closed);
+}
+
+/* Every process of a captured pair inherits the previous stdout. */
+static void TakeDiagFd(void)
+{
+	const char* val = getenv(WD_CAPTURE_DIAG_ENV);
+
+	if (NULL != val && '\0' != *val)
+	{
+		g_diag_fd = atoi(val);
+	}
+}
+
+static void* PumpThread(void* args)
+{
+	wd_capture_ty* capture = (wd_capture_ty*) args;
+	struct epoll_event events[WD_CAPTURE_EVENTS];
+	int n = 0;
+	int i;
+
+	while (!LOAD(&capture->is_stopping))
+	{
+		n = epoll_wait(capture->epoll_fd, events, WD_CAPTURE_EVENTS, -1);
+		for (i = 0; i < n; ++i)
+		{
+			if (NULL != events[i].data.ptr)
+			{
+				Pump(capture, (wd_capture_stream_ty*) events[i].data.ptr);
+			}
+		}
+	}
+
+	/* log what the pipes still hold */
+	n = LOAD(&capture->n_streams);
+	for (i = 0; i < n; ++i)
+	{
+		if (!capture->streams[i].stats.is_closed)
+		{
+			Pump(capture, &capture->streams[i]);
+		}
+	}
+
+	return (NULL);
+}
+
+static void Pump(wd_capture_ty* capture, wd_capture_stream_ty* stream)
+{
+	ssize_t teed = -1;
+	ssize_t n = 0;
+	size_t len = 0;
+	int round;
+
+	for (round = 0; round < WD_CAPTURE_ROUNDS; ++round)
+	{
+		len = WD_CAPTURE_CHUNK;
+		if (0 != capture->max && capture->max - stream->size < len)
+		{
+			len = capture->max - stream->size;
+		}
+
+		/* duplicate first: splice consumes the bytes */
+		if (stream->mirror_fd >= 0)
+		{
+			FlushMirror(stream);
+			teed = tee(stream->read_fd, stream->mirror[1], len,
+			           SPLICE_F_NONBLOCK);
+			if (teed > 0)
+			{
+				len = (size_t) teed;
+			}
+		}
+
+		n = splice(stream->read_fd, NULL, stream->log_fd, NULL, len,
+		           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (0 == n)
+		{
+			Close(capture, stream);
+			return;
+		}
+		if (n < 0)
+		{
+			if (EAGAIN != errno && EINTR != errno)
+			{
+				WD_TRACE_I("capture failed", (long) errno);
+				Close(capture, stream);
+			}
+			return;
+		}
+
+		if (stream->mirror_fd >= 0)
+		{
+			teed = teed > n ? n : teed;
+			teed = teed < 0 ? 0 : teed;
+			STORE(&stream->stats.mirrored,
+			      stream->stats.mirrored + (uint64_t) teed);
+			STORE(&stream->stats.mirror_drops,
+			      stream->stats.mirror_drops + (uint64_t) (n - teed));
+			FlushMirror(stream);
+		}
+
+		stream->size += (size_t) n;
+		STORE(&stream->stats.bytes, stream->stats.bytes + (uint64_t) n);
+		if (0 != capture->max && stream->size >= capture->max)
+		{
+			Rotate(capture, stream);
+		}
+	}
+}
+
+static void FlushMirror(wd_capture_stream_ty* stream)
+{
+	while (splice(stream->mirror[0], NULL, stream->mirror_fd, NULL,
+	              WD_CAPTURE_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK) > 0)
+	{
+	}
+}
+
+/* log -> log.1 -> ... -> log.<keep>; the oldest is overwritten. */
+static void Rotate(wd_capture_ty* capture, wd_capture_stream_ty* stream)
+{
+	char from[sizeof(stream->path) + WD_CAPTURE_SUFFIX];
+	char to[sizeof(stream->path) + WD_CAPTURE_SUFFIX];
+	int i;
+
+	close(stream->log_fd);
+	for (i = capture->keep - 1; i > 0; --i)
+	{
+		sprintf(from, "%s.%d", stream->path, i);
+		sprintf(to, "%s.%d", stream->path, i + 1);
+		rename(from, to);
+	}
+	if (capture->keep > 0)
+	{
+		sprintf(to, "%s.1", stream->path);
+		rename(stream->path, to);
+	}
+
+	OpenLog(stream, 0);
+	if (stream->size >= capture->max)
+	{
+		/* nothing kept, or the rename failed */
+		close(stream->log_fd);
+		OpenLog(stream, O_TRUNC);
+	}
+	STORE(&stream->stats.rotations, stream->stats.rotations + 1);
+	WD_TRACE_I("log rotated", (long) stream->stats.rotations);
+}
+
+/* Continues an existing log; splice cannot write to O_APPEND files. */
+static void OpenLog(wd_capture_stream_ty* stream, int flags)
+{
+	off_t size = 0;
+
+	stream->log_fd = open(stream->path, O_WRONLY | O_CREAT | O_CLOEXEC | flags,
+	                      0644);
+	if (stream->log_fd < 0)
+	{
+		WD_TRACE_I("log open failed", (long) errno);
+		stream->log_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	}
+
+	size = lseek(stream->log_fd, 0, SEEK_END);
+	stream->size = size > 0 ? (size_t) size : 0;
+}
+
+static void Close(wd_capture_ty* capture, wd_capture_stream_ty* stream)
+{
+	epoll_ctl(capture->epoll_fd, EPOLL_CTL_DEL, stream->read_fd, NULL);
+	STORE(&stream->stats.is_closed, 1);
+	WD_TRACE_I("capture closed", (long) stream->stats.bytes);
+}
+
+/* A description of its own, so O_NONBLOCK does not leak to other users
+ * of the terminal or pipe. */
+static int OpenMirror(int fd)
+{
+	char path[32];
+	int mirror_fd = -1;
+
+	sprintf(path, "/proc/self/fd/%d", fd);
+	mirror_fd = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	if (mirror_fd < 0)
+	{
+		mirror_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	}
+
+	return (mirror_fd);
+}
+
+/* Like a mirror, but inherited by the pair, and appending if stdout is a
+ * file; /dev/null if there was no stdout at all. */
+static int OpenDiag(int fd)
+{
+	char path[32];
+	int diag_fd = -1;
+
+	sprintf(path, "/proc/self/fd/%d", fd);
+	diag_fd = open(path, O_WRONLY | O_APPEND | O_NONBLOCK);
+	if (diag_fd < 0)
+	{
+		diag_fd = dup(fd);
+	}
+	if (diag_fd < 0)
+	{
+		diag_fd = open("/dev/null", O_WRONLY);
+	}
+
+	return (diag_fd);
+}
+
+/* Set by `WdCaptureAttach` in the spawned child; stdout must still be a
+ * pipe (not, say, redirected to a file by a script in between). */
+static int IsCaptured(void)
+{
+	struct stat st;
+
+	return (NULL != getenv(WD_CAPTURED_ENV) &&
+	        0 == fstat(STDOUT_FILENO, &st) && S_ISFIFO(st.st_mode));
+}
+
+static int BuildPath(char* path, const char* name)
+{
+	const char* dir = getenv(WD_CAPTURE_ENV);
+
+	if (NULL == dir)
+	{
+		return (1);
+	}
+	if (snprintf(path, WD_CAPTURE_PATH_MAX, "%s/%s.log", dir, name) >=
+	    WD_CAPTURE_PATH_MAX)
+	{
+		WdCaptureDiag("capture path too long: %s/%s.log\n", dir, name);
+		return (1);
+	}
+
+	return (0);
+}
+
+static void CloseFd(int* fd)
+{
+	if (*fd >= 0)
+	{
+		close(*fd);
+	}
+	*fd = -1;
+}
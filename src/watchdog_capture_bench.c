@@ -0,0 +1,341 @@
+/**
+ * @file watchdog_capture_bench.c
+ * @brief Floods a captured target's stdout and checks the scheduler keeps
+ *        ticking on time.
+ *
+ * The bench runs itself as the target: each instance writes `-b` bytes to
+ * stdout as fast as it can and exits, and the bench spawns `-n` instances
+ * one after the other through `WdSpawnTarget`, like revives. All of their
+ * output goes through one capture into `<WD_CAPTURE>/capture_bench.log`
+ * (default directory /tmp), rotated every `-m` bytes. Prints the logged
+ * throughput, the rotations and the largest gap between one-second
+ * scheduler ticks, and checks that every byte was logged.
+ *
+ * With `-s seconds` it plays a pair whose watchdog process is stopped
+ * instead: the bench redirects its own stdout like `MakeMeImmortal`, forks
+ * a pump process and stops it, and a thread fills the pipe through stdio
+ * until it blocks. Meanwhile the scheduler exchanges real SIGUSR1
+ * heartbeats with the bench itself for `seconds`; the tick gaps and missed
+ * heartbeats show whether the watchdog side stalled with the app's output.
+ *
+ * Usage:
+ *      ./watchdog_capture_bench [-n instances] [-b bytes] [-m max_bytes]
+ *      ./watchdog_capture_bench -s seconds
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>          /* using printf         */
+#include <stdlib.h>         /* using strtoul        */
+#include <string.h>         /* using memset         */
+#include <unistd.h>         /* using getopt, write  */
+#include <signal.h>         /* using kill, SIGSTOP  */
+#include <pthread.h>        /* using pthread_create */
+#include <sys/prctl.h>      /* using prctl          */
+#include <sys/wait.h>       /* using waitpid        */
+
+#include "watchdog_utils.h"
+#include "watchdog_capture.h"
+
+#define BENCH_BLOCK     (4096)
+#define BENCH_NUM_MAX   (24)
+
+static int      RunChild    (unsigned long bytes);
+static int      RunStalled  (unsigned long seconds);
+static void*    FloodThread (void* args);
+static int      TickTSK     (void* args);
+static int      RespawnTSK  (void* args);
+static int      StopTSK     (void* args);
+static int      NoSignal    (wd_ty* wd, int sig_num);
+static int      NoPoll      (wd_ty* wd);
+
+static const wd_sol_ops_ty g_no_sol_ops = {NoSignal, NoPoll, NULL};
+
+static wd_capture_ty*   g_capture = NULL;
+static int              g_stream = -1;
+static unsigned long    g_instances = 4;
+static unsigned long    g_spawned = 0;
+static uint64_t         g_expected = 0;
+static uint64_t         g_last_tick_ns = 0;
+static uint64_t         g_max_gap_ns = 0;
+static unsigned long    g_max_fails = 0;
+static unsigned long    g_ticks_left = 0;
+static uint64_t         g_flooded = 0;
+static char             g_bytes_arg[BENCH_NUM_MAX];
+static char*            g_args[] = {"capture_bench", "1", "3", NULL};
+static char*            g_child_args[] = {NULL, "--child", g_bytes_arg, NULL};
+
+int main(int argc, char* argv[])
+{
+	wd_capture_stats_ty stats;
+	wd_ty* wd = NULL;
+	unsigned long bytes = 64ul << 20;
+	unsigned long stall_s = 0;
+	uint64_t start_ns = 0;
+	uint64_t end_ns = 0;
+	int opt;
+
+	if (3 == argc && 0 == strcmp("--child", argv[1]))
+	{
+		return (RunChild(strtoul(argv[2], NULL, 10)));
+	}
+
+	while (-1 != (opt = getopt(argc, argv, "n:b:m:s:")))
+	{
+		switch (opt)
+		{
+			case 'n':
+				g_instances = strtoul(optarg, NULL, 10);
+				break;
+			case 'b':
+				bytes = strtoul(optarg, NULL, 10);
+				break;
+			case 'm':
+				setenv(WD_CAPTURE_MAX_ENV, optarg, 1);
+				break;
+			case 's':
+				stall_s = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				printf("usage: %s [-n instances] [-b bytes] [-m max_bytes] "
+				       "[-s seconds]\n", argv[0]);
+				return (1);
+		}
+	}
+	setenv(WD_CAPTURE_ENV, "/tmp", 0);
+	if (0 != stall_s)
+	{
+		return (RunStalled(stall_s));
+	}
+	sprintf(g_bytes_arg, "%lu", bytes);
+	g_child_args[0] = argv[0];
+	g_expected = (uint64_t) g_instances * bytes;
+
+	wd = WdCreate(g_args);
+	g_capture = WdCaptureCreate();
+	if (NULL == wd || NULL == g_capture)
+	{
+		printf("setup failed\n");
+		return (1);
+	}
+	wd->sol_ops = &g_no_sol_ops;
+	wd->target_args = g_child_args;
+	g_stream = WdCaptureAttach(g_capture, wd, "capture_bench");
+	if (g_stream < 0)
+	{
+		printf("WdCaptureAttach failed\n");
+		return (1);
+	}
+
+	start_ns = WdClockNow(wd->clock);
+	g_last_tick_ns = start_ns;
+	WdAddTask(wd, TickTSK, 1);
+	WdAddTask(wd, RespawnTSK, 1);
+	WdStart(wd);
+	end_ns = WdClockNow(wd->clock);
+
+	WdCaptureGetStats(g_capture, g_stream, &stats);
+	printf("%lu instances x %lu bytes -> %s/capture_bench.log\n",
+	       g_instances, bytes, getenv(WD_CAPTURE_ENV));
+	printf("  logged %llu of %llu bytes, %lu rotations, %.1f MB/s\n",
+	       (unsigned long long) stats.bytes,
+	       (unsigned long long) g_expected, stats.rotations,
+	       (double) stats.bytes * 1e3 / (double) (end_ns - start_ns));
+	printf("  max scheduler tick gap %.3f s\n",
+	       (double) g_max_gap_ns / WD_NS_PER_SEC);
+
+	WdCaptureDestroy(g_capture);
+	WdDestroy(wd);
+
+	return (stats.bytes == g_expected ? 0 : 1);
+}
+
+static int RunChild(unsigned long bytes)
+{
+	char block[BENCH_BLOCK];
+	unsigned long left = bytes;
+	ssize_t n = 0;
+
+	memset(block, 'x', sizeof(block));
+	block[sizeof(block) - 1] = '\n';
+
+	while (left > 0)
+	{
+		n = write(STDOUT_FILENO, block,
+		          left < sizeof(block) ? left : sizeof(block));
+		if (n <= 0)
+		{
+			printf("write() failed\n");
+			return (1);
+		}
+		left -= (unsigned long) n;
+	}
+
+	return (0);
+}
+
+static int RunStalled(unsigned long seconds)
+{
+	pthread_t flood;
+	wd_ty* wd = NULL;
+	pid_t pump = 0;
+
+	unsetenv(WD_CAPTURE_FD_ENV);
+	if (WdCaptureRedirect())
+	{
+		printf("WdCaptureRedirect failed\n");
+		return (1);
+	}
+
+	/* the watchdog process' pump, stopped for good */
+	pump = fork();
+	if (0 == pump)
+	{
+		/* even stopped, it must not outlive a bench killed by the alarm */
+		prctl(PR_SET_PDEATHSIG, SIGKILL);
+		WdCaptureFromEnv("capture_bench_stall");
+		pause();
+		_exit(0);
+	}
+	if (pump < 0 || kill(pump, SIGSTOP))
+	{
+		WdCaptureDiag("stopped pump setup failed\n");
+		return (1);
+	}
+
+	wd = WdCreate(g_args);
+	if (NULL == wd || pthread_create(&flood, NULL, FloodThread, NULL))
+	{
+		WdCaptureDiag("setup failed\n");
+		kill(pump, SIGKILL);
+		return (1);
+	}
+	SetSignalHandler(SIGUSR1, SIGUSR1Handler);
+	wd->target_pid = getpid();
+	g_ticks_left = seconds;
+	/* a hung scheduler never gets to report */
+	alarm((unsigned int) seconds + 10);
+
+	g_last_tick_ns = WdClockNow(wd->clock);
+	WdAddTask(wd, SendSolTSK, 1);
+	WdAddTask(wd, CheckSolTSK, 1);
+	WdAddTask(wd, TickTSK, 1);
+	WdAddTask(wd, StopTSK, 1);
+	WdStart(wd);
+	alarm(0);
+
+	WdCaptureDiag("stalled pump, %lu s of SIGUSR1 heartbeats\n", seconds);
+	WdCaptureDiag("  stdout blocked after %llu bytes\n",
+	              (unsigned long long) __atomic_load_n(&g_flooded,
+	                                                   __ATOMIC_ACQUIRE));
+	WdCaptureDiag("  max scheduler tick gap %.3f s, max missed heartbeats "
+	              "%lu\n", (double) g_max_gap_ns / WD_NS_PER_SEC,
+	              g_max_fails);
+
+	kill(pump, SIGKILL);
+	waitpid(pump, NULL, 0);
+	WdDestroy(wd);
+
+	/* the flood thread is still blocked in stdout: leave without it */
+	_exit(g_max_gap_ns < 2 * WD_NS_PER_SEC && 0 == g_max_fails ? 0 : 1);
+}
+
+/* The app: writes through stdio until the pipe is full, then blocks there
+ * holding stdout's lock. Heartbeats are for the scheduler thread. */
+static void* FloodThread(void* args)
+{
+	char block[BENCH_BLOCK];
+	sigset_t set;
+
+	(void) args;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+	memset(block, 'x', sizeof(block));
+	block[sizeof(block) - 1] = '\n';
+
+	while (sizeof(block) == fwrite(block, 1, sizeof(block), stdout))
+	{
+		__atomic_add_fetch(&g_flooded, sizeof(block), __ATOMIC_RELEASE);
+	}
+
+	return (NULL);
+}
+
+static int TickTSK(void* args)
+{
+	wd_ty* wd = (wd_ty*) args;
+	uint64_t now = WdClockNow(wd->clock);
+
+	if (now - g_last_tick_ns > g_max_gap_ns)
+	{
+		g_max_gap_ns = now - g_last_tick_ns;
+	}
+	g_last_tick_ns = now;
+	if (wd->fails > g_max_fails)
+	{
+		g_max_fails = wd->fails;
+	}
+
+	return (1);
+}
+
+/* Starts the next instance once the previous one exited; stops once all
+ * the output is logged. */
+static int RespawnTSK(void* args)
+{
+	wd_ty* wd = (wd_ty*) args;
+	wd_capture_stats_ty stats;
+
+	if (wd->target_pid > 0)
+	{
+		if (0 == waitpid(wd->target_pid, NULL, WNOHANG))
+		{
+			return (1);
+		}
+		wd->target_pid = -1;
+	}
+
+	if (g_spawned < g_instances)
+	{
+		WdSpawnTarget(wd);
+		++g_spawned;
+		return (1);
+	}
+
+	WdCaptureGetStats(g_capture, g_stream, &stats);
+	if (stats.bytes >= g_expected)
+	{
+		WdStop(wd);
+		return (0);
+	}
+
+	return (1);
+}
+
+static int StopTSK(void* args)
+{
+	if (0 == --g_ticks_left)
+	{
+		WdStop((wd_ty*) args);
+		return (0);
+	}
+
+	return (1);
+}
+
+static int NoSignal(wd_ty* wd, int sig_num)
+{
+	(void) wd;
+	(void) sig_num;
+
+	return (0);
+}
+
+static int NoPoll(wd_ty* wd)
+{
+	(void) wd;
+
+	return (1);
+}
@@ -0,0 +1,933 @@
+/**
+ * @file watchdog_chaos.c
+ * @brief End-to-end chaos harness measuring mean-time-to-recovery.
+ *
+ * Launches N supervised client/watchdog pairs and injects failures at a
+ * configurable rate:
+ *  - kill-target:   SIGKILL the client
+ *  - kill-watchdog: SIGKILL `watchdog_exec`
+ *  - hang:          SIGSTOP the client
+ *  - kill-both:     SIGKILL both processes of a pair
+ *  - starve:        saturate every CPU with busy loops for a while
+ *
+ * Each pair runs with `WD_TRACE` pointing to its own directory, and the
+ * harness follows the "heartbeat" events of both sides to time the
+ * interval from fault to restored heartbeat (one live client and one live
+ * watchdog, each having received a heartbeat after the fault). Pairs are
+ * found by scanning /proc for their tag argument, which also reveals
+ * double spawns (two live processes of one role), orphans (one role
+ * missing for longer than the recovery timeout) and zombies.
+ *
+ * `-P` adds CPU pressure (two busy loops per CPU) and `-M <mb>` memory
+ * pressure (processes repeatedly touching that much memory) for the whole
+ * run. Comparing runs with and without `WD_HARDEN=1` in the environment
+ * shows what the hardened mode buys in detection latency under pressure.
+ *
+ * The harness makes itself a child subreaper, so revived processes whose
+ * parent died are reaped here instead of piling up under init.
+ *
+ * Usage (from the directory holding `watchdog_exec`):
+ *      ./watchdog_chaos [-c ./client_test] [-n pairs] [-d duration_s]
+ *                       [-r faults_per_min] [-t timeout_s] [-H hang_s]
+ *                       [-S starve_s] [-s seed] [-P] [-M mb]
+ *                       [-f kill-target,kill-watchdog,hang,kill-both,starve]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>      /* using printf             */
+#include <stdlib.h>     /* using qsort, strtoul     */
+#include <string.h>     /* using strcmp, memcpy     */
+#include <signal.h>     /* using kill               */
+#include <fcntl.h>      /* using open               */
+#include <dirent.h>     /* using opendir            */
+#include <unistd.h>     /* using fork, execv        */
+#include <sys/wait.h>   /* using waitpid            */
+#include <sys/stat.h>   /* using mkdir              */
+#include <sys/prctl.h>  /* using PR_SET_CHILD_SUBREAPER */
+#include <sys/syscall.h> /* using SYS_pidfd_open    */
+
+#include "watchdog_trace.h"
+#include "watchdog_clock.h"
+
+#define CHAOS_MAX_PAIRS     (256)
+#define CHAOS_MAX_ROLE      (8)
+#define CHAOS_MAX_SAMPLES   (4096)
+#define CHAOS_POLL_NS       (50000000ull)
+#define CHAOS_PATH_MAX      (512)
+
+enum chaos_fault
+{
+	FAULT_KILL_TARGET,
+	FAULT_KILL_WATCHDOG,
+	FAULT_HANG,
+	FAULT_KILL_BOTH,
+	FAULT_STARVE,
+	FAULT_COUNT
+};
+
+static const char* g_fault_names[FAULT_COUNT] =
+{
+	"kill-target", "kill-watchdog", "hang", "kill-both", "starve"
+};
+
+typedef struct chaos_stats
+{
+	unsigned long   injected;
+	unsigned long   unrecovered;
+	size_t          n_samples;
+	double          samples[CHAOS_MAX_SAMPLES];     /* seconds */
+} chaos_stats_ty;
+
+typedef struct chaos_pair
+{
+	char        tag[32];
+	char        trace_dir[CHAOS_PATH_MAX];
+	pid_t       clients[CHAOS_MAX_ROLE];
+	size_t      n_clients;
+	pid_t       watchdogs[CHAOS_MAX_ROLE];
+	size_t      n_watchdogs;
+	size_t      n_zombies;
+	int         is_stopped;
+
+	int         is_healthy;         /* may receive the next fault */
+	int         fault;              /* FAULT_COUNT when none pending */
+	uint64_t    fault_ns;
+	uint64_t    launch_ns;
+	int         hung_fd;            /* pidfd of the stopped client, or -1 */
+
+	int         is_double;
+	uint64_t    missing_since_ns;
+	int         is_orphan;
+} chaos_pair_ty;
+
+typedef struct chaos
+{
+	const char*     client_path;
+	size_t          n_pairs;
+	double          duration_s;
+	double          faults_per_min;
+	double          timeout_s;
+	double          hang_s;
+	double          starve_s;
+	int             enabled[FAULT_COUNT];
+	uint64_t        rng;
+	char            base_dir[CHAOS_PATH_MAX];
+
+	chaos_pair_ty   pairs[CHAOS_MAX_PAIRS];
+	chaos_stats_ty  stats[FAULT_COUNT];
+	unsigned long   double_spawns;
+	unsigned long   orphans;
+	size_t          max_zombies;
+	pid_t           starvers[256];
+	size_t          n_starvers;
+	uint64_t        starve_end_ns;
+	int             is_cpu_pressure;
+	size_t          memory_pressure_mb;
+	pid_t           hogs[256];
+	size_t          n_hogs;
+} chaos_ty;
+
+static int      ParseFaults     (chaos_ty* chaos, char* list);
+static void     LaunchPair      (chaos_ty* chaos, chaos_pair_ty* pair);
+static void     KillPair        (chaos_ty* chaos, chaos_pair_ty* pair);
+static void     ResumeHung      (chaos_pair_ty* pair);
+static void     ScanProcesses   (chaos_ty* chaos);
+static void     UpdatePair      (chaos_ty* chaos, chaos_pair_ty* pair,
+                                 uint64_t now);
+static void     InjectFault     (chaos_ty* chaos, uint64_t now);
+static void     StartStarvation (chaos_ty* chaos, uint64_t now);
+static void     StopStarvation  (chaos_ty* chaos);
+static void     StartPressure   (chaos_ty* chaos);
+static void     StopPressure    (chaos_ty* chaos);
+static pid_t    SpawnBusyLoop   (void);
+static pid_t    SpawnMemoryHog  (size_t mb);
+static uint64_t LastHeartbeatNs (const chaos_pair_ty* pair, pid_t pid);
+static uint64_t RoleHeartbeatNs (const chaos_pair_ty* pair,
+                                 const pid_t* pids, size_t n);
+static void     Report          (chaos_ty* chaos);
+static int      CompareDouble   (const void* a, const void* b);
+static void     ReapChildren    (void);
+static double   Random          (chaos_ty* chaos);
+static uint64_t NowNs           (void);
+static void     SleepNs         (uint64_t ns);
+static int      IsPairProcess   (const chaos_pair_ty* pair, pid_t pid);
+
+static chaos_ty g_chaos;
+
+int main(int argc, char* argv[])
+{
+	chaos_ty* chaos = &g_chaos;
+	char dir[CHAOS_PATH_MAX];
+	uint64_t start_ns = 0;
+	uint64_t end_ns = 0;
+	size_t i;
+	int opt;
+
+	chaos->client_path = "./client_test";
+	chaos->n_pairs = 4;
+	chaos->duration_s = 600;
+	chaos->faults_per_min = 4;
+	chaos->timeout_s = 120;
+	chaos->hang_s = 30;
+	chaos->starve_s = 10;
+	chaos->rng = 1;
+	for (i = 0; i < FAULT_COUNT; ++i)
+	{
+		chaos->enabled[i] = (FAULT_KILL_BOTH != i);
+	}
+
+	while (-1 != (opt = getopt(argc, argv, "c:n:d:r:t:H:S:s:f:PM:")))
+	{
+		switch (opt)
+		{
+			case 'c': chaos->client_path = optarg; break;
+			case 'n': chaos->n_pairs = strtoul(optarg, NULL, 10); break;
+			case 'd': chaos->duration_s = strtod(optarg, NULL); break;
+			case 'r': chaos->faults_per_min = strtod(optarg, NULL); break;
+			case 't': chaos->timeout_s = strtod(optarg, NULL); break;
+			case 'H': chaos->hang_s = strtod(optarg, NULL); break;
+			case 'S': chaos->starve_s = strtod(optarg, NULL); break;
+			case 's': chaos->rng = strtoul(optarg, NULL, 10) | 1; break;
+			case 'P': chaos->is_cpu_pressure = 1; break;
+			case 'M': chaos->memory_pressure_mb = strtoul(optarg, NULL, 10);
+			          break;
+			case 'f':
+				if (ParseFaults(chaos, optarg))
+				{
+					return (1);
+				}
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-c client] [-n pairs] "
+				        "[-d duration_s] [-r faults_per_min] [-t timeout_s] "
+				        "[-H hang_s] [-S starve_s] [-s seed] [-f faults] "
+				        "[-P] [-M mb]\n",
+				        argv[0]);
+				return (1);
+		}
+	}
+
+	if (0 == chaos->n_pairs || chaos->n_pairs > CHAOS_MAX_PAIRS)
+	{
+		fprintf(stderr, "pairs must be 1..%d\n", CHAOS_MAX_PAIRS);
+		return (1);
+	}
+
+	if (prctl(PR_SET_CHILD_SUBREAPER, 1, 0, 0, 0))
+	{
+		perror("prctl(PR_SET_CHILD_SUBREAPER)");
+	}
+
+	sprintf(chaos->base_dir, "/tmp/wd_chaos.%d", (int) getpid());
+	if (mkdir(chaos->base_dir, 0755))
+	{
+		perror(chaos->base_dir);
+		return (1);
+	}
+
+	for (i = 0; i < chaos->n_pairs; ++i)
+	{
+		chaos_pair_ty* pair = &chaos->pairs[i];
+
+		sprintf(pair->tag, "chaos-%d-%lu", (int) getpid(), (unsigned long) i);
+		/* a buffer of its own: base_dir and trace_dir share g_chaos */
+		if ((size_t) snprintf(dir, sizeof(dir), "%s/%s", chaos->base_dir,
+		                      pair->tag) >= sizeof(dir))
+		{
+			printf("trace directory name too long\n");
+			return (1);
+		}
+		memcpy(pair->trace_dir, dir, sizeof(dir));
+		mkdir(pair->trace_dir, 0755);
+		LaunchPair(chaos, pair);
+	}
+
+	StartPressure(chaos);
+	start_ns = NowNs();
+	end_ns = start_ns + (uint64_t) (chaos->duration_s * WD_NS_PER_SEC);
+
+	while (NowNs() < end_ns)
+	{
+		uint64_t now = 0;
+
+		SleepNs(CHAOS_POLL_NS);
+		ReapChildren();
+		ScanProcesses(chaos);
+
+		now = NowNs();
+		for (i = 0; i < chaos->n_pairs; ++i)
+		{
+			UpdatePair(chaos, &chaos->pairs[i], now);
+		}
+
+		if (chaos->n_starvers && now >= chaos->starve_end_ns)
+		{
+			StopStarvation(chaos);
+		}
+
+		/* Poisson arrivals: one poll is a small slice of a minute */
+		if (Random(chaos) < chaos->faults_per_min * CHAOS_POLL_NS /
+		                    (60.0 * WD_NS_PER_SEC))
+		{
+			InjectFault(chaos, now);
+		}
+	}
+
+	StopStarvation(chaos);
+	StopPressure(chaos);
+	for (i = 0; i < chaos->n_pairs; ++i)
+	{
+		KillPair(chaos, &chaos->pairs[i]);
+	}
+
+	Report(chaos);
+	printf("traces kept in %s\n", chaos->base_dir);
+
+	return (0);
+}
+
+static int ParseFaults(chaos_ty* chaos, char* list)
+{
+	char* name = NULL;
+	size_t i;
+
+	for (i = 0; i < FAULT_COUNT; ++i)
+	{
+		chaos->enabled[i] = 0;
+	}
+
+	for (name = strtok(list, ","); NULL != name; name = strtok(NULL, ","))
+	{
+		for (i = 0; i < FAULT_COUNT && strcmp(name, g_fault_names[i]); ++i)
+		{
+		}
+		if (FAULT_COUNT == i)
+		{
+			fprintf(stderr, "unknown fault '%s'\n", name);
+			return (1);
+		}
+		chaos->enabled[i] = 1;
+	}
+
+	return (0);
+}
+
+static void LaunchPair(chaos_ty* chaos, chaos_pair_ty* pair)
+{
+	pid_t pid = fork();
+
+	if (pid < 0)
+	{
+		perror("fork");
+		return;
+	}
+
+	if (0 == pid)
+	{
+		char* args[3];
+		int null_fd = open("/dev/null", O_WRONLY);
+
+		dup2(null_fd, STDOUT_FILENO);
+		dup2(null_fd, STDERR_FILENO);
+		setenv("WD_TRACE", pair->trace_dir, 1);
+
+		args[0] = (char*) chaos->client_path;
+		args[1] = pair->tag;
+		args[2] = NULL;
+		execv(args[0], args);
+		_exit(127);
+	}
+
+	pair->is_healthy = 0;
+	pair->fault = FAULT_COUNT;
+	pair->hung_fd = -1;
+	pair->launch_ns = NowNs();
+	pair->missing_since_ns = 0;
+}
+
+static void KillPair(chaos_ty* chaos, chaos_pair_ty* pair)
+{
+	size_t i;
+	int round;
+
+	/* the peers revive each other; kill until no process is left */
+	for (round = 0; round < 20; ++round)
+	{
+		ScanProcesses(chaos);
+		if (0 == pair->n_clients && 0 == pair->n_watchdogs)
+		{
+			break;
+		}
+		for (i = 0; i < pair->n_clients; ++i)
+		{
+			kill(pair->clients[i], SIGKILL);
+		}
+		for (i = 0; i < pair->n_watchdogs; ++i)
+		{
+			kill(pair->watchdogs[i], SIGKILL);
+		}
+		SleepNs(CHAOS_POLL_NS);
+		ReapChildren();
+	}
+
+	if (pair->hung_fd >= 0)
+	{
+		close(pair->hung_fd);
+		pair->hung_fd = -1;
+	}
+}
+
+/* Fails harmlessly (ESRCH) if the stopped client is gone by now. */
+static void ResumeHung(chaos_pair_ty* pair)
+{
+	syscall(SYS_pidfd_send_signal, pair->hung_fd, SIGCONT, NULL, 0);
+	close(pair->hung_fd);
+	pair->hung_fd = -1;
+}
+
+static void ScanProcesses(chaos_ty* chaos)
+{
+	DIR* proc = opendir("/proc");
+	struct dirent* entry = NULL;
+	pid_t zombie_parents[256];
+	size_t n_zombies = 0;
+	size_t i;
+
+	for (i = 0; i < chaos->n_pairs; ++i)
+	{
+		chaos->pairs[i].n_clients = 0;
+		chaos->pairs[i].n_watchdogs = 0;
+		chaos->pairs[i].n_zombies = 0;
+		chaos->pairs[i].is_stopped = 0;
+	}
+
+	if (NULL == proc)
+	{
+		return;
+	}
+
+	while (NULL != (entry = readdir(proc)))
+	{
+		char path[64];
+		char cmdline[1024];
+		char stat[256];
+		const char* arg = NULL;
+		const char* base = NULL;
+		char* state = NULL;
+		ssize_t len = 0;
+		pid_t pid = (pid_t) strtol(entry->d_name, NULL, 10);
+		int fd = -1;
+
+		if (pid <= 0)
+		{
+			continue;
+		}
+
+		sprintf(path, "/proc/%d/cmdline", (int) pid);
+		fd = open(path, O_RDONLY);
+		if (fd < 0)
+		{
+			continue;
+		}
+		len = read(fd, cmdline, sizeof(cmdline) - 1);
+		close(fd);
+		if (len <= 0)
+		{
+			len = 0;
+		}
+		cmdline[len] = '\0';
+
+		sprintf(path, "/proc/%d/stat", (int) pid);
+		fd = open(path, O_RDONLY);
+		stat[0] = '\0';
+		if (fd >= 0)
+		{
+			ssize_t n = read(fd, stat, sizeof(stat) - 1);
+
+			stat[n > 0 ? n : 0] = '\0';
+			close(fd);
+		}
+		state = strrchr(stat, ')');
+		state = (NULL != state && ' ' == state[1]) ? state + 2 : NULL;
+
+		/* zombies have an empty cmdline: attribute them by their parent */
+		if (NULL != state && 'Z' == *state)
+		{
+			if (n_zombies < 256)
+			{
+				zombie_parents[n_zombies++] =
+				                    (pid_t) strtol(state + 2, NULL, 10);
+			}
+			continue;
+		}
+
+		base = strrchr(cmdline, '/');
+		base = (NULL != base) ? base + 1 : cmdline;
+
+		for (i = 0; i < chaos->n_pairs; ++i)
+		{
+			chaos_pair_ty* pair = &chaos->pairs[i];
+
+			for (arg = cmdline; arg < cmdline + len; arg += strlen(arg) + 1)
+			{
+				if (0 == strcmp(arg, pair->tag))
+				{
+					break;
+				}
+			}
+			if (arg >= cmdline + len)
+			{
+				continue;
+			}
+
+			if (0 == strcmp(base, "watchdog_exec"))
+			{
+				if (pair->n_watchdogs < CHAOS_MAX_ROLE)
+				{
+					pair->watchdogs[pair->n_watchdogs++] = pid;
+				}
+			}
+			else if (pair->n_clients < CHAOS_MAX_ROLE)
+			{
+				pair->clients[pair->n_clients++] = pid;
+			}
+			if (NULL != state && 'T' == *state)
+			{
+				pair->is_stopped = 1;
+			}
+			break;
+		}
+	}
+
+	closedir(proc);
+
+	while (n_zombies--)
+	{
+		for (i = 0; i < chaos->n_pairs; ++i)
+		{
+			if (IsPairProcess(&chaos->pairs[i], zombie_parents[n_zombies]))
+			{
+				++chaos->pairs[i].n_zombies;
+			}
+		}
+	}
+}
+
+static int IsPairProcess(const chaos_pair_ty* pair, pid_t pid)
+{
+	size_t i;
+
+	for (i = 0; i < pair->n_clients; ++i)
+	{
+		if (pair->clients[i] == pid)
+		{
+			return (1);
+		}
+	}
+	for (i = 0; i < pair->n_watchdogs; ++i)
+	{
+		if (pair->watchdogs[i] == pid)
+		{
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
+static void UpdatePair(chaos_ty* chaos, chaos_pair_ty* pair, uint64_t now)
+{
+	uint64_t timeout_ns = (uint64_t) (chaos->timeout_s * WD_NS_PER_SEC);
+	uint64_t since_ns = FAULT_COUNT != pair->fault ? pair->fault_ns
+	                                                : pair->launch_ns;
+	int is_whole = (1 == pair->n_clients && 1 == pair->n_watchdogs &&
+	                !pair->is_stopped);
+	int is_restored = is_whole &&
+	            RoleHeartbeatNs(pair, pair->clients, 1) > since_ns &&
+	            RoleHeartbeatNs(pair, pair->watchdogs, 1) > since_ns;
+
+	if (pair->n_zombies > chaos->max_zombies)
+	{
+		chaos->max_zombies = pair->n_zombies;
+	}
+
+	if (pair->n_clients > 1 || pair->n_watchdogs > 1)
+	{
+		if (!pair->is_double)
+		{
+			++chaos->double_spawns;
+			pair->is_double = 1;
+		}
+	}
+	else
+	{
+		pair->is_double = 0;
+	}
+
+	if ((0 == pair->n_clients) != (0 == pair->n_watchdogs))
+	{
+		if (0 == pair->missing_since_ns)
+		{
+			pair->missing_since_ns = now;
+		}
+		else if (!pair->is_orphan && now - pair->missing_since_ns > timeout_ns)
+		{
+			++chaos->orphans;
+			pair->is_orphan = 1;
+		}
+	}
+	else
+	{
+		pair->missing_since_ns = 0;
+		pair->is_orphan = 0;
+	}
+
+	if (FAULT_HANG == pair->fault && pair->hung_fd >= 0 &&
+	    now - pair->fault_ns > (uint64_t) (chaos->hang_s * WD_NS_PER_SEC))
+	{
+		ResumeHung(pair);
+	}
+
+	if (is_restored)
+	{
+		if (FAULT_COUNT != pair->fault)
+		{
+			chaos_stats_ty* stats = &chaos->stats[pair->fault];
+
+			if (stats->n_samples < CHAOS_MAX_SAMPLES)
+			{
+				stats->samples[stats->n_samples++] =
+				            (double) (now - pair->fault_ns) / WD_NS_PER_SEC;
+			}
+			pair->fault = FAULT_COUNT;
+		}
+		pair->is_healthy = 1;
+		return;
+	}
+
+	if (now - since_ns > timeout_ns)
+	{
+		if (FAULT_COUNT != pair->fault)
+		{
+			++chaos->stats[pair->fault].unrecovered;
+		}
+		fprintf(stderr, "%s: not recovered after %.0fs, relaunching\n",
+		        pair->tag, chaos->timeout_s);
+		KillPair(chaos, pair);
+		LaunchPair(chaos, pair);
+	}
+}
+
+static void InjectFault(chaos_ty* chaos, uint64_t now)
+{
+	chaos_pair_ty* pair = NULL;
+	size_t n_enabled = 0;
+	size_t pick = 0;
+	int fault = 0;
+	size_t i;
+
+	for (i = 0; i < FAULT_COUNT; ++i)
+	{
+		n_enabled += chaos->enabled[i];
+	}
+	if (0 == n_enabled)
+	{
+		return;
+	}
+
+	/* start at a random pair and take the first healthy one */
+	pick = (size_t) (Random(chaos) * chaos->n_pairs);
+	for (i = 0; i < chaos->n_pairs && NULL == pair; ++i)
+	{
+		chaos_pair_ty* candidate = &chaos->pairs[(pick + i) % chaos->n_pairs];
+
+		if (candidate->is_healthy && FAULT_COUNT == candidate->fault)
+		{
+			pair = candidate;
+		}
+	}
+	if (NULL == pair)
+	{
+		return;
+	}
+
+	pick = (size_t) (Random(chaos) * n_enabled);
+	for (fault = 0; fault < FAULT_COUNT; ++fault)
+	{
+		if (chaos->enabled[fault] && 0 == pick--)
+		{
+			break;
+		}
+	}
+
+	if (FAULT_STARVE == fault && chaos->n_starvers)
+	{
+		return;
+	}
+
+	/* the pidfd makes sure SIGCONT never hits a reused pid; without one
+	 * the stopped client could never be resumed, so skip the hang */
+	if (FAULT_HANG == fault)
+	{
+		pair->hung_fd = (int) syscall(SYS_pidfd_open, pair->clients[0], 0);
+		if (pair->hung_fd < 0)
+		{
+			return;
+		}
+	}
+
+	pair->fault = fault;
+	pair->fault_ns = now;
+	pair->is_healthy = 0;
+	++chaos->stats[fault].injected;
+
+	switch (fault)
+	{
+		case FAULT_KILL_TARGET:
+			kill(pair->clients[0], SIGKILL);
+			break;
+		case FAULT_KILL_WATCHDOG:
+			kill(pair->watchdogs[0], SIGKILL);
+			break;
+		case FAULT_HANG:
+			syscall(SYS_pidfd_send_signal, pair->hung_fd, SIGSTOP, NULL, 0);
+			break;
+		case FAULT_KILL_BOTH:
+			kill(pair->clients[0], SIGKILL);
+			kill(pair->watchdogs[0], SIGKILL);
+			break;
+		default:
+			StartStarvation(chaos, now);
+			break;
+	}
+}
+
+static void StartStarvation(chaos_ty* chaos, uint64_t now)
+{
+	long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	long i;
+
+	n_cpus = n_cpus > 0 ? n_cpus * 2 : 2;
+	for (i = 0; i < n_cpus && chaos->n_starvers < 256; ++i)
+	{
+		pid_t pid = SpawnBusyLoop();
+
+		if (pid > 0)
+		{
+			chaos->starvers[chaos->n_starvers++] = pid;
+		}
+	}
+
+	chaos->starve_end_ns = now + (uint64_t) (chaos->starve_s * WD_NS_PER_SEC);
+}
+
+static void StopStarvation(chaos_ty* chaos)
+{
+	size_t i;
+
+	for (i = 0; i < chaos->n_starvers; ++i)
+	{
+		kill(chaos->starvers[i], SIGKILL);
+		waitpid(chaos->starvers[i], NULL, 0);
+	}
+	chaos->n_starvers = 0;
+}
+
+static void StartPressure(chaos_ty* chaos)
+{
+	long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	long i;
+
+	n_cpus = n_cpus > 0 ? n_cpus : 1;
+	for (i = 0; chaos->is_cpu_pressure && i < n_cpus * 2 &&
+	            chaos->n_hogs < 256; ++i)
+	{
+		pid_t pid = SpawnBusyLoop();
+
+		if (pid > 0)
+		{
+			chaos->hogs[chaos->n_hogs++] = pid;
+		}
+	}
+
+	/* two hogs so one is always touching while the other gets paged */
+	for (i = 0; chaos->memory_pressure_mb && i < 2 && chaos->n_hogs < 256; ++i)
+	{
+		pid_t pid = SpawnMemoryHog(chaos->memory_pressure_mb / 2);
+
+		if (pid > 0)
+		{
+			chaos->hogs[chaos->n_hogs++] = pid;
+		}
+	}
+}
+
+static void StopPressure(chaos_ty* chaos)
+{
+	size_t i;
+
+	for (i = 0; i < chaos->n_hogs; ++i)
+	{
+		kill(chaos->hogs[i], SIGKILL);
+		waitpid(chaos->hogs[i], NULL, 0);
+	}
+	chaos->n_hogs = 0;
+}
+
+static pid_t SpawnBusyLoop(void)
+{
+	pid_t pid = fork();
+
+	if (0 == pid)
+	{
+		volatile unsigned long spin = 0;
+
+		for (;;)
+		{
+			++spin;
+		}
+	}
+
+	return (pid);
+}
+
+static pid_t SpawnMemoryHog(size_t mb)
+{
+	pid_t pid = fork();
+
+	if (0 == pid)
+	{
+		size_t size = mb * 1024 * 1024;
+		volatile char* mem = (volatile char*) malloc(size);
+		size_t i = 0;
+
+		if (NULL == mem)
+		{
+			_exit(1);
+		}
+		for (;;)
+		{
+			for (i = 0; i < size; i += 4096)
+			{
+				++mem[i];
+			}
+		}
+	}
+
+	return (pid);
+}
+
+static uint64_t RoleHeartbeatNs(const chaos_pair_ty* pair, const pid_t* pids,
+                                size_t n)
+{
+	uint64_t last_ns = 0;
+	size_t i;
+
+	for (i = 0; i < n; ++i)
+	{
+		uint64_t ns = LastHeartbeatNs(pair, pids[i]);
+
+		last_ns = ns > last_ns ? ns : last_ns;
+	}
+
+	return (last_ns);
+}
+
+/* Latest heartbeat received by any thread of `pid`. */
+static uint64_t LastHeartbeatNs(const chaos_pair_ty* pair, pid_t pid)
+{
+	DIR* dir = opendir(pair->trace_dir);
+	struct dirent* entry = NULL;
+	char prefix[64];
+	uint64_t last_ns = 0;
+
+	if (NULL == dir)
+	{
+		return (0);
+	}
+
+	sprintf(prefix, "wd_trace.%d.", (int) pid);
+	while (NULL != (entry = readdir(dir)))
+	{
+		char path[CHAOS_PATH_MAX + 256];
+		uint64_t ns = 0;
+
+		if (0 != strncmp(entry->d_name, prefix, strlen(prefix)))
+		{
+			continue;
+		}
+		sprintf(path, "%s/%s", pair->trace_dir, entry->d_name);
+		ns = WdTraceLastEventNs(path, "heartbeat");
+		last_ns = ns > last_ns ? ns : last_ns;
+	}
+	closedir(dir);
+
+	return (last_ns);
+}
+
+static void Report(chaos_ty* chaos)
+{
+	size_t i;
+
+	printf("%-14s %8s %8s %11s %9s %9s %9s\n", "fault", "injected",
+	       "recovered", "unrecovered", "p50_s", "p99_s", "max_s");
+
+	for (i = 0; i < FAULT_COUNT; ++i)
+	{
+		chaos_stats_ty* stats = &chaos->stats[i];
+		size_t n = stats->n_samples;
+
+		if (0 == stats->injected)
+		{
+			continue;
+		}
+
+		qsort(stats->samples, n, sizeof(double), CompareDouble);
+		printf("%-14s %8lu %9lu %11lu %9.2f %9.2f %9.2f\n", g_fault_names[i],
+		       stats->injected, (unsigned long) n, stats->unrecovered,
+		       n ? stats->samples[(n - 1) * 50 / 100] : 0.0,
+		       n ? stats->samples[(n - 1) * 99 / 100] : 0.0,
+		       n ? stats->samples[n - 1] : 0.0);
+	}
+
+	printf("double spawns: %lu\norphans: %lu\nmax zombies per pair: %lu\n",
+	       chaos->double_spawns, chaos->orphans,
+	       (unsigned long) chaos->max_zombies);
+}
+
+static int CompareDouble(const void* a, const void* b)
+{
+	double lhs = *(const double*) a;
+	double rhs = *(const double*) b;
+
+	return ((lhs > rhs) - (lhs < rhs));
+}
+
+static void ReapChildren(void)
+{
+	while (waitpid(-1, NULL, WNOHANG) > 0)
+	{
+	}
+}
+
+/* xorshift64* */
+static double Random(chaos_ty* chaos)
+{
+	chaos->rng ^= chaos->rng >> 12;
+	chaos->rng ^= chaos->rng << 25;
+	chaos->rng ^= chaos->rng >> 27;
+
+	return ((double) ((chaos->rng * 0x2545F4914F6CDD1Dull) >> 11) /
+	        (double) (1ull << 53));
+}
+
+static uint64_t NowNs(void)
+{
+	return (WdClockNow(WdClockReal()));
+}
+
+static void SleepNs(uint64_t ns)
+{
+	WdClockSleep(WdClockReal(), ns);
+}
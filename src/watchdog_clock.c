@@ -0,0 +1,73 @@
+/**
+ * @file watchdog_clock.c
+ * @brief Real (monotonic) and virtual clocks for the Watchdog system.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>      /* using EINTR          */
+#include <time.h>       /* using clock_gettime  */
+
+#include "watchdog_clock.h"
+
+static uint64_t RealNow     (const wd_clock_ty* clock);
+static void     RealSleep   (wd_clock_ty* clock, uint64_t ns);
+static uint64_t VirtualNow  (const wd_clock_ty* clock);
+static void     VirtualSleep(wd_clock_ty* clock, uint64_t ns);
+
+static wd_clock_ty g_real_clock = {RealNow, RealSleep, 0};
+
+wd_clock_ty* WdClockReal(void)
+{
+	return (&g_real_clock);
+}
+
+void WdClockInitVirtual(wd_clock_ty* clock, uint64_t start_ns)
+{
+	clock->now_ns = VirtualNow;
+	clock->sleep_ns = VirtualSleep;
+	clock->virtual_ns = start_ns;
+}
+
+uint64_t WdClockNow(const wd_clock_ty* clock)
+{
+	return (clock->now_ns(clock));
+}
+
+void WdClockSleep(wd_clock_ty* clock, uint64_t ns)
+{
+	clock->sleep_ns(clock, ns);
+}
+
+static uint64_t RealNow(const wd_clock_ty* clock)
+{
+	struct timespec now;
+	(void) clock;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((uint64_t) now.tv_sec * WD_NS_PER_SEC + now.tv_nsec);
+}
+
+static void RealSleep(wd_clock_ty* clock, uint64_t ns)
+{
+	struct timespec left;
+	(void) clock;
+
+	left.tv_sec = (time_t) (ns / WD_NS_PER_SEC);
+	left.tv_nsec = (long) (ns % WD_NS_PER_SEC);
+
+	while (nanosleep(&left, &left) && EINTR == errno)
+	{
+	}
+}
+
+static uint64_t VirtualNow(const wd_clock_ty* clock)
+{
+	return (clock->virtual_ns);
+}
+
+static void VirtualSleep(wd_clock_ty* clock, uint64_t ns)
+{
+	clock->virtual_ns += ns;
+}
@@ -0,0 +1,298 @@
+/**
+ * @file watchdog_cmd.c
+ * @brief Intrusive MPSC queue (one atomic exchange per submit) of watchdog
+ *        commands, with an eventfd wakeup.
+ *
+ * Producers swap themselves in at `head` and then link the previous node
+ * to the new one; the single consumer walks from `tail`. Between the swap
+ * and the link the queue looks empty past the previous node, in which
+ * case the consumer stops and finds the rest on its next drain (the
+ * submitted/applied counters tell it something is still pending).
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>         /* using malloc, free   */
+#include <stdio.h>          /* using printf         */
+#include <unistd.h>         /* using read, write    */
+#include <sys/eventfd.h>    /* using eventfd        */
+
+#include "watchdog_cmd.h"
+#include "watchdog_trace.h"
+
+#define LOAD(p)         __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE(p, v)     __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+typedef struct wd_cmd_node
+{
+	struct wd_cmd_node* next;
+	wd_cmd_ty           cmd;
+	uint64_t            submitted_ns;
+} wd_cmd_node_ty;
+
+struct wd_cmd_queue
+{
+	wd_cmd_node_ty*     head;       /* last submitted; producers */
+	wd_cmd_node_ty*     tail;       /* next to apply; consumer */
+	wd_cmd_node_ty      stub;
+	int                 efd;
+	int                 is_signalled; /* eventfd armed, atomic */
+	unsigned long       submitted;  /* producers, atomic */
+	wd_cmd_stats_ty     stats;      /* consumer */
+};
+
+static void             Push    (wd_cmd_queue_ty* queue, wd_cmd_node_ty* node);
+static void             Wake    (wd_cmd_queue_ty* queue);
+static wd_cmd_node_ty*  Pop     (wd_cmd_queue_ty* queue);
+static void             Apply   (const wd_cmd_ty* cmd, wd_ty* wd);
+static void             Cancel  (wd_ty* wd, int (*task)(void*));
+
+wd_cmd_queue_ty* WdCmdCreate(void)
+{
+	wd_cmd_queue_ty* queue =
+	        (wd_cmd_queue_ty*) calloc(1, sizeof(wd_cmd_queue_ty));
+
+	if (NULL == queue)
+	{
+		printf("malloc failed\n");
+		return (NULL);
+	}
+
+	queue->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (queue->efd < 0)
+	{
+		printf("eventfd() failed\n");
+		free(queue);
+		return (NULL);
+	}
+	queue->head = &queue->stub;
+	queue->tail = &queue->stub;
+
+	return (queue);
+}
+
+void WdCmdDestroy(wd_cmd_queue_ty* queue)
+{
+	wd_cmd_node_ty* node = NULL;
+
+	while (NULL != (node = Pop(queue)))
+	{
+		free(node);
+	}
+	close(queue->efd);
+	free(queue);
+}
+
+int WdCmdSubmit(wd_cmd_queue_ty* queue, const wd_cmd_ty* cmd)
+{
+	wd_cmd_node_ty* node = (wd_cmd_node_ty*) malloc(sizeof(wd_cmd_node_ty));
+
+	if (NULL == node)
+	{
+		printf("malloc failed\n");
+		return (1);
+	}
+
+	node->cmd = *cmd;
+	node->submitted_ns = WdClockNow(WdClockReal());
+	Push(queue, node);
+	__atomic_add_fetch(&queue->submitted, 1, __ATOMIC_RELEASE);
+
+	/* one wakeup per batch: only the submit that finds it unarmed signals */
+	if (0 == __atomic_exchange_n(&queue->is_signalled, 1, __ATOMIC_SEQ_CST))
+	{
+		Wake(queue);
+	}
+
+	return (0);
+}
+
+int WdCmdSubmitOp(wd_cmd_queue_ty* queue, wd_cmd_op_ty op, wd_ty* wd,
+                  int (*task)(void*), const char* name,
+                  unsigned long interval)
+{
+	wd_cmd_ty cmd;
+
+	cmd.op = op;
+	cmd.wd = wd;
+	cmd.task = task;
+	cmd.name = name;
+	cmd.interval = interval;
+
+	return (WdCmdSubmit(queue, &cmd));
+}
+
+int WdCmdDrain(wd_cmd_queue_ty* queue, wd_ty* wd)
+{
+	wd_cmd_node_ty* node = NULL;
+	uint64_t count = 0;
+	uint64_t latency = 0;
+	int n_applied = 0;
+
+	if (LOAD(&queue->submitted) == queue->stats.applied)
+	{
+		return (0);
+	}
+
+	/* disarm first: a submit racing with the drain signals again */
+	__atomic_exchange_n(&queue->is_signalled, 0, __ATOMIC_SEQ_CST);
+	if (read(queue->efd, &count, sizeof(count)) < 0)
+	{
+		count = 0;
+	}
+
+	while (NULL != (node = Pop(queue)))
+	{
+		latency = WdClockNow(WdClockReal()) - node->submitted_ns;
+		if (latency > queue->stats.max_latency_ns)
+		{
+			queue->stats.max_latency_ns = latency;
+		}
+		queue->stats.total_latency_ns += latency;
+		++queue->stats.applied;
+		++n_applied;
+
+		Apply(&node->cmd, NULL != node->cmd.wd ? node->cmd.wd : wd);
+		free(node);
+	}
+
+	/* a producer was still linking its node in: come back for it */
+	if (LOAD(&queue->submitted) != queue->stats.applied &&
+	    0 == __atomic_exchange_n(&queue->is_signalled, 1, __ATOMIC_SEQ_CST))
+	{
+		Wake(queue);
+	}
+
+	return (n_applied);
+}
+
+int WdCmdTSK(void* args)
+{
+	(void) args;
+
+	return (1);
+}
+
+int WdCmdGetFd(const wd_cmd_queue_ty* queue)
+{
+	return (queue->efd);
+}
+
+void WdCmdGetStats(const wd_cmd_queue_ty* queue, wd_cmd_stats_ty* stats)
+{
+	*stats = queue->stats;
+	stats->submitted = LOAD(&queue->submitted);
+}
+
+static void Push(wd_cmd_queue_ty* queue, wd_cmd_node_ty* node)
+{
+	wd_cmd_node_ty* prev = NULL;
+
+	node->next = NULL;
+	prev = __atomic_exchange_n(&queue->head, node, __ATOMIC_ACQ_REL);
+	STORE(&prev->next, node);
+}
+
+static void Wake(wd_cmd_queue_ty* queue)
+{
+	uint64_t one = 1;
+
+	/* fails only if the counter would overflow: it is readable anyway */
+	if (sizeof(one) != write(queue->efd, &one, sizeof(one)))
+	{
+		return;
+	}
+}
+
+static wd_cmd_node_ty* Pop(wd_cmd_queue_ty* queue)
+{
+	wd_cmd_node_ty* tail = queue->tail;
+	wd_cmd_node_ty* next = LOAD(&tail->next);
+
+	if (&queue->stub == tail)
+	{
+		if (NULL == next)
+		{
+			return (NULL);
+		}
+		queue->tail = next;
+		tail = next;
+		next = LOAD(&next->next);
+	}
+
+	if (NULL != next)
+	{
+		queue->tail = next;
+		return (tail);
+	}
+
+	/* a producer swapped in past `tail` but has not linked it yet */
+	if (tail != LOAD(&queue->head))
+	{
+		return (NULL);
+	}
+
+	/* `tail` is the last node: park the stub behind it to take it out */
+	Push(queue, &queue->stub);
+	next = LOAD(&tail->next);
+	if (NULL != next)
+	{
+		queue->tail = next;
+		return (tail);
+	}
+
+	return (NULL);
+}
+
+static void Apply(const wd_cmd_ty* cmd, wd_ty* wd)
+{
+	WD_TRACE_I("command", (long) cmd->op);
+
+	switch (cmd->op)
+	{
+		case WD_CMD_ADD:
+			WdAddNamedTask(wd, cmd->task, cmd->name, cmd->interval);
+			break;
+
+		case WD_CMD_REMOVE:
+			Cancel(wd, cmd->task);
+			break;
+
+		case WD_CMD_RESCHEDULE:
+			Cancel(wd, cmd->task);
+			WdAddNamedTask(wd, cmd->task, cmd->name, cmd->interval);
+			break;
+
+		case WD_CMD_RUN:
+			WD_TRACE_B(cmd->name, wd->target_pid);
+			cmd->task(wd);
+			WD_TRACE_E(cmd->name, 0);
+			break;
+
+		case WD_CMD_STOP:
+			WdStop(wd);
+			break;
+	}
+}
+
+/* Frees the slots right away, so a reschedule can reuse them; a slot that
+ * is being dispatched right now is dropped by `WdDispatchTSK` on return. */
+static void Cancel(wd_ty* wd, int (*task)(void*))
+{
+	size_t i;
+
+	if (NULL == task)
+	{
+		return;
+	}
+
+	for (i = 0; i < WD_MAX_TASKS; ++i)
+	{
+		if (task == wd->tasks[i].task)
+		{
+			SchedRemoveTask(wd->scheduler, wd->tasks[i].uid);
+			wd->tasks[i].task = NULL;
+			wd->tasks[i].is_cancelled = 0;
+		}
+	}
+}
@@ -0,0 +1,230 @@
+/**
+ * @file watchdog_cmd_bench.c
+ * @brief Floods a watchdog's command queue from many threads.
+ *
+ * P producer threads each submit M commands (runs of a counting task, plus
+ * a reschedule of a per-producer task every 64 commands) while a single
+ * consumer applies them. The consumer is either the scheduler itself
+ * (commands drained on dispatch, so latency follows the one-second tick)
+ * or an event loop waiting on the queue's eventfd (`-e`). Prints the
+ * throughput and the submit-to-apply latency, and checks that every
+ * command was applied exactly once. With `-i`, producers pause between
+ * commands, which shows the latency of a queue that is not saturated.
+ *
+ * Usage:
+ *      ./watchdog_cmd_bench [-p producers] [-m commands] [-i pause_us] [-e]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>          /* using printf         */
+#include <stdlib.h>         /* using strtoul        */
+#include <unistd.h>         /* using getopt         */
+#include <poll.h>           /* using poll           */
+#include <sched.h>          /* using sched_yield    */
+#include <pthread.h>        /* using pthread_create */
+
+#include "watchdog_utils.h"
+#include "watchdog_cmd.h"
+
+#define BENCH_PRODUCERS_MAX (64)
+#define BENCH_RESCHEDULE    (64)
+
+static void*    ProducerThread  (void* args);
+static void     EventLoop       (wd_ty* wd);
+static int      CountTSK        (void* args);
+static int      IdleTSK         (void* args);
+static int      NoSignal        (wd_ty* wd, int sig_num);
+static int      NoPoll          (wd_ty* wd);
+
+static const wd_sol_ops_ty g_no_sol_ops = {NoSignal, NoPoll, NULL};
+
+static wd_cmd_queue_ty* g_queue = NULL;
+static unsigned long    g_n_producers = 4;
+static unsigned long    g_per_producer = 100000;
+static unsigned long    g_pause_us = 0;
+static unsigned long    g_done = 0;
+static unsigned long    g_counted = 0;
+static char*            g_args[] = {"cmd_bench", "1", "3", NULL};
+
+int main(int argc, char* argv[])
+{
+	pthread_t producers[BENCH_PRODUCERS_MAX];
+	wd_cmd_stats_ty stats;
+	wd_ty* wd = NULL;
+	unsigned long expected = 0;
+	uint64_t start_ns = 0;
+	uint64_t end_ns = 0;
+	int is_event_loop = 0;
+	unsigned long i;
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "p:m:i:e")))
+	{
+		switch (opt)
+		{
+			case 'p':
+				g_n_producers = strtoul(optarg, NULL, 10);
+				break;
+			case 'm':
+				g_per_producer = strtoul(optarg, NULL, 10);
+				break;
+			case 'i':
+				g_pause_us = strtoul(optarg, NULL, 10);
+				break;
+			case 'e':
+				is_event_loop = 1;
+				break;
+			default:
+				printf("usage: %s [-p producers] [-m commands] "
+				       "[-i pause_us] [-e]\n", argv[0]);
+				return (1);
+		}
+	}
+	if (0 == g_n_producers || g_n_producers > BENCH_PRODUCERS_MAX)
+	{
+		printf("producers must be 1..%d\n", BENCH_PRODUCERS_MAX);
+		return (1);
+	}
+
+	g_queue = WdCmdCreate();
+	wd = WdCreate(g_args);
+	if (NULL == g_queue || NULL == wd)
+	{
+		printf("setup failed\n");
+		return (1);
+	}
+	wd->sol_ops = &g_no_sol_ops;
+	wd->cmds = g_queue;
+	WdAddTask(wd, WdCmdTSK, 1);
+
+	start_ns = WdClockNow(WdClockReal());
+	for (i = 0; i < g_n_producers; ++i)
+	{
+		if (pthread_create(&producers[i], NULL, ProducerThread, NULL))
+		{
+			printf("pthread_create failed\n");
+			return (1);
+		}
+	}
+
+	if (is_event_loop)
+	{
+		EventLoop(wd);
+	}
+	else
+	{
+		WdStart(wd);
+	}
+	end_ns = WdClockNow(WdClockReal());
+
+	for (i = 0; i < g_n_producers; ++i)
+	{
+		pthread_join(producers[i], NULL);
+	}
+	WdCmdDrain(g_queue, wd);
+
+	expected = g_n_producers * g_per_producer;
+	WdCmdGetStats(g_queue, &stats);
+	printf("%s: %lu producers x %lu commands\n",
+	       is_event_loop ? "event loop" : "scheduler", g_n_producers,
+	       g_per_producer);
+	printf("  submitted %lu, applied %lu, counted %lu of %lu\n",
+	       stats.submitted, stats.applied, g_counted, expected);
+	printf("  %.0f commands/s, latency mean %.1f us, max %.1f us\n",
+	       (double) stats.applied * 1e9 / (double) (end_ns - start_ns),
+	       0 == stats.applied ? 0.0 :
+	       (double) stats.total_latency_ns / (double) stats.applied / 1e3,
+	       (double) stats.max_latency_ns / 1e3);
+
+	WdDestroy(wd);
+	WdCmdDestroy(g_queue);
+
+	return (g_counted == expected && stats.applied == stats.submitted ? 0 : 1);
+}
+
+static void* ProducerThread(void* args)
+{
+	unsigned long i;
+
+	(void) args;
+
+	for (i = 0; i < g_per_producer; ++i)
+	{
+		while (0 != WdCmdRun(g_queue, NULL, CountTSK))
+		{
+			sched_yield();
+		}
+		if (0 == i % BENCH_RESCHEDULE)
+		{
+			WdCmdReschedule(g_queue, NULL, IdleTSK, 1 + i % 3);
+		}
+		if (0 != g_pause_us)
+		{
+			usleep(g_pause_us);
+		}
+	}
+
+	/* the last producer to finish stops the scheduler */
+	if (__atomic_add_fetch(&g_done, 1, __ATOMIC_ACQ_REL) == g_n_producers)
+	{
+		WdCmdStop(g_queue, NULL);
+	}
+
+	return (NULL);
+}
+
+/* Applies commands as soon as the eventfd says some are pending. */
+static void EventLoop(wd_ty* wd)
+{
+	struct pollfd pfd;
+
+	pfd.fd = WdCmdGetFd(g_queue);
+	pfd.events = POLLIN;
+
+	while (1)
+	{
+		wd_cmd_stats_ty stats;
+
+		if (poll(&pfd, 1, 1000) > 0)
+		{
+			WdCmdDrain(g_queue, wd);
+		}
+		WdCmdGetStats(g_queue, &stats);
+		if (g_n_producers == __atomic_load_n(&g_done, __ATOMIC_ACQUIRE) &&
+		    stats.applied == stats.submitted)
+		{
+			break;
+		}
+	}
+}
+
+static int CountTSK(void* args)
+{
+	(void) args;
+	++g_counted;
+
+	return (0);
+}
+
+static int IdleTSK(void* args)
+{
+	(void) args;
+
+	return (1);
+}
+
+static int NoSignal(wd_ty* wd, int sig_num)
+{
+	(void) wd;
+	(void) sig_num;
+
+	return (0);
+}
+
+static int NoPoll(wd_ty* wd)
+{
+	(void) wd;
+
+	return (1);
+}
@@ -1,61 +1,139 @@
-/**
- * @file watchdog_exec.c
- * @brief Watchdog executable used to monitor and revive the original process.
- *
- * This file defines the behavior of the watchdog *process* (not the thread).
- * It is launched by the main program via `MakeMeImmortal`, and its job is to:
- * 
- * - Monitor the parent process (the original application).
- * - Send and receive heartbeat signals (`SIGUSR1`) to ensure it's alive.
- * - Restart the original process if it stops responding or crashes.
- *
- * The watchdog uses a scheduler to run tasks periodically:
- *  - `SendSolTSK` – Sends heartbeat signal to the parent.
- *  - `CheckSolTSK` – Verifies heartbeat response.
- *  - `ReviveIfErrorTSK` – Restarts the process if needed.
- *
- * This file is compiled into a separate binary and invoked using `execv`.
- */
-
-
-#define _POSIX_C_SOURCE 200809L
-
-#include <stdio.h>
-#include <unistd.h>
-#include <stdlib.h>  /* for malloc */
-#include <string.h>  /* for strdup */
-#include <assert.h>  /* for assert */
-#include <signal.h>  /* using SIGKILL */
-
-#include "scheduler.h"
-#include "watchdog_utils.h"
-
-int ExecTargetTSK(void* args);
-
-int main(int argc, char* argv[])
-{
-	wd_ty* wd = NULL;
-	(void) argc;
-
-	SetSignalHandler(SIGUSR1, SIGUSR1Handler);
-
-	wd = WdCreate(argv);
-	wd->target_pid = getppid();
-	wd->target_args = &wd->target_args[3];
-	wd->revive_task = ExecTargetTSK;
-	WdAddTask(wd, SendSolTSK, 6);
-	WdAddTask(wd, CheckSolTSK, 4);
-	WdAddTask(wd, ReviveIfErrorTSK, 10);
-	WdStart(wd);
-
-	return (0);
-}
-
-int ExecTargetTSK(void* args)
-{
-	wd_ty* wd = (wd_ty*) args;
-	
-	WdExecTarget(wd);
-	
-	return (0);
-}
+/**
+ * @file watchdog_exec.c
+ * @brief Watchdog executable used to monitor and revive the original process.
+ *
+ * This file defines the behavior of the watchdog *process* (not the thread).
+ * It is launched by the main program via `MakeMeImmortal`, and its job is to:
+ * 
+ * - Monitor the parent process (the original application).
+ * - Send and receive heartbeat signals (`SIGUSR1`) to ensure it's alive.
+ * - Restart the original process if it stops responding or crashes.
+ *
+ * The watchdog uses a scheduler to run tasks periodically:
+ *  - `SendSolTSK` – Sends heartbeat signal to the parent.
+ *  - `CheckSolTSK` – Verifies heartbeat response.
+ *  - `ReviveIfErrorTSK` – Restarts the process if needed.
+ *  - `WdFlightWatchTSK` – Dumps the parent's flight recorder when it exits.
+ *  - `ProbeTSK` – Probes the parent's service endpoint, if `WD_PROBE` is set.
+ *
+ * With `WD_CAPTURE` set, a pump thread also logs the pair's output (see
+ * watchdog_capture.h); it ends with the process, and the pipe it drained
+ * carries on to the next watchdog process.
+ *
+ * Missed heartbeats count only after the parent's first heartbeat, which
+ * is its readiness report (see watchdog_ready.h); the watchdog itself
+ * reports ready to the client right before its tasks start.
+ *
+ * This file is compiled into a separate binary and invoked using `execv`.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>  /* for malloc */
+#include <string.h>  /* for strdup */
+#include <assert.h>  /* for assert */
+#include <signal.h>  /* using SIGKILL */
+
+#include "scheduler.h"
+#include "watchdog_utils.h"
+#include "watchdog_harden.h"
+#include "watchdog_flight.h"
+#include "watchdog_state.h"
+#include "watchdog_ready.h"
+#include "watchdog_probe.h"
+#include "watchdog_profile.h"
+#include "watchdog_capture.h"
+
+int ExecTargetTSK(void* args);
+static void AddWatchTasks(wd_ty* wd);
+static int ProbeTSK(void* args);
+
+static wd_probe_ty* g_probe = NULL;
+static wd_capture_ty* g_capture = NULL;
+
+int main(int argc, char* argv[])
+{
+	wd_ty* wd = NULL;
+	wd_state_ty* state = NULL;
+	uint64_t started_ns = 0;
+
+	WdProfileMarkSelf(WD_PHASE_MAIN);
+	WdHardenProcess();
+	SetSignalHandler(SIGUSR1, SIGUSR1Handler);
+	/* argv: exec path, interval, max fails, then the client's argv */
+	if (argc > 3)
+	{
+		g_capture = WdCaptureFromEnv(argv[3]);
+	}
+
+	wd = WdCreate(argv);
+	wd->target_pid = getppid();
+	wd->target_args = &wd->target_args[3];
+	wd->revive_task = ExecTargetTSK;
+	state = WdStateOpen(0);
+	if (NULL != state)
+	{
+		WdStateAttach(wd, state, WD_ROLE_WATCHDOG);
+		/* the first client was started when it created the block */
+		started_ns = WdStateGetTargetStartedNs(wd);
+		if (0 == started_ns)
+		{
+			started_ns = state->created_ns;
+		}
+	}
+	WdAwaitHeartbeatReady(wd, 0 != started_ns ? started_ns :
+	                          WdClockNow(wd->clock));
+	g_probe = WdProbeFromEnv(wd);
+	AddWatchTasks(wd);
+	WdNotifyReady();
+	WdProfilePublish(wd);
+	WdStart(wd);
+
+	return (0);
+}
+
+static void AddWatchTasks(wd_ty* wd)
+{
+	WdAddTask(wd, SendSolTSK, 6);
+	WdAddTask(wd, CheckSolTSK, 4);
+	WdAddTask(wd, ReviveIfErrorTSK, 10);
+	WdAddTask(wd, WdFlightWatchTSK, 1);
+	if (NULL != wd->state)
+	{
+		WdAddTask(wd, WdStateLeaseTSK, 1);
+	}
+	if (NULL != g_probe)
+	{
+		WdAddTask(wd, ProbeTSK, 1);
+	}
+}
+
+static int ProbeTSK(void* args)
+{
+	(void) args;
+
+	return (WdProbeTSK(g_probe));
+}
+
+int ExecTargetTSK(void* args)
+{
+	wd_ty* wd = (wd_ty*) args;
+
+	/* another instance already revived the client: keep watching it */
+	if (NULL != wd->state && WdStateBeginRevive(wd))
+	{
+		WdAwaitHeartbeatReady(wd, WdStateGetTargetStartedNs(wd));
+		AddWatchTasks(wd);
+		return (0);
+	}
+
+	WdHardenResetForTarget();
+	WdProfileExport(wd);
+	WdExecTarget(wd);
+	WdProfileUnexport(wd);
+	
+	return (0);
+}
@@ -0,0 +1,341 @@
+/**
+ * @file watchdog_flight.c
+ * @brief Shared-memory flight recorder of the application, dumped by the watchdog.
+ *
+ * Writers claim a slot with one relaxed atomic increment of `head`, fill
+ * it, and publish it by storing its `seq` last (release). Several threads
+ * may record at once without a lock. The reader (`WdFlightDump`) copies a
+ * slot between two acquire loads of its `seq` and skips slots that were
+ * rewritten or not yet published meanwhile.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>         /* using getenv             */
+#include <stdio.h>          /* using fopen, fprintf     */
+#include <string.h>         /* using memcpy, strncpy    */
+#include <time.h>           /* using clock_gettime      */
+#include <fcntl.h>          /* using O_RDWR             */
+#include <unistd.h>         /* using ftruncate, syscall */
+#include <poll.h>           /* using poll               */
+#include <pthread.h>        /* using pthread_atfork     */
+#include <sys/mman.h>       /* using shm_open, mmap     */
+#include <sys/syscall.h>    /* using SYS_gettid         */
+
+#include "watchdog_flight.h"
+#include "watchdog_utils.h"
+
+#define WD_FLIGHT_ENV       "WD_FLIGHT"
+#define WD_FLIGHT_PATH_MAX  (512)
+#define WD_FLIGHT_NAME_MAX  (64)
+
+static uint64_t NowNs       (clockid_t clock_id);
+static void     ShmName     (char* name, pid_t pid);
+static void     ResetInChild(void);
+static void     Record      (wd_flight_ring_ty* ring, unsigned int code,
+                             uint64_t a, uint64_t b, const char* text);
+static void     WriteDump   (FILE* out, const wd_flight_ring_ty* ring,
+                             pid_t pid, const char* reason);
+
+wd_flight_ring_ty* g_wd_flight = NULL;
+
+static __thread uint32_t    t_tid = 0;
+static int                  g_pidfd = -1;
+static pid_t                g_pidfd_pid = 0;
+
+int WdFlightCreate(void)
+{
+	char name[WD_FLIGHT_NAME_MAX];
+	const char* dir = getenv(WD_FLIGHT_ENV);
+	wd_flight_ring_ty* ring = NULL;
+	int fd = -1;
+
+	if (NULL != g_wd_flight || NULL == dir || '\0' == *dir)
+	{
+		return (0);
+	}
+
+	ShmName(name, getpid());
+	fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+	{
+		printf("flight shm_open() failed\n");
+		return (1);
+	}
+
+	if (ftruncate(fd, sizeof(wd_flight_ring_ty)))
+	{
+		printf("flight ftruncate() failed\n");
+		close(fd);
+		shm_unlink(name);
+		return (1);
+	}
+
+	ring = (wd_flight_ring_ty*) mmap(NULL, sizeof(wd_flight_ring_ty),
+	                                 PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == ring)
+	{
+		printf("flight mmap() failed\n");
+		shm_unlink(name);
+		return (1);
+	}
+
+	ring->version = WD_FLIGHT_VERSION;
+	ring->capacity = WD_FLIGHT_CAPACITY;
+	ring->pid = (uint32_t) getpid();
+	ring->mono_at_create_ns = NowNs(CLOCK_MONOTONIC);
+	ring->real_at_create_ns = NowNs(CLOCK_REALTIME);
+	ring->head = 0;
+	__atomic_store_n(&ring->magic, WD_FLIGHT_MAGIC, __ATOMIC_RELEASE);
+
+	pthread_atfork(NULL, NULL, ResetInChild);
+	__atomic_store_n(&g_wd_flight, ring, __ATOMIC_RELEASE);
+
+	return (0);
+}
+
+/* Other threads may be recording right now: the ring stays mapped (and
+ * recordable) until the process exits, only its name goes away. */
+void WdFlightRemove(void)
+{
+	char name[WD_FLIGHT_NAME_MAX];
+
+	if (NULL == __atomic_load_n(&g_wd_flight, __ATOMIC_ACQUIRE))
+	{
+		return;
+	}
+
+	ShmName(name, getpid());
+	shm_unlink(name);
+}
+
+void WdFlightRecord(unsigned int code, uint64_t a, uint64_t b)
+{
+	wd_flight_ring_ty* ring = __atomic_load_n(&g_wd_flight, __ATOMIC_ACQUIRE);
+
+	if (NULL != ring)
+	{
+		Record(ring, code, a, b, NULL);
+	}
+}
+
+void WdFlightNote(const char* text)
+{
+	wd_flight_ring_ty* ring = __atomic_load_n(&g_wd_flight, __ATOMIC_ACQUIRE);
+
+	if (NULL != ring)
+	{
+		Record(ring, 0, 0, 0, text);
+	}
+}
+
+int WdFlightDump(pid_t pid, const char* reason)
+{
+	char name[WD_FLIGHT_NAME_MAX];
+	char path[WD_FLIGHT_PATH_MAX];
+	const char* dir = getenv(WD_FLIGHT_ENV);
+	const wd_flight_ring_ty* ring = NULL;
+	FILE* out = NULL;
+	int fd = -1;
+
+	if (NULL == dir || '\0' == *dir || pid <= 0)
+	{
+		return (1);
+	}
+
+	ShmName(name, pid);
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+	{
+		return (1);
+	}
+
+	ring = (const wd_flight_ring_ty*) mmap(NULL, sizeof(wd_flight_ring_ty),
+	                                       PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == ring)
+	{
+		printf("flight mmap() failed\n");
+		return (1);
+	}
+
+	/* one dump per ring, whichever of exit and revive notices first */
+	shm_unlink(name);
+
+	if (WD_FLIGHT_MAGIC != __atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) ||
+	    WD_FLIGHT_VERSION != ring->version ||
+	    WD_FLIGHT_CAPACITY != ring->capacity)
+	{
+		munmap((void*) ring, sizeof(wd_flight_ring_ty));
+		return (1);
+	}
+
+	sprintf(path, "%.400s/wd_flight.%d.%.31s.log", dir, (int) pid, reason);
+	out = fopen(path, "w");
+	if (NULL == out)
+	{
+		printf("flight fopen() failed\n");
+		munmap((void*) ring, sizeof(wd_flight_ring_ty));
+		return (1);
+	}
+
+	WriteDump(out, ring, pid, reason);
+	fclose(out);
+	munmap((void*) ring, sizeof(wd_flight_ring_ty));
+
+	return (0);
+}
+
+int WdFlightWatchTSK(void* args)
+{
+	wd_ty* wd = (wd_ty*) args;
+	const char* dir = getenv(WD_FLIGHT_ENV);
+	struct pollfd pfd;
+
+	if (NULL == dir || '\0' == *dir)
+	{
+		return (0);
+	}
+
+	if (g_pidfd >= 0 && g_pidfd_pid != wd->target_pid)
+	{
+		close(g_pidfd);
+		g_pidfd = -1;
+	}
+
+	if (g_pidfd < 0)
+	{
+		g_pidfd = (int) syscall(SYS_pidfd_open, wd->target_pid, 0);
+		if (g_pidfd < 0)
+		{
+			/* no pidfds: the dump is left to ReviveIfErrorTSK */
+			return (0);
+		}
+		g_pidfd_pid = wd->target_pid;
+	}
+
+	pfd.fd = g_pidfd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, 0) <= 0)
+	{
+		return (1);
+	}
+
+	WdFlightDump(wd->target_pid, "exit");
+	close(g_pidfd);
+	g_pidfd = -1;
+
+	return (0);
+}
+
+static void Record(wd_flight_ring_ty* ring, unsigned int code, uint64_t a,
+                   uint64_t b, const char* text)
+{
+	wd_flight_event_ty* event = NULL;
+	uint64_t idx = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+
+	if (0 == t_tid)
+	{
+		t_tid = (uint32_t) syscall(SYS_gettid);
+	}
+
+	event = &ring->events[idx & (WD_FLIGHT_CAPACITY - 1)];
+	__atomic_store_n(&event->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	event->ts_ns = NowNs(CLOCK_MONOTONIC);
+	event->tid = t_tid;
+	event->code = code;
+	event->a = a;
+	event->b = b;
+	if (NULL != text)
+	{
+		strncpy(event->text, text, WD_FLIGHT_TEXT_LEN - 1);
+		event->text[WD_FLIGHT_TEXT_LEN - 1] = '\0';
+	}
+	else
+	{
+		event->text[0] = '\0';
+	}
+
+	__atomic_store_n(&event->seq, idx + 1, __ATOMIC_RELEASE);
+}
+
+static void WriteDump(FILE* out, const wd_flight_ring_ty* ring, pid_t pid,
+                      const char* reason)
+{
+	wd_flight_event_ty event;
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	uint64_t first = head > WD_FLIGHT_CAPACITY ? head - WD_FLIGHT_CAPACITY : 0;
+	uint64_t seq = 0;
+	unsigned long skipped = 0;
+
+	fprintf(out, "# flight recorder of pid %d, dumped on %s\n", (int) pid,
+	        reason);
+	fprintf(out, "# %lu events recorded, %lu overwritten\n",
+	        (unsigned long) head, (unsigned long) first);
+	fprintf(out, "# seq wall_time +ms tid code a b text\n");
+
+	for (seq = first + 1; seq <= head; ++seq)
+	{
+		const wd_flight_event_ty* slot =
+		                &ring->events[(seq - 1) & (WD_FLIGHT_CAPACITY - 1)];
+		uint64_t real_ns = 0;
+		time_t real_s = 0;
+		struct tm tm;
+		char wall[32];
+
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq)
+		{
+			++skipped;
+			continue;
+		}
+		memcpy(&event, slot, sizeof(event));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+		{
+			++skipped;
+			continue;
+		}
+
+		real_ns = ring->real_at_create_ns +
+		          (event.ts_ns - ring->mono_at_create_ns);
+		real_s = (time_t) (real_ns / 1000000000u);
+		localtime_r(&real_s, &tm);
+		strftime(wall, sizeof(wall), "%Y-%m-%d %H:%M:%S", &tm);
+		event.text[WD_FLIGHT_TEXT_LEN - 1] = '\0';
+
+		fprintf(out, "%lu %s.%03lu +%.3f %u %u %lu %lu %s\n",
+		        (unsigned long) seq, wall,
+		        (unsigned long) (real_ns / 1000000u % 1000u),
+		        (double) (event.ts_ns - ring->mono_at_create_ns) / 1e6,
+		        event.tid, event.code, (unsigned long) event.a,
+		        (unsigned long) event.b, event.text);
+	}
+
+	fprintf(out, "# %lu events in flight or rewritten while dumping\n",
+	        skipped);
+}
+
+static uint64_t NowNs(clockid_t clock_id)
+{
+	struct timespec now;
+
+	clock_gettime(clock_id, &now);
+
+	return ((uint64_t) now.tv_sec * 1000000000u + now.tv_nsec);
+}
+
+static void ShmName(char* name, pid_t pid)
+{
+	sprintf(name, "/wd_flight.%d", (int) pid);
+}
+
+/* a forked child gets its own ring only if it calls MakeMeImmortal */
+static void ResetInChild(void)
+{
+	g_wd_flight = NULL;
+	t_tid = 0;
+}
@@ -0,0 +1,239 @@
+/**
+ * @file watchdog_harden.c
+ * @brief Memory locking, priority, CPU pinning and OOM scores for the watchdog.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>          /* using printf                 */
+#include <stdlib.h>         /* using getenv, malloc         */
+#include <string.h>         /* using strerror               */
+#include <errno.h>          /* using errno                  */
+#include <fcntl.h>          /* using open                   */
+#include <unistd.h>         /* using write, syscall         */
+#include <sched.h>          /* using sched_setscheduler     */
+#include <malloc.h>         /* using mallopt                */
+#include <pthread.h>        /* using pthread_setschedparam  */
+#include <sys/mman.h>       /* using mlockall               */
+#include <sys/resource.h>   /* using setpriority            */
+#include <sys/syscall.h>    /* using SYS_gettid             */
+
+#include "watchdog_harden.h"
+
+#define WD_HARDEN_STACK     (256 * 1024)    /* stack prefaulted and locked */
+#define WD_HARDEN_HEAP      (1024 * 1024)   /* heap pool kept and locked */
+#define WD_HARDEN_NICE      (-10)
+#define WD_HARDEN_PAGE      (4096)
+
+static int  IsEnabled       (void);
+static int  GetEnvInt       (const char* name, int default_val);
+static void PrefaultStack   (void);
+static void PrefaultHeap    (void);
+static void LockThreadStack (void);
+static void SetOomScoreAdj  (int adj);
+static void Note            (const char* what);
+
+void WdHardenProcess(void)
+{
+	struct sched_param param;
+	cpu_set_t cpus;
+	int cpu = GetEnvInt("WD_HARDEN_CPU", -1);
+
+	if (!IsEnabled())
+	{
+		return;
+	}
+
+	PrefaultStack();
+	PrefaultHeap();
+	if (mlockall(MCL_CURRENT | MCL_FUTURE))
+	{
+		Note("mlockall()");
+	}
+
+	/* forked targets must not inherit the real-time policy */
+	param.sched_priority = GetEnvInt("WD_HARDEN_PRIO", 10);
+	if (sched_setscheduler(0, SCHED_RR | SCHED_RESET_ON_FORK, &param))
+	{
+		Note("sched_setscheduler(SCHED_RR)");
+		if (setpriority(PRIO_PROCESS, 0, WD_HARDEN_NICE))
+		{
+			Note("setpriority()");
+		}
+	}
+
+	if (cpu >= 0)
+	{
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		if (sched_setaffinity(0, sizeof(cpus), &cpus))
+		{
+			Note("sched_setaffinity()");
+		}
+	}
+
+	SetOomScoreAdj(WD_HARDEN_OOM_ADJ_WATCHDOG);
+}
+
+void WdHardenThread(void)
+{
+	struct sched_param param;
+	cpu_set_t cpus;
+	int cpu = GetEnvInt("WD_HARDEN_CPU", -1);
+
+	if (!IsEnabled())
+	{
+		return;
+	}
+
+	PrefaultStack();
+	LockThreadStack();
+
+	param.sched_priority = GetEnvInt("WD_HARDEN_PRIO", 10);
+	if (pthread_setschedparam(pthread_self(),
+	                          SCHED_RR | SCHED_RESET_ON_FORK, &param))
+	{
+		Note("pthread_setschedparam(SCHED_RR)");
+		if (setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid),
+		                WD_HARDEN_NICE))
+		{
+			Note("setpriority()");
+		}
+	}
+
+	if (cpu >= 0)
+	{
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus))
+		{
+			Note("pthread_setaffinity_np()");
+		}
+	}
+
+	/* this thread lives inside the target; the target is the one to go */
+	SetOomScoreAdj(WD_HARDEN_OOM_ADJ_TARGET);
+}
+
+void WdHardenResetForTarget(void)
+{
+	struct sched_param param;
+	cpu_set_t cpus;
+	long n_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	long i;
+
+	if (!IsEnabled())
+	{
+		return;
+	}
+
+	param.sched_priority = 0;
+	sched_setscheduler(0, SCHED_OTHER, &param);
+	setpriority(PRIO_PROCESS, 0, 0);
+
+	CPU_ZERO(&cpus);
+	for (i = 0; i < n_cpus && i < CPU_SETSIZE; ++i)
+	{
+		CPU_SET(i, &cpus);
+	}
+	sched_setaffinity(0, sizeof(cpus), &cpus);
+
+	SetOomScoreAdj(WD_HARDEN_OOM_ADJ_TARGET);
+}
+
+static int IsEnabled(void)
+{
+	const char* val = getenv("WD_HARDEN");
+
+	return (NULL != val && '\0' != *val && 0 != strcmp(val, "0"));
+}
+
+static int GetEnvInt(const char* name, int default_val)
+{
+	const char* val = getenv(name);
+
+	return ((NULL != val && '\0' != *val) ? atoi(val) : default_val);
+}
+
+/* Touches the stack the watchdog may grow into so it is resident. */
+static void PrefaultStack(void)
+{
+	volatile char stack[WD_HARDEN_STACK];
+	size_t i;
+
+	for (i = 0; i < sizeof(stack); i += WD_HARDEN_PAGE)
+	{
+		stack[i] = 0;
+	}
+}
+
+/* Locks the top of this thread's stack, the part it runs in, as reported
+ * by the thread's own attributes. */
+static void LockThreadStack(void)
+{
+	pthread_attr_t attr;
+	void* base = NULL;
+	size_t size = 0;
+	size_t len = 0;
+	int err = pthread_getattr_np(pthread_self(), &attr);
+
+	if (0 != err)
+	{
+		errno = err;
+		Note("pthread_getattr_np()");
+		return;
+	}
+	err = pthread_attr_getstack(&attr, &base, &size);
+	pthread_attr_destroy(&attr);
+	if (0 != err)
+	{
+		errno = err;
+		Note("pthread_attr_getstack()");
+		return;
+	}
+
+	len = size < WD_HARDEN_STACK ? size : WD_HARDEN_STACK;
+	if (mlock((char*) base + (size - len), len))
+	{
+		Note("mlock(stack)");
+	}
+}
+
+/* Grows the malloc arena and keeps it, so later allocations need no new pages. */
+static void PrefaultHeap(void)
+{
+	char* pool = NULL;
+
+	mallopt(M_TRIM_THRESHOLD, WD_HARDEN_HEAP * 4);
+	mallopt(M_MMAP_THRESHOLD, WD_HARDEN_HEAP * 2);
+
+	pool = (char*) malloc(WD_HARDEN_HEAP);
+	if (NULL != pool)
+	{
+		memset(pool, 0, WD_HARDEN_HEAP);
+		free(pool);
+	}
+}
+
+static void SetOomScoreAdj(int adj)
+{
+	char buf[16];
+	int fd = open("/proc/self/oom_score_adj", O_WRONLY);
+	int len = sprintf(buf, "%d", adj);
+
+	if (fd < 0 || write(fd, buf, len) != len)
+	{
+		Note("oom_score_adj");
+	}
+
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+}
+
+static void Note(const char* what)
+{
+	printf("hardened mode: %s failed (%s), continuing\n", what,
+	       strerror(errno));
+}
@@ -0,0 +1,218 @@
+/**
+ * @file watchdog_pressure.c
+ * @brief PSI sampling, stretched detection deadlines and staggered revives.
+ *
+ * The sample is process-wide and taken from the watchdog's scheduler
+ * thread, so it is shared by every watchdog context of the process
+ * without locking. The revive turns are process-wide too, so they are
+ * kept on the real clock whatever clock each context runs on.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>         /* using getenv, strtod, rand_r */
+#include <stdio.h>          /* using snprintf               */
+#include <string.h>         /* using strstr                 */
+#include <errno.h>          /* using errno                  */
+#include <fcntl.h>          /* using open                   */
+#include <poll.h>           /* using poll                   */
+#include <unistd.h>         /* using pread, syscall         */
+#include <sys/syscall.h>    /* using SYS_pidfd_open         */
+
+#include "watchdog_pressure.h"
+#include "watchdog_trace.h"
+
+#define WD_PRESSURE_FILES       (3)
+#define WD_PRESSURE_PATH_MAX    (256)
+#define WD_PRESSURE_SAMPLE_NS   (WD_NS_PER_SEC)
+
+static void     Init        (void);
+static double   ReadSome    (int fd);
+static int      IsPeerGone  (const wd_ty* wd);
+
+static const char* g_files[WD_PRESSURE_FILES] = {"cpu", "memory", "io"};
+
+static int          g_is_init = 0;
+static int          g_fds[WD_PRESSURE_FILES] = {-1, -1, -1};
+static double       g_threshold = 0.0;
+static double       g_level = -1.0;
+static uint64_t     g_sampled_ns = 0;
+static uint64_t     g_next_revive_ns = 0;
+static unsigned int g_seed = 0;
+
+double WdPressureGet(void)
+{
+	uint64_t now = 0;
+	double level = -1.0;
+	double some = 0.0;
+	int i;
+
+	Init();
+	if (0.0 == g_threshold)
+	{
+		return (-1.0);
+	}
+
+	now = WdClockNow(WdClockReal());
+	if (0 != g_sampled_ns && now - g_sampled_ns < WD_PRESSURE_SAMPLE_NS)
+	{
+		return (g_level);
+	}
+	g_sampled_ns = now;
+
+	for (i = 0; i < WD_PRESSURE_FILES; ++i)
+	{
+		some = ReadSome(g_fds[i]);
+		if (some > level)
+		{
+			level = some;
+		}
+	}
+
+	if (level >= g_threshold && g_level < g_threshold)
+	{
+		WD_TRACE_I("pressure high", (long) level);
+	}
+	else if (level < g_threshold && g_level >= g_threshold)
+	{
+		WD_TRACE_I("pressure normal", (long) level);
+	}
+	g_level = level;
+
+	return (g_level);
+}
+
+unsigned long WdPressureMaxFails(const wd_ty* wd)
+{
+	double level = WdPressureGet();
+	double stretch = 0.0;
+
+	/* only a slow peer gets more time: a dead one is not coming back */
+	if (level < g_threshold || IsPeerGone(wd))
+	{
+		return (wd->max_fails);
+	}
+
+	stretch = 1.0 + level / g_threshold;
+	if (stretch > WD_PRESSURE_MAX_STRETCH)
+	{
+		stretch = WD_PRESSURE_MAX_STRETCH;
+	}
+
+	return ((unsigned long) (wd->max_fails * stretch));
+}
+
+int WdPressureDeferRevive(wd_ty* wd)
+{
+	double level = WdPressureGet();
+	uint64_t now = WdClockNow(WdClockReal());
+	uint64_t delay_ms = 0;
+
+	if (level < 0.0 || level < g_threshold || IsPeerGone(wd))
+	{
+		wd->revive_after_ns = 0;
+		return (0);
+	}
+
+	if (0 == wd->revive_after_ns)
+	{
+		delay_ms = (uint64_t) rand_r(&g_seed) % (WD_PRESSURE_STAGGER_S * 1000);
+		wd->revive_after_ns = now + delay_ms * (WD_NS_PER_SEC / 1000);
+		WD_TRACE_I("revive staggered", (long) delay_ms);
+	}
+
+	if (now < wd->revive_after_ns || now < g_next_revive_ns)
+	{
+		return (1);
+	}
+
+	g_next_revive_ns = now + WD_PRESSURE_REVIVE_GAP_S * WD_NS_PER_SEC;
+	wd->revive_after_ns = 0;
+
+	return (0);
+}
+
+static void Init(void)
+{
+	char path[WD_PRESSURE_PATH_MAX];
+	const char* threshold = getenv(WD_PRESSURE_ENV);
+	const char* dir = getenv(WD_PRESSURE_DIR_ENV);
+	int i;
+
+	if (g_is_init)
+	{
+		return;
+	}
+	g_is_init = 1;
+
+	if (NULL == threshold || (g_threshold = strtod(threshold, NULL)) <= 0.0)
+	{
+		g_threshold = 0.0;
+		return;
+	}
+
+	if (NULL == dir || '\0' == *dir)
+	{
+		dir = WD_PRESSURE_DIR;
+	}
+	for (i = 0; i < WD_PRESSURE_FILES; ++i)
+	{
+		snprintf(path, sizeof(path), "%s/%s", dir, g_files[i]);
+		g_fds[i] = open(path, O_RDONLY | O_CLOEXEC);
+	}
+	if (g_fds[0] < 0 && g_fds[1] < 0 && g_fds[2] < 0)
+	{
+		printf("no pressure information in %s\n", dir);
+	}
+
+	/* different watchdogs of a host must draw different delays */
+	g_seed = (unsigned int) getpid() ^ (unsigned int) WdClockNow(WdClockReal());
+}
+
+/* Returns the "some avg10" value of an open PSI file, or -1. */
+static double ReadSome(int fd)
+{
+	char buf[256];
+	const char* avg10 = NULL;
+	ssize_t len = 0;
+
+	if (fd < 0)
+	{
+		return (-1.0);
+	}
+
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+	{
+		return (-1.0);
+	}
+	buf[len] = '\0';
+
+	avg10 = strstr(buf, "some avg10=");
+
+	return (NULL != avg10 ? strtod(avg10 + 11, NULL) : -1.0);
+}
+
+/* Non-zero if the peer is a local process that exited (a zombie included),
+ * as opposed to one that is merely slow to answer. */
+static int IsPeerGone(const wd_ty* wd)
+{
+	struct pollfd pfd;
+	int is_gone = 0;
+
+	if (wd->target_pid <= 0)
+	{
+		return (0);
+	}
+
+	pfd.fd = (int) syscall(SYS_pidfd_open, wd->target_pid, 0);
+	if (pfd.fd < 0)
+	{
+		return (ESRCH == errno);
+	}
+	pfd.events = POLLIN;
+	is_gone = (1 == poll(&pfd, 1, 0));
+	close(pfd.fd);
+
+	return (is_gone);
+}
@@ -0,0 +1,567 @@
+/**
+ * @file watchdog_probe.c
+ * @brief Non-blocking connect/request/reply probes multiplexed with epoll.
+ *
+ * Each probe keeps one socket at most and moves through
+ * IDLE -> CONNECTING -> SENDING -> RECEIVING -> IDLE; its epoll
+ * registration always matches the state (EPOLLOUT while connecting or
+ * sending, EPOLLIN while receiving). Completion closes the socket, which
+ * also drops the registration.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>         /* using calloc, getenv     */
+#include <stdio.h>          /* using printf             */
+#include <string.h>         /* using memcpy, strncmp    */
+#include <errno.h>          /* using errno              */
+#include <unistd.h>         /* using close              */
+#include <sys/epoll.h>      /* using epoll_create1      */
+#include <sys/socket.h>     /* using socket, connect    */
+#include <sys/un.h>         /* using sockaddr_un        */
+#include <netinet/in.h>     /* using sockaddr_in        */
+#include <arpa/inet.h>      /* using inet_pton          */
+
+#include "watchdog_probe.h"
+#include "watchdog_trace.h"
+
+#define WD_PROBE_EVENTS     (256)   /* events taken per epoll_wait() */
+#define WD_NS_PER_MS        (1000000ull)
+
+typedef enum probe_state
+{
+	PROBE_IDLE,
+	PROBE_CONNECTING,
+	PROBE_SENDING,
+	PROBE_RECEIVING
+} probe_state_ty;
+
+typedef struct wd_probe_one
+{
+	wd_probe_ty*            set;
+	wd_ty*                  wd;
+	struct sockaddr_storage addr;
+	socklen_t               addr_len;
+	char*                   request;
+	size_t                  request_len;
+	char*                   expect;
+	size_t                  expect_len;
+	uint64_t                timeout_ns;
+	uint64_t                interval_ns;
+	probe_state_ty          state;
+	int                     fd;
+	size_t                  sent;
+	char                    reply[WD_PROBE_REPLY_MAX];
+	size_t                  received;
+	uint64_t                next_ns;        /* next start */
+	uint64_t                deadline_ns;    /* of the probe in flight */
+	pid_t                   pid;            /* peer the fails belong to */
+	unsigned long           fails;          /* consecutive, this probe */
+} wd_probe_one_ty;
+
+struct wd_probe
+{
+	int                 epfd;
+	wd_probe_one_ty**   probes;
+	size_t              n_probes;
+	wd_probe_stats_ty   stats;
+};
+
+static void Start       (wd_probe_one_ty* probe, uint64_t now);
+static int  Advance     (wd_probe_one_ty* probe, uint32_t events);
+static int  Watch       (wd_probe_one_ty* probe, int op, uint32_t events);
+static void Finish      (wd_probe_one_ty* probe, int is_ok, int is_timeout);
+static int  ParseEndpoint(wd_probe_one_ty* probe, const char* endpoint);
+static char* CopyBytes  (const char* src, size_t len);
+static size_t Unescape  (char* str);
+
+wd_probe_ty* WdProbeCreate(void)
+{
+	wd_probe_ty* probes = (wd_probe_ty*) calloc(1, sizeof(wd_probe_ty));
+
+	if (NULL == probes)
+	{
+		printf("malloc failed\n");
+		return (NULL);
+	}
+
+	probes->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (probes->epfd < 0)
+	{
+		printf("epoll_create1() failed\n");
+		free(probes);
+		return (NULL);
+	}
+
+	return (probes);
+}
+
+void WdProbeDestroy(wd_probe_ty* probes)
+{
+	size_t i;
+
+	for (i = 0; i < probes->n_probes; ++i)
+	{
+		wd_probe_one_ty* probe = probes->probes[i];
+
+		if (probe->fd >= 0)
+		{
+			close(probe->fd);
+		}
+		free(probe->request);
+		free(probe->expect);
+		free(probe);
+	}
+	free(probes->probes);
+	close(probes->epfd);
+	free(probes);
+}
+
+int WdProbeAttach(wd_probe_ty* probes, wd_ty* wd,
+                  const wd_probe_spec_ty* spec)
+{
+	wd_probe_one_ty** all = NULL;
+	wd_probe_one_ty* probe =
+	        (wd_probe_one_ty*) calloc(1, sizeof(wd_probe_one_ty));
+
+	if (NULL == probe)
+	{
+		printf("malloc failed\n");
+		return (1);
+	}
+
+	if (ParseEndpoint(probe, spec->endpoint))
+	{
+		printf("bad probe endpoint %s\n", spec->endpoint);
+		free(probe);
+		return (1);
+	}
+
+	probe->request_len = NULL != spec->request ? spec->request_len : 0;
+	probe->expect_len = NULL != spec->expect ? strlen(spec->expect) : 0;
+	if (probe->expect_len > WD_PROBE_REPLY_MAX)
+	{
+		printf("probe reply prefix too long\n");
+		free(probe);
+		return (1);
+	}
+	probe->request = CopyBytes(spec->request, probe->request_len);
+	probe->expect = CopyBytes(spec->expect, probe->expect_len);
+	all = (wd_probe_one_ty**) realloc(probes->probes,
+	                                  (probes->n_probes + 1) * sizeof(*all));
+	if (NULL == probe->request || NULL == probe->expect || NULL == all)
+	{
+		printf("malloc failed\n");
+		free(probe->request);
+		free(probe->expect);
+		free(probe);
+		if (NULL != all)
+		{
+			probes->probes = all;
+		}
+		return (1);
+	}
+	probes->probes = all;
+
+	probe->set = probes;
+	probe->wd = wd;
+	probe->timeout_ns = spec->timeout_ms * WD_NS_PER_MS;
+	probe->interval_ns = spec->interval * WD_NS_PER_SEC;
+	probe->state = PROBE_IDLE;
+	probe->fd = -1;
+	probe->next_ns = 0;
+	probe->pid = wd->target_pid;
+	probes->probes[probes->n_probes++] = probe;
+
+	return (0);
+}
+
+wd_probe_ty* WdProbeFromEnv(wd_ty* wd)
+{
+	wd_probe_spec_ty spec;
+	wd_probe_ty* probes = NULL;
+	const char* endpoint = getenv(WD_PROBE_ENV);
+	const char* val = NULL;
+	char* request = NULL;
+	char* expect = NULL;
+	int status = 0;
+
+	if (NULL == endpoint || '\0' == *endpoint)
+	{
+		return (NULL);
+	}
+
+	memset(&spec, 0, sizeof(spec));
+	spec.endpoint = endpoint;
+	spec.timeout_ms = WD_PROBE_TIMEOUT_MS;
+	spec.interval = WD_PROBE_INTERVAL_S;
+	if (NULL != (val = getenv(WD_PROBE_TIMEOUT_ENV)))
+	{
+		spec.timeout_ms = strtoul(val, NULL, 10);
+	}
+	if (NULL != (val = getenv(WD_PROBE_INTERVAL_ENV)))
+	{
+		spec.interval = strtoul(val, NULL, 10);
+	}
+	if (NULL != (val = getenv(WD_PROBE_SEND_ENV)))
+	{
+		request = CopyBytes(val, strlen(val));
+		spec.request = request;
+		spec.request_len = NULL != request ? Unescape(request) : 0;
+	}
+	if (NULL != (val = getenv(WD_PROBE_EXPECT_ENV)))
+	{
+		expect = CopyBytes(val, strlen(val));
+		if (NULL != expect)
+		{
+			Unescape(expect);
+		}
+		spec.expect = expect;
+	}
+
+	probes = WdProbeCreate();
+	status = NULL == probes || WdProbeAttach(probes, wd, &spec);
+	free(request);
+	free(expect);
+	if (status)
+	{
+		if (NULL != probes)
+		{
+			WdProbeDestroy(probes);
+		}
+		return (NULL);
+	}
+
+	return (probes);
+}
+
+int WdProbeTSK(void* args)
+{
+	wd_probe_ty* probes = (wd_probe_ty*) args;
+	uint64_t now = 0;
+	size_t i;
+
+	if (0 == probes->n_probes)
+	{
+		return (1);
+	}
+
+	WdProbePump(probes);
+
+	/* one time for the whole pass, or probes late in a long pass would
+	 * keep missing their start by a few microseconds */
+	now = WdClockNow(probes->probes[0]->wd->clock);
+	for (i = 0; i < probes->n_probes; ++i)
+	{
+		wd_probe_one_ty* probe = probes->probes[i];
+		wd_ty* wd = probe->wd;
+
+		if (PROBE_IDLE != probe->state && now >= probe->deadline_ns)
+		{
+			Finish(probe, 0, 1);
+		}
+		if (PROBE_IDLE != probe->state)
+		{
+			continue;
+		}
+
+		/* a new instance starts with a clean record */
+		if (probe->pid != wd->target_pid)
+		{
+			probe->pid = wd->target_pid;
+			probe->fails = 0;
+		}
+
+		/* a starting peer is not expected to serve yet */
+		if (wd->is_target_ready && now >= probe->next_ns)
+		{
+			Start(probe, now);
+		}
+	}
+
+	/* loopback connects and small replies often complete at once */
+	WdProbePump(probes);
+
+	return (1);
+}
+
+int WdProbePump(wd_probe_ty* probes)
+{
+	struct epoll_event events[WD_PROBE_EVENTS];
+	int n_done = 0;
+	int n = 0;
+	int i;
+
+	do
+	{
+		n = epoll_wait(probes->epfd, events, WD_PROBE_EVENTS, 0);
+		for (i = 0; i < n; ++i)
+		{
+			n_done += Advance((wd_probe_one_ty*) events[i].data.ptr,
+			                  events[i].events);
+		}
+	}
+	while (WD_PROBE_EVENTS == n);
+
+	return (n_done);
+}
+
+int WdProbeGetFd(const wd_probe_ty* probes)
+{
+	return (probes->epfd);
+}
+
+void WdProbeGetStats(const wd_probe_ty* probes, wd_probe_stats_ty* stats)
+{
+	*stats = probes->stats;
+}
+
+static void Start(wd_probe_one_ty* probe, uint64_t now)
+{
+	wd_probe_stats_ty* stats = &probe->set->stats;
+
+	probe->next_ns = now + probe->interval_ns;
+	probe->deadline_ns = now + probe->timeout_ns;
+	probe->sent = 0;
+	probe->received = 0;
+	++stats->started;
+	if (++stats->in_flight > stats->max_in_flight)
+	{
+		stats->max_in_flight = stats->in_flight;
+	}
+
+	probe->fd = socket(probe->addr.ss_family,
+	                   SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (probe->fd < 0)
+	{
+		probe->state = PROBE_CONNECTING;
+		Finish(probe, 0, 0);
+		return;
+	}
+
+	if (connect(probe->fd, (struct sockaddr*) &probe->addr, probe->addr_len))
+	{
+		/* a full Unix listen backlog says EAGAIN: the service is not keeping
+		 * up, which is what the probe is for */
+		probe->state = PROBE_CONNECTING;
+		if (EINPROGRESS != errno || Watch(probe, EPOLL_CTL_ADD, EPOLLOUT))
+		{
+			Finish(probe, 0, 0);
+		}
+		return;
+	}
+
+	probe->state = PROBE_SENDING;
+	if (Watch(probe, EPOLL_CTL_ADD, EPOLLOUT))
+	{
+		Finish(probe, 0, 0);
+	}
+}
+
+/* Returns 1 if the probe completed. */
+static int Advance(wd_probe_one_ty* probe, uint32_t events)
+{
+	int error = 0;
+	socklen_t len = sizeof(error);
+	ssize_t got = 0;
+
+	if (PROBE_CONNECTING == probe->state)
+	{
+		if (getsockopt(probe->fd, SOL_SOCKET, SO_ERROR, &error, &len) ||
+		    0 != error)
+		{
+			Finish(probe, 0, 0);
+			return (1);
+		}
+		probe->state = PROBE_SENDING;
+	}
+
+	if (PROBE_SENDING == probe->state)
+	{
+		while (probe->sent < probe->request_len)
+		{
+			got = send(probe->fd, probe->request + probe->sent,
+			           probe->request_len - probe->sent, MSG_NOSIGNAL);
+			if (got < 0)
+			{
+				if (EAGAIN == errno || EINTR == errno)
+				{
+					return (0);
+				}
+				Finish(probe, 0, 0);
+				return (1);
+			}
+			probe->sent += (size_t) got;
+		}
+
+		if (0 == probe->request_len && 0 == probe->expect_len)
+		{
+			Finish(probe, 1, 0);
+			return (1);
+		}
+		probe->state = PROBE_RECEIVING;
+		if (Watch(probe, EPOLL_CTL_MOD, EPOLLIN))
+		{
+			Finish(probe, 0, 0);
+			return (1);
+		}
+		return (0);
+	}
+
+	/* PROBE_RECEIVING */
+	do
+	{
+		got = recv(probe->fd, probe->reply + probe->received,
+		           WD_PROBE_REPLY_MAX - probe->received, 0);
+		if (got > 0)
+		{
+			probe->received += (size_t) got;
+		}
+	}
+	while (got > 0 && probe->received < probe->expect_len);
+
+	if (probe->received > 0 && probe->received >= probe->expect_len)
+	{
+		Finish(probe, 0 == memcmp(probe->reply, probe->expect,
+		                          probe->expect_len), 0);
+		return (1);
+	}
+	if (0 == got || (got < 0 && EAGAIN != errno && EINTR != errno) ||
+	    (events & (EPOLLERR | EPOLLHUP)))
+	{
+		Finish(probe, 0, 0);
+		return (1);
+	}
+
+	return (0);
+}
+
+static int Watch(wd_probe_one_ty* probe, int op, uint32_t events)
+{
+	struct epoll_event event;
+
+	event.events = events;
+	event.data.ptr = probe;
+
+	return (epoll_ctl(probe->set->epfd, op, probe->fd, &event));
+}
+
+static void Finish(wd_probe_one_ty* probe, int is_ok, int is_timeout)
+{
+	wd_probe_stats_ty* stats = &probe->set->stats;
+	wd_ty* wd = probe->wd;
+
+	if (probe->fd >= 0)
+	{
+		close(probe->fd);
+		probe->fd = -1;
+	}
+	probe->state = PROBE_IDLE;
+	--stats->in_flight;
+
+	if (is_ok)
+	{
+		++stats->succeeded;
+		/* undo this probe's share; missed heartbeats stay counted */
+		if (probe->fails)
+		{
+			WD_TRACE_I("probe restored", probe->fails);
+			wd->fails -= probe->fails < wd->fails ? probe->fails : wd->fails;
+			wd->probe_fails -= probe->fails < wd->probe_fails ?
+			                   probe->fails : wd->probe_fails;
+			probe->fails = 0;
+		}
+		return;
+	}
+
+	if (is_timeout)
+	{
+		++stats->timed_out;
+	}
+	else
+	{
+		++stats->failed;
+	}
+	++probe->fails;
+	++wd->probe_fails;
+	++wd->fails;
+	WD_TRACE_I(is_timeout ? "probe timed out" : "probe failed", wd->fails);
+}
+
+static int ParseEndpoint(wd_probe_one_ty* probe, const char* endpoint)
+{
+	struct sockaddr_un* un = (struct sockaddr_un*) &probe->addr;
+	struct sockaddr_in* in = (struct sockaddr_in*) &probe->addr;
+	char ip[INET_ADDRSTRLEN];
+	const char* colon = NULL;
+	size_t len = 0;
+
+	memset(&probe->addr, 0, sizeof(probe->addr));
+
+	if (0 == strncmp(endpoint, "unix:", 5))
+	{
+		len = strlen(endpoint + 5);
+		if (0 == len || len >= sizeof(un->sun_path))
+		{
+			return (1);
+		}
+		un->sun_family = AF_UNIX;
+		memcpy(un->sun_path, endpoint + 5, len);
+		probe->addr_len = sizeof(*un);
+		return (0);
+	}
+
+	if (0 == strncmp(endpoint, "tcp:", 4) &&
+	    NULL != (colon = strrchr(endpoint + 4, ':')) &&
+	    (len = (size_t) (colon - (endpoint + 4))) < sizeof(ip))
+	{
+		memcpy(ip, endpoint + 4, len);
+		ip[len] = '\0';
+		in->sin_family = AF_INET;
+		in->sin_port = htons((unsigned short) strtoul(colon + 1, NULL, 10));
+		probe->addr_len = sizeof(*in);
+		return (1 != inet_pton(AF_INET, ip, &in->sin_addr));
+	}
+
+	return (1);
+}
+
+/* Copies `len` bytes, NUL-terminated; a NULL source yields "". */
+static char* CopyBytes(const char* src, size_t len)
+{
+	char* copy = (char*) malloc(len + 1);
+
+	if (NULL != copy)
+	{
+		if (len)
+		{
+			memcpy(copy, src, len);
+		}
+		copy[len] = '\0';
+	}
+
+	return (copy);
+}
+
+/* Replaces \n, \r, \t and \\ in place; returns the new length. */
+static size_t Unescape(char* str)
+{
+	char* out = str;
+	const char* in = str;
+
+	while ('\0' != *in)
+	{
+		if ('\\' == in[0] && '\0' != in[1])
+		{
+			++in;
+			*out++ = 'n' == *in ? '\n' : 'r' == *in ? '\r' :
+			         't' == *in ? '\t' : *in;
+			++in;
+			continue;
+		}
+		*out++ = *in++;
+	}
+	*out = '\0';
+
+	return ((size_t) (out - str));
+}
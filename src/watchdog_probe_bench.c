@@ -0,0 +1,352 @@
+/**
+ * @file watchdog_probe_bench.c
+ * @brief Runs thousands of concurrent application probes on one scheduler.
+ *
+ * An in-process server answers "PING\n" with "PONG\n" on a Unix socket or
+ * a loopback TCP port. N watchdogs on one shared scheduler each probe it
+ * once a second through a single probe set; their only failure input is
+ * the probes. Halfway through the server wedges (it keeps accepting but
+ * stops replying) and every watchdog must detect it, while the scheduler
+ * keeps ticking on time.
+ *
+ * Usage:
+ *      ./watchdog_probe_bench [-n probes] [-t tcp|unix] [-m timeout_ms]
+ *                             [-d duration_s]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>          /* using printf         */
+#include <stdlib.h>         /* using calloc         */
+#include <string.h>         /* using strcmp         */
+#include <errno.h>          /* using errno          */
+#include <unistd.h>         /* using getopt         */
+#include <pthread.h>        /* using pthread_create */
+#include <sys/epoll.h>      /* using epoll_wait     */
+#include <sys/socket.h>     /* using accept4        */
+#include <sys/un.h>         /* using sockaddr_un    */
+#include <sys/resource.h>   /* using setrlimit      */
+#include <netinet/in.h>     /* using sockaddr_in    */
+
+#include "scheduler.h"
+#include "watchdog_utils.h"
+#include "watchdog_probe.h"
+
+#define BENCH_ENDPOINT_MAX  (128)
+
+static int      NoSignal        (wd_ty* wd, int sig_num);
+static int      NoPoll          (wd_ty* wd);
+static int      Listen          (int is_tcp, char* endpoint);
+static void*    ServerThread    (void* args);
+static int      TimedProbeTSK   (void* args);
+static int      WedgeTSK        (void* args);
+static int      StopTSK         (void* args);
+static int      PeerLostTSK     (void* args);
+static void     RaiseFdLimit    (void);
+
+static const wd_sol_ops_ty g_no_sol_ops = {NoSignal, NoPoll, NULL};
+
+static scheduler_ty*    g_scheduler = NULL;
+static wd_probe_ty*     g_probes = NULL;
+static int              g_listen_fd = -1;
+static volatile int     g_is_wedged = 0;
+static volatile int     g_is_stopped = 0;
+static unsigned long    g_lost_before = 0;
+static unsigned long    g_lost_after = 0;
+static uint64_t         g_last_tick_ns = 0;
+static uint64_t         g_max_gap_ns = 0;
+static uint64_t         g_max_task_ns = 0;
+static char*            g_args[] = {"probe_bench", "1", "3", NULL};
+
+int main(int argc, char* argv[])
+{
+	char endpoint[BENCH_ENDPOINT_MAX];
+	wd_probe_spec_ty spec;
+	wd_probe_stats_ty stats;
+	pthread_t server;
+	wd_ty** wds = NULL;
+	unsigned long duration_s = 20;
+	size_t n_probes = 1000;
+	int is_tcp = 0;
+	size_t i;
+	int opt;
+
+	memset(&spec, 0, sizeof(spec));
+	spec.request = "PING\n";
+	spec.request_len = 5;
+	spec.expect = "PONG";
+	spec.timeout_ms = 500;
+	spec.interval = 1;
+
+	while (-1 != (opt = getopt(argc, argv, "n:t:m:d:")))
+	{
+		switch (opt)
+		{
+			case 'n': n_probes = strtoul(optarg, NULL, 10); break;
+			case 't': is_tcp = (0 == strcmp(optarg, "tcp")); break;
+			case 'm': spec.timeout_ms = strtoul(optarg, NULL, 10); break;
+			case 'd': duration_s = strtoul(optarg, NULL, 10); break;
+			default:
+				fprintf(stderr, "usage: %s [-n probes] [-t tcp|unix] "
+				        "[-m timeout_ms] [-d duration_s]\n", argv[0]);
+				return (1);
+		}
+	}
+
+	RaiseFdLimit();
+	g_listen_fd = Listen(is_tcp, endpoint);
+	g_scheduler = SchedCreate();
+	g_probes = WdProbeCreate();
+	wds = (wd_ty**) calloc(n_probes, sizeof(wd_ty*));
+	if (g_listen_fd < 0 || NULL == g_scheduler || NULL == g_probes ||
+	    NULL == wds || pthread_create(&server, NULL, ServerThread, NULL))
+	{
+		printf("setup failed\n");
+		return (1);
+	}
+	spec.endpoint = endpoint;
+
+	for (i = 0; i < n_probes; ++i)
+	{
+		wds[i] = WdCreateShared(g_args, g_scheduler);
+		if (NULL == wds[i])
+		{
+			return (1);
+		}
+		wds[i]->sol_ops = &g_no_sol_ops;
+		wds[i]->target_pid = (pid_t) (i + 1);
+		wds[i]->revive_task = PeerLostTSK;
+		if (WdProbeAttach(g_probes, wds[i], &spec))
+		{
+			return (1);
+		}
+		WdAddTask(wds[i], ReviveIfErrorTSK, 1);
+	}
+
+	SchedAddTask(g_scheduler, TimedProbeTSK, DoNothingTSK, NULL, NULL, 1);
+	SchedAddTask(g_scheduler, WedgeTSK, DoNothingTSK, NULL, NULL,
+	             duration_s / 2);
+	SchedAddTask(g_scheduler, StopTSK, DoNothingTSK, NULL, NULL, duration_s);
+
+	SchedRun(g_scheduler);
+	g_is_stopped = 1;
+	pthread_join(server, NULL);
+
+	WdProbeGetStats(g_probes, &stats);
+	printf("%lu probes over %s, timeout %lu ms\n", (unsigned long) n_probes,
+	       endpoint, spec.timeout_ms);
+	printf("started %lu, succeeded %lu, failed %lu, timed out %lu, "
+	       "max in flight %lu\n", stats.started, stats.succeeded,
+	       stats.failed, stats.timed_out, stats.max_in_flight);
+	printf("detected %lu of %lu wedged, %lu false positives before\n",
+	       g_lost_after, (unsigned long) n_probes, g_lost_before);
+	printf("scheduler: longest probe task %.2f ms, longest tick gap %.2f ms\n",
+	       (double) g_max_task_ns / 1e6, (double) g_max_gap_ns / 1e6);
+
+	SchedDestroy(g_scheduler);
+	for (i = 0; i < n_probes; ++i)
+	{
+		WdDestroy(wds[i]);
+	}
+	free(wds);
+	WdProbeDestroy(g_probes);
+	if (!is_tcp)
+	{
+		unlink(endpoint + 5);
+	}
+
+	return (n_probes == g_lost_after && 0 == g_lost_before ? 0 : 1);
+}
+
+static int NoSignal(wd_ty* wd, int sig_num)
+{
+	(void) wd;
+	(void) sig_num;
+
+	return (0);
+}
+
+static int NoPoll(wd_ty* wd)
+{
+	(void) wd;
+
+	return (0);
+}
+
+/* Listens on a fresh Unix socket or loopback port; fills `endpoint`. */
+static int Listen(int is_tcp, char* endpoint)
+{
+	struct sockaddr_un un;
+	struct sockaddr_in in;
+	socklen_t len = sizeof(in);
+	int fd = socket(is_tcp ? AF_INET : AF_UNIX,
+	                SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+	if (fd < 0)
+	{
+		printf("socket() failed\n");
+		return (-1);
+	}
+
+	if (is_tcp)
+	{
+		memset(&in, 0, sizeof(in));
+		in.sin_family = AF_INET;
+		in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (bind(fd, (struct sockaddr*) &in, sizeof(in)) ||
+		    getsockname(fd, (struct sockaddr*) &in, &len))
+		{
+			printf("bind() failed\n");
+			close(fd);
+			return (-1);
+		}
+		sprintf(endpoint, "tcp:127.0.0.1:%u", ntohs(in.sin_port));
+	}
+	else
+	{
+		memset(&un, 0, sizeof(un));
+		un.sun_family = AF_UNIX;
+		sprintf(un.sun_path, "/tmp/wd_probe_bench.%d.sock", (int) getpid());
+		unlink(un.sun_path);
+		if (bind(fd, (struct sockaddr*) &un, sizeof(un)))
+		{
+			printf("bind() failed\n");
+			close(fd);
+			return (-1);
+		}
+		sprintf(endpoint, "unix:%s", un.sun_path);
+	}
+
+	if (listen(fd, SOMAXCONN))
+	{
+		printf("listen() failed\n");
+		close(fd);
+		return (-1);
+	}
+
+	return (fd);
+}
+
+/* Answers every request line with "PONG\n" until wedged, then only reads. */
+static void* ServerThread(void* args)
+{
+	struct epoll_event events[256];
+	struct epoll_event event;
+	char buf[64];
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+	int n = 0;
+	int i;
+	(void) args;
+
+	event.events = EPOLLIN;
+	event.data.fd = g_listen_fd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, g_listen_fd, &event);
+
+	while (!g_is_stopped)
+	{
+		n = epoll_wait(epfd, events, 256, 100);
+		for (i = 0; i < n; ++i)
+		{
+			int fd = events[i].data.fd;
+			ssize_t got = 0;
+
+			if (fd == g_listen_fd)
+			{
+				while ((fd = accept4(g_listen_fd, NULL, NULL,
+				                     SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+				{
+					event.events = EPOLLIN;
+					event.data.fd = fd;
+					epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+				}
+				continue;
+			}
+
+			got = read(fd, buf, sizeof(buf));
+			if (got <= 0)
+			{
+				if (0 == got || EAGAIN != errno)
+				{
+					close(fd);
+				}
+				continue;
+			}
+			if (!g_is_wedged && 5 != write(fd, "PONG\n", 5))
+			{
+				close(fd);
+			}
+		}
+	}
+
+	close(epfd);
+
+	return (NULL);
+}
+
+static int TimedProbeTSK(void* args)
+{
+	uint64_t start = WdClockNow(WdClockReal());
+	uint64_t end = 0;
+	(void) args;
+
+	WdProbeTSK(g_probes);
+	end = WdClockNow(WdClockReal());
+
+	if (end - start > g_max_task_ns)
+	{
+		g_max_task_ns = end - start;
+	}
+	if (0 != g_last_tick_ns && start - g_last_tick_ns > g_max_gap_ns)
+	{
+		g_max_gap_ns = start - g_last_tick_ns;
+	}
+	g_last_tick_ns = start;
+
+	return (1);
+}
+
+static int WedgeTSK(void* args)
+{
+	(void) args;
+
+	g_is_wedged = 1;
+
+	return (0);
+}
+
+static int StopTSK(void* args)
+{
+	(void) args;
+
+	SchedStop(g_scheduler);
+
+	return (0);
+}
+
+static int PeerLostTSK(void* args)
+{
+	(void) args;
+
+	if (g_is_wedged)
+	{
+		++g_lost_after;
+	}
+	else
+	{
+		++g_lost_before;
+	}
+
+	return (0);
+}
+
+/* Every probe in flight holds a socket, and the server holds the other end. */
+static void RaiseFdLimit(void)
+{
+	struct rlimit limit;
+
+	if (0 == getrlimit(RLIMIT_NOFILE, &limit))
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+}
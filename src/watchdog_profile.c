@@ -0,0 +1,309 @@
+/**
+ * @file watchdog_profile.c
+ * @brief Per-phase revive timestamps, carried across exec and folded into
+ *        the shared pair state.
+ *
+ * `WD_REVIVE` holds four fixed-width decimal fields (detected, kill sent,
+ * exit confirmed, spawned), so the forked child can fill in "spawned"
+ * without allocating.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>         /* using getenv, unsetenv   */
+#include <stdio.h>          /* using sprintf, sscanf    */
+#include <string.h>         /* using memset, strlen     */
+#include <errno.h>          /* using errno              */
+#include <poll.h>           /* using poll               */
+#include <unistd.h>         /* using syscall, close     */
+#include <sys/wait.h>       /* using waitpid            */
+#include <sys/syscall.h>    /* using SYS_pidfd_open     */
+
+#include "watchdog_profile.h"
+#include "watchdog_utils.h"
+#include "watchdog_state.h"
+#include "watchdog_trace.h"
+#include "watchdog_capture.h"
+
+#define WD_PROFILE_FIELD    (20)    /* digits of a uint64_t */
+#define WD_PROFILE_FIELDS   (WD_PHASE_SPAWNED + 1)
+#define WD_PROFILE_LEN      (WD_PROFILE_FIELDS * (WD_PROFILE_FIELD + 1))
+
+#define LOAD(p)         __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE(p, v)     __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static void     CaptureExec (void) __attribute__((constructor));
+static uint64_t Now         (void);
+static void     PutField    (char* field, uint64_t val);
+static void     SortNs      (uint64_t* vals, size_t n);
+
+/* this instance's own revive record */
+static uint64_t g_self[WD_PHASES];
+
+void WdProfileMark(struct wd* wd, wd_phase_ty phase)
+{
+	if (phase < WD_PHASE_SPAWNED)
+	{
+		wd->revive_ns[phase] = Now();
+	}
+}
+
+void WdProfileMarkSelf(wd_phase_ty phase)
+{
+	if (0 == g_self[phase])
+	{
+		g_self[phase] = Now();
+	}
+}
+
+int WdProfileCheckExit(struct wd* wd)
+{
+	struct pollfd pfd;
+	int status = 0;
+
+	if (wd->target_pid <= 0)
+	{
+		return (1);
+	}
+
+	pfd.fd = (int) syscall(SYS_pidfd_open, wd->target_pid, 0);
+	if (pfd.fd < 0)
+	{
+		if (ESRCH != errno)
+		{
+			return (1);
+		}
+		status = 1;
+	}
+	else
+	{
+		pfd.events = POLLIN;
+		status = poll(&pfd, 1, 0);
+		close(pfd.fd);
+	}
+
+	if (1 != status)
+	{
+		return (1);
+	}
+
+	/* not our child (the client is the watchdog process' parent): ECHILD */
+	waitpid(wd->target_pid, NULL, WNOHANG);
+	WD_TRACE_I("exit confirmed", wd->target_pid);
+	WdProfileMark(wd, WD_PHASE_EXIT_CONFIRMED);
+
+	return (0);
+}
+
+void WdProfileExport(struct wd* wd)
+{
+	char val[WD_PROFILE_LEN];
+	int i;
+
+	if (0 == wd->revive_ns[WD_PHASE_DETECTED])
+	{
+		return;
+	}
+
+	/* the kill was sent a dispatch ago: the peer has had time to go */
+	if (0 != wd->revive_ns[WD_PHASE_KILL_SENT] &&
+	    0 == wd->revive_ns[WD_PHASE_EXIT_CONFIRMED] &&
+	    0 != WdProfileCheckExit(wd))
+	{
+		WdCaptureDiag("target %d did not exit in time\n", (int) wd->target_pid);
+	}
+
+	for (i = 0; i < WD_PROFILE_FIELDS; ++i)
+	{
+		PutField(val + i * (WD_PROFILE_FIELD + 1),
+		         i < WD_PHASE_SPAWNED ? wd->revive_ns[i] : 0);
+		val[i * (WD_PROFILE_FIELD + 1) + WD_PROFILE_FIELD] = ',';
+	}
+	val[WD_PROFILE_LEN - 1] = '\0';
+
+	WdSetChildEnv(wd, WD_PROFILE_ENV, val);
+}
+
+void WdProfileUnexport(struct wd* wd)
+{
+	WdUnsetChildEnv(wd, WD_PROFILE_ENV);
+	memset(wd->revive_ns, 0, sizeof(wd->revive_ns));
+}
+
+void WdProfileStampChild(struct wd* wd)
+{
+	char* val = WdGetChildEnv(wd, WD_PROFILE_ENV);
+
+	if (NULL != val && WD_PROFILE_LEN - 1 == strlen(val))
+	{
+		PutField(val + WD_PHASE_SPAWNED * (WD_PROFILE_FIELD + 1), Now());
+	}
+}
+
+void WdProfilePublish(struct wd* wd)
+{
+	wd_profile_ty* profile = NULL;
+	int i;
+
+	if (NULL == wd->state || 0 == g_self[WD_PHASE_DETECTED])
+	{
+		return;
+	}
+
+	/* the watcher reads `cur` only once the generation is ours */
+	profile = &wd->state->roles[wd->role].profile;
+	STORE(&profile->generation, (uint32_t) 0);
+	for (i = 0; i < WD_PHASES; ++i)
+	{
+		STORE(&profile->cur[i], g_self[i]);
+	}
+	STORE(&profile->generation, wd->generation);
+}
+
+void WdProfileHeartbeat(struct wd* wd)
+{
+	wd_profile_ty* profile = NULL;
+	uint64_t* durations = NULL;
+	uint64_t now = 0;
+	uint64_t prev = 0;
+	uint64_t ts = 0;
+	int i;
+
+	if (NULL == wd->state)
+	{
+		return;
+	}
+
+	profile = &wd->state->roles[WD_ROLES - 1 - wd->role].profile;
+	if (LOAD(&profile->generation) != wd->target_generation ||
+	    0 == LOAD(&profile->cur[WD_PHASE_DETECTED]) ||
+	    0 != LOAD(&profile->cur[WD_PHASE_FIRST_HEARTBEAT]))
+	{
+		return;
+	}
+
+	now = Now();
+	STORE(&profile->cur[WD_PHASE_FIRST_HEARTBEAT], now);
+
+	/* each phase gets the time since the last phase that was reached */
+	durations = profile->ring[profile->revives % WD_PROFILE_RING];
+	prev = LOAD(&profile->cur[WD_PHASE_DETECTED]);
+	STORE(&durations[WD_PHASE_DETECTED], now - prev);
+	for (i = WD_PHASE_DETECTED + 1; i < WD_PHASES; ++i)
+	{
+		ts = LOAD(&profile->cur[i]);
+		if (0 == ts || ts < prev)
+		{
+			STORE(&durations[i], (uint64_t) WD_PROFILE_SKIPPED);
+			continue;
+		}
+		STORE(&durations[i], ts - prev);
+		prev = ts;
+	}
+	__atomic_add_fetch(&profile->revives, 1, __ATOMIC_ACQ_REL);
+
+	WD_TRACE_I("revive profiled",
+	           (long) (durations[WD_PHASE_DETECTED] / 1000000u));
+}
+
+void WdProfileSummarize(const wd_profile_ty* profile,
+                        wd_profile_summary_ty summary[WD_PHASES])
+{
+	uint64_t vals[WD_PROFILE_RING];
+	uint32_t revives = LOAD(&profile->revives);
+	size_t n_slots = revives < WD_PROFILE_RING ? revives : WD_PROFILE_RING;
+	size_t last = (revives + WD_PROFILE_RING - 1) % WD_PROFILE_RING;
+	int i;
+
+	memset(summary, 0, WD_PHASES * sizeof(*summary));
+	for (i = 0; i < WD_PHASES; ++i)
+	{
+		uint64_t sum = 0;
+		size_t n = 0;
+		size_t k;
+
+		for (k = 0; k < n_slots; ++k)
+		{
+			uint64_t ns = LOAD(&profile->ring[k][i]);
+
+			if (WD_PROFILE_SKIPPED != ns)
+			{
+				vals[n++] = ns;
+				sum += ns;
+			}
+		}
+		if (0 == n)
+		{
+			continue;
+		}
+
+		SortNs(vals, n);
+		summary[i].count = (unsigned long) n;
+		summary[i].last_ns = LOAD(&profile->ring[last][i]);
+		if (WD_PROFILE_SKIPPED == summary[i].last_ns)
+		{
+			summary[i].last_ns = 0;
+		}
+		summary[i].p50_ns = vals[n / 2];
+		summary[i].mean_ns = sum / n;
+		summary[i].max_ns = vals[n - 1];
+	}
+}
+
+/* Takes over the reviver's timestamps as soon as the new image is loaded. */
+static void CaptureExec(void)
+{
+	const char* val = getenv(WD_PROFILE_ENV);
+	unsigned long long ts[WD_PROFILE_FIELDS];
+	int i;
+
+	if (NULL == val)
+	{
+		return;
+	}
+
+	if (WD_PROFILE_FIELDS == sscanf(val, "%llu,%llu,%llu,%llu",
+	                                &ts[0], &ts[1], &ts[2], &ts[3]))
+	{
+		for (i = 0; i < WD_PROFILE_FIELDS; ++i)
+		{
+			g_self[i] = (uint64_t) ts[i];
+		}
+		g_self[WD_PHASE_EXEC_DONE] = Now();
+	}
+	unsetenv(WD_PROFILE_ENV);
+}
+
+static uint64_t Now(void)
+{
+	return (WdClockNow(WdClockReal()));
+}
+
+/* Zero-padded decimal, exactly WD_PROFILE_FIELD digits, no terminator. */
+static void PutField(char* field, uint64_t val)
+{
+	int i;
+
+	for (i = WD_PROFILE_FIELD - 1; i >= 0; --i)
+	{
+		field[i] = (char) ('0' + val % 10);
+		val /= 10;
+	}
+}
+
+static void SortNs(uint64_t* vals, size_t n)
+{
+	size_t i;
+	size_t j;
+
+	for (i = 1; i < n; ++i)
+	{
+		uint64_t val = vals[i];
+
+		for (j = i; j > 0 && vals[j - 1] > val; --j)
+		{
+			vals[j] = vals[j - 1];
+		}
+		vals[j] = val;
+	}
+}
@@ -0,0 +1,134 @@
+/**
+ * @file watchdog_profile_dump.c
+ * @brief Prints the per-phase revive timings of client/watchdog pairs.
+ *
+ * For each role, each phase shows the time from the previous phase over the
+ * last revives (last, median, mean, max, in ms) and its share of the mean
+ * total, so the phase worth optimizing stands out. Can run while the pair
+ * runs; without arguments, prints every block found in /dev/shm.
+ *
+ * Usage:
+ *      ./watchdog_profile_dump [/wd_state.<pid> ...]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>      /* using printf     */
+#include <string.h>     /* using strncmp    */
+#include <dirent.h>     /* using opendir    */
+
+#include "watchdog_state.h"
+#include "watchdog_profile.h"
+
+#define DUMP_NAME_MAX   (288)
+
+static int      Dump    (const char* name);
+static void     DumpRole(const char* role_name, const wd_profile_ty* profile);
+static double   Ms      (uint64_t ns);
+
+static const char* g_role_names[WD_ROLES] = {"client", "watchdog"};
+static const char* g_phase_names[WD_PHASES] =
+{
+	"total", "kill sent", "exit confirmed", "spawned", "exec done",
+	"main entered", "ready", "first heartbeat"
+};
+
+int main(int argc, char* argv[])
+{
+	char name[DUMP_NAME_MAX];
+	struct dirent* entry = NULL;
+	DIR* dir = NULL;
+	int status = 0;
+	int i;
+
+	for (i = 1; i < argc; ++i)
+	{
+		status |= Dump(argv[i]);
+	}
+	if (argc > 1)
+	{
+		return (status);
+	}
+
+	dir = opendir("/dev/shm");
+	if (NULL == dir)
+	{
+		printf("opendir() failed\n");
+		return (1);
+	}
+	while (NULL != (entry = readdir(dir)))
+	{
+		if (0 == strncmp(entry->d_name, "wd_state.", 9))
+		{
+			sprintf(name, "/%.255s", entry->d_name);
+			status |= Dump(name);
+		}
+	}
+	closedir(dir);
+
+	return (status);
+}
+
+static int Dump(const char* name)
+{
+	const wd_state_ty* state = WdStateOpenByName(name);
+	int r;
+
+	if (NULL == state)
+	{
+		printf("%s: no state block\n", name);
+		return (1);
+	}
+
+	printf("%s\n", name);
+	for (r = 0; r < WD_ROLES; ++r)
+	{
+		DumpRole(g_role_names[r], &state->roles[r].profile);
+	}
+
+	WdStateClose(state);
+
+	return (0);
+}
+
+static void DumpRole(const char* role_name, const wd_profile_ty* profile)
+{
+	wd_profile_summary_ty summary[WD_PHASES];
+	double total = 0.0;
+	int i;
+
+	WdProfileSummarize(profile, summary);
+	printf("  %s: %u revives profiled\n", role_name,
+	       (unsigned int) profile->revives);
+	if (0 == summary[WD_PHASE_DETECTED].count)
+	{
+		return;
+	}
+
+	total = Ms(summary[WD_PHASE_DETECTED].mean_ns);
+	printf("    %-16s %10s %10s %10s %10s %6s\n", "phase (ms)", "last",
+	       "p50", "mean", "max", "share");
+	for (i = WD_PHASE_DETECTED + 1; i < WD_PHASES; ++i)
+	{
+		if (0 == summary[i].count)
+		{
+			printf("    %-16s %10s\n", g_phase_names[i], "-");
+			continue;
+		}
+		printf("    %-16s %10.3f %10.3f %10.3f %10.3f %5.1f%%\n",
+		       g_phase_names[i], Ms(summary[i].last_ns),
+		       Ms(summary[i].p50_ns), Ms(summary[i].mean_ns),
+		       Ms(summary[i].max_ns),
+		       total > 0.0 ? 100.0 * Ms(summary[i].mean_ns) / total : 0.0);
+	}
+	printf("    %-16s %10.3f %10.3f %10.3f %10.3f\n",
+	       g_phase_names[WD_PHASE_DETECTED],
+	       Ms(summary[WD_PHASE_DETECTED].last_ns),
+	       Ms(summary[WD_PHASE_DETECTED].p50_ns), total,
+	       Ms(summary[WD_PHASE_DETECTED].max_ns));
+}
+
+static double Ms(uint64_t ns)
+{
+	return ((double) ns / 1000000.0);
+}
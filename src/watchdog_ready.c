@@ -0,0 +1,268 @@
+/**
+ * @file watchdog_ready.c
+ * @brief Readiness reports over an inherited pipe or the heartbeat channel.
+ *
+ * The pipe carries the peer's own CLOCK_MONOTONIC time of readiness, so
+ * the recorded time-to-ready is exact however rarely the watcher polls.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>     /* using getenv, unsetenv */
+#include <stdio.h>      /* using printf         */
+#include <errno.h>      /* using errno          */
+#include <fcntl.h>      /* using pipe2, fcntl   */
+#include <unistd.h>     /* using read, write    */
+
+#include "watchdog_ready.h"
+#include "watchdog_state.h"
+#include "watchdog_trace.h"
+#include "watchdog_profile.h"
+#include "watchdog_capture.h"
+
+static void TakeNotifyFd (void) __attribute__((constructor));
+static void MarkReady   (wd_ty* wd, uint64_t ready_ns);
+static void MarkMissed  (wd_ty* wd);
+static void CloseFd     (wd_ty* wd);
+
+static uint64_t g_ready_ns = 0;
+static int      g_notify_fd = -1;
+
+int WdNotifyReady(void)
+{
+	uint64_t now = WdClockNow(WdClockReal());
+	ssize_t written = 0;
+	int fd = -1;
+
+	if (0 != g_ready_ns)
+	{
+		return (0);
+	}
+	__atomic_store_n(&g_ready_ns, now, __ATOMIC_RELEASE);
+	WdProfileMarkSelf(WD_PHASE_READY);
+
+	fd = __atomic_exchange_n(&g_notify_fd, -1, __ATOMIC_ACQ_REL);
+	if (fd < 0)
+	{
+		return (0);
+	}
+
+	do
+	{
+		written = write(fd, &now, sizeof(now));
+	}
+	while (written < 0 && EINTR == errno);
+	close(fd);
+
+	if ((ssize_t) sizeof(now) != written)
+	{
+		printf("WdNotifyReady write() failed\n");
+		return (1);
+	}
+
+	return (0);
+}
+
+uint64_t WdReadyNs(void)
+{
+	return (__atomic_load_n(&g_ready_ns, __ATOMIC_ACQUIRE));
+}
+
+unsigned long WdStartupDeadline(void)
+{
+	const char* val = getenv(WD_STARTUP_DEADLINE_ENV);
+
+	return ((NULL != val && '\0' != *val) ? strtoul(val, NULL, 10) :
+	        WD_STARTUP_DEADLINE_S);
+}
+
+int WdReadyExport(wd_ty* wd, int fds[2])
+{
+	char fd_str[16];
+
+	/* only the write end crosses exec, and only into the next child: it
+	 * stays CLOEXEC here, the child clears the flag just before exec */
+	if (pipe2(fds, O_CLOEXEC))
+	{
+		WdCaptureDiag("pipe2() failed\n");
+		return (1);
+	}
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+	sprintf(fd_str, "%d", fds[1]);
+	if (NULL == WdSetChildEnv(wd, WD_READY_FD_ENV, fd_str))
+	{
+		close(fds[0]);
+		close(fds[1]);
+		fds[0] = -1;
+		fds[1] = -1;
+		return (1);
+	}
+	wd->child_fd = fds[1];
+
+	return (0);
+}
+
+void WdReadyUnexport(wd_ty* wd, int fds[2])
+{
+	WdUnsetChildEnv(wd, WD_READY_FD_ENV);
+	wd->child_fd = -1;
+	close(fds[1]);
+	fds[1] = -1;
+}
+
+int WdReadyRead(int fd, uint64_t* ready_ns)
+{
+	ssize_t got = read(fd, ready_ns, sizeof(*ready_ns));
+
+	if ((ssize_t) sizeof(*ready_ns) == got)
+	{
+		return (1);
+	}
+	/* any other report (e.g. a shell's "echo R >&$WD_READY_FD") is ready now */
+	if (got > 0)
+	{
+		*ready_ns = WdClockNow(WdClockReal());
+		return (1);
+	}
+
+	return ((0 == got || (got < 0 && EAGAIN != errno && EINTR != errno)) ?
+	        -1 : 0);
+}
+
+void WdSpawnAwaitingReady(wd_ty* wd)
+{
+	int fds[2] = {-1, -1};
+	int has_pipe = 0;
+
+	CloseFd(wd);
+	has_pipe = (0 == WdReadyExport(wd, fds));
+
+	WdSpawnTarget(wd);
+	WdAwaitHeartbeatReady(wd, WdClockNow(wd->clock));
+
+	if (has_pipe)
+	{
+		WdReadyUnexport(wd, fds);
+		wd->ready_fd = fds[0];
+	}
+	wd->is_target_ready = !has_pipe;
+}
+
+void WdAwaitHeartbeatReady(wd_ty* wd, uint64_t started_ns)
+{
+	CloseFd(wd);
+	wd->target_started_ns = started_ns;
+	wd->ready_deadline_ns = WdClockNow(wd->clock) +
+	                        WdStartupDeadline() * WD_NS_PER_SEC;
+	wd->is_target_ready = 0;
+}
+
+int WdPollReady(wd_ty* wd, int is_heartbeat)
+{
+	uint64_t ready_ns = 0;
+	int status = 0;
+
+	if (wd->is_target_ready)
+	{
+		return (1);
+	}
+
+	/* a missed deadline stands until the target is revived */
+	if (0 == wd->ready_deadline_ns)
+	{
+		return (-1);
+	}
+
+	if (wd->ready_fd >= 0)
+	{
+		status = WdReadyRead(wd->ready_fd, &ready_ns);
+		if (status > 0)
+		{
+			MarkReady(wd, ready_ns);
+			return (1);
+		}
+		if (status < 0)
+		{
+			/* the target died before reporting */
+			MarkMissed(wd);
+			return (-1);
+		}
+	}
+	else
+	{
+		/* the peer publishes its readiness in the state block, if any */
+		ready_ns = NULL != wd->state ? WdStateGetTargetReadyAt(wd) : 0;
+		if (ready_ns < wd->target_started_ns)
+		{
+			ready_ns = is_heartbeat ? WdClockNow(wd->clock) : 0;
+		}
+		if (0 != ready_ns)
+		{
+			MarkReady(wd, ready_ns);
+			return (1);
+		}
+	}
+
+	if (WdClockNow(wd->clock) >= wd->ready_deadline_ns)
+	{
+		MarkMissed(wd);
+		return (-1);
+	}
+
+	return (0);
+}
+
+/* Runs before main, so before any thread that could read or change the
+ * environment: the variable is only meant for this process, and the fd must
+ * not leak into the processes it spawns, or the pipe would outlive it. */
+static void TakeNotifyFd(void)
+{
+	const char* val = getenv(WD_READY_FD_ENV);
+
+	if (NULL == val || '\0' == *val)
+	{
+		return;
+	}
+
+	g_notify_fd = atoi(val);
+	unsetenv(WD_READY_FD_ENV);
+	fcntl(g_notify_fd, F_SETFD, FD_CLOEXEC);
+}
+
+static void MarkReady(wd_ty* wd, uint64_t ready_ns)
+{
+	uint64_t time_to_ready_ns = ready_ns > wd->target_started_ns ?
+	                            ready_ns - wd->target_started_ns : 0;
+
+	CloseFd(wd);
+	wd->is_target_ready = 1;
+	WD_TRACE_I("ready", (long) (time_to_ready_ns / 1000000u));
+
+	if (NULL != wd->state)
+	{
+		WdStateSaveStartup(wd, time_to_ready_ns, 1);
+	}
+}
+
+static void MarkMissed(wd_ty* wd)
+{
+	CloseFd(wd);
+	wd->ready_deadline_ns = 0;
+	WD_TRACE_I("startup deadline missed", wd->target_pid);
+	WdCaptureDiag("target %d missed its startup deadline\n", (int) wd->target_pid);
+
+	if (NULL != wd->state)
+	{
+		WdStateSaveStartup(wd, 0, 0);
+	}
+}
+
+static void CloseFd(wd_ty* wd)
+{
+	if (wd->ready_fd >= 0)
+	{
+		close(wd->ready_fd);
+		wd->ready_fd = -1;
+	}
+}
@@ -0,0 +1,426 @@
+/**
+ * @file watchdog_sim.c
+ * @brief Deterministic virtual-time simulation of the watchdog detector.
+ *
+ * Runs the real `SendSolTSK`, `CheckSolTSK` and `ReviveIfErrorTSK` tasks
+ * against a simulated peer on a virtual clock, and sweeps a grid of
+ * detector configurations (task intervals and `max_fails`). The peer
+ * follows a scripted fault pattern: heartbeat loss, reply delay and
+ * jitter, random crashes and periodic stalls (e.g. GC pauses).
+ *
+ * For every configuration one CSV line is printed with:
+ *  - crashes:  number of injected crashes
+ *  - detected: crashes followed by a revive
+ *  - missed:   crashes never detected before the end of the run
+ *  - false_pos: revives of a peer that had not crashed
+ *  - lat_mean_s / lat_max_s: time from crash to kill
+ *
+ * Usage:
+ *      ./watchdog_sim [-d duration_s] [-s seed] [-l loss] [-D delay_s]
+ *                     [-j jitter_s] [-m mtbf_s] [-S stall_every_s]
+ *                     [-L stall_len_s] [-u startup_s] > sweep.csv
+ *
+ * Without `-l`, loss rates of 0, 1%, 5% and 20% are swept as well.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>      /* using printf             */
+#include <stdlib.h>     /* using strtod             */
+#include <string.h>     /* using memset             */
+#include <signal.h>     /* using SIGUSR1, SIGKILL   */
+#include <unistd.h>     /* using getopt             */
+#include <math.h>       /* using log                */
+
+#include "watchdog_utils.h"
+#include "watchdog_clock.h"
+
+#define SIM_MAX_REPLIES (64)
+
+enum sim_peer_state {PEER_UP, PEER_CRASHED, PEER_KILLED};
+
+typedef struct sim_script
+{
+	double          duration_s;     /* virtual run length per config */
+	double          loss;           /* chance a ping or its reply is lost */
+	double          delay_s;        /* base reply delay */
+	double          jitter_s;       /* extra uniform reply delay */
+	double          mtbf_s;         /* mean time between crashes, 0: never */
+	double          stall_every_s;  /* stall period, 0: never */
+	double          stall_len_s;    /* stall length */
+	double          startup_s;      /* revive to first reply */
+	uint64_t        seed;
+} sim_script_ty;
+
+typedef struct sim_config
+{
+	unsigned long   send_interval;
+	unsigned long   check_interval;
+	unsigned long   revive_interval;
+	unsigned long   max_fails;
+} sim_config_ty;
+
+typedef struct sim_peer
+{
+	const sim_script_ty*    script;
+	const sim_config_ty*    config;
+	uint64_t                rng;
+	int                     state;
+	uint64_t                ready_ns;       /* answers from this time on */
+	uint64_t                crash_ns;       /* next injected crash */
+	uint64_t                down_ns;        /* time of the last crash */
+	uint64_t                replies[SIM_MAX_REPLIES];
+	size_t                  n_replies;
+
+	unsigned long           crashes;
+	unsigned long           detected;
+	unsigned long           false_pos;
+	double                  lat_sum_s;
+	double                  lat_max_s;
+} sim_peer_ty;
+
+static void     SimConfig   (const sim_script_ty* script,
+                             const sim_config_ty* config);
+static void     SimRun      (wd_ty* wd, sim_peer_ty* peer, uint64_t end_ns);
+static int      SimSignal   (wd_ty* wd, int sig_num);
+static int      SimPoll     (wd_ty* wd);
+static int      SimReviveTSK(void* args);
+static void     SimAddTasks (wd_ty* wd, const sim_config_ty* config);
+static void     SimPlanCrash(sim_peer_ty* peer, uint64_t from_ns);
+static uint64_t SimStallEnd (const sim_peer_ty* peer, uint64_t now_ns);
+static double   SimRandom   (sim_peer_ty* peer);
+static uint64_t Ns          (double seconds);
+
+static const wd_sol_ops_ty g_sim_sol_ops = {SimSignal, SimPoll, NULL};
+
+static const unsigned long g_send[]   = {1, 2, 5, 10};
+static const unsigned long g_check[]  = {1, 2, 4, 5};
+static const unsigned long g_revive[] = {1, 5, 10};
+static const unsigned long g_fails[]  = {1, 2, 3, 4, 6, 8};
+static const double        g_loss[]   = {0.0, 0.01, 0.05, 0.2};
+
+#define ARR_LEN(arr) (sizeof(arr) / sizeof(*(arr)))
+
+int main(int argc, char* argv[])
+{
+	sim_script_ty script;
+	sim_config_ty config;
+	int sweep_loss = 1;
+	size_t n_loss = 0;
+	size_t a, b, c, d, l;
+	int opt;
+
+	script.duration_s = 3600;
+	script.loss = 0;
+	script.delay_s = 0.001;
+	script.jitter_s = 0.01;
+	script.mtbf_s = 600;
+	script.stall_every_s = 0;
+	script.stall_len_s = 0;
+	script.startup_s = 0.5;
+	script.seed = 1;
+
+	while (-1 != (opt = getopt(argc, argv, "d:s:l:D:j:m:S:L:u:")))
+	{
+		switch (opt)
+		{
+			case 'd': script.duration_s = strtod(optarg, NULL); break;
+			case 's': script.seed = strtoul(optarg, NULL, 10); break;
+			case 'l': script.loss = strtod(optarg, NULL); sweep_loss = 0; break;
+			case 'D': script.delay_s = strtod(optarg, NULL); break;
+			case 'j': script.jitter_s = strtod(optarg, NULL); break;
+			case 'm': script.mtbf_s = strtod(optarg, NULL); break;
+			case 'S': script.stall_every_s = strtod(optarg, NULL); break;
+			case 'L': script.stall_len_s = strtod(optarg, NULL); break;
+			case 'u': script.startup_s = strtod(optarg, NULL); break;
+			default:
+				fprintf(stderr, "usage: %s [-d duration_s] [-s seed] [-l loss]"
+				        " [-D delay_s] [-j jitter_s] [-m mtbf_s]"
+				        " [-S stall_every_s] [-L stall_len_s] [-u startup_s]\n",
+				        argv[0]);
+				return (1);
+		}
+	}
+
+	n_loss = sweep_loss ? ARR_LEN(g_loss) : 1;
+
+	printf("send_s,check_s,revive_s,max_fails,loss,crashes,detected,missed,"
+	       "false_pos,lat_mean_s,lat_max_s\n");
+
+	for (l = 0; l < n_loss; ++l)
+	{
+		if (sweep_loss)
+		{
+			script.loss = g_loss[l];
+		}
+		for (a = 0; a < ARR_LEN(g_send); ++a)
+		for (b = 0; b < ARR_LEN(g_check); ++b)
+		for (c = 0; c < ARR_LEN(g_revive); ++c)
+		for (d = 0; d < ARR_LEN(g_fails); ++d)
+		{
+			config.send_interval = g_send[a];
+			config.check_interval = g_check[b];
+			config.revive_interval = g_revive[c];
+			config.max_fails = g_fails[d];
+			SimConfig(&script, &config);
+		}
+	}
+
+	return (0);
+}
+
+static void SimConfig(const sim_script_ty* script, const sim_config_ty* config)
+{
+	char interval[32];
+	char max_fails[32];
+	char* args[4];
+	wd_clock_ty clock;
+	sim_peer_ty peer;
+	wd_ty* wd = NULL;
+
+	sprintf(interval, "%lu", config->send_interval);
+	sprintf(max_fails, "%lu", config->max_fails);
+	args[0] = "watchdog_sim";
+	args[1] = interval;
+	args[2] = max_fails;
+	args[3] = NULL;
+
+	wd = WdCreate(args);
+	if (NULL == wd)
+	{
+		return;
+	}
+
+	memset(&peer, 0, sizeof(peer));
+	peer.script = script;
+	peer.config = config;
+	peer.rng = script->seed * 0x9E3779B97F4A7C15ull + 1;
+	peer.state = PEER_UP;
+	SimPlanCrash(&peer, 0);
+
+	WdClockInitVirtual(&clock, 0);
+	wd->clock = &clock;
+	wd->sol_ops = &g_sim_sol_ops;
+	wd->sol_ctx = &peer;
+	wd->revive_task = SimReviveTSK;
+	SimAddTasks(wd, config);
+
+	SimRun(wd, &peer, Ns(script->duration_s));
+
+	printf("%lu,%lu,%lu,%lu,%g,%lu,%lu,%lu,%lu,%.3f,%.3f\n",
+	       config->send_interval, config->check_interval,
+	       config->revive_interval, config->max_fails, script->loss,
+	       peer.crashes, peer.detected, peer.crashes - peer.detected,
+	       peer.false_pos,
+	       peer.detected ? peer.lat_sum_s / peer.detected : 0.0,
+	       peer.lat_max_s);
+
+	WdDestroy(wd);
+}
+
+/* Virtual-time stand-in for SchedRun over the watchdog's task slots. */
+static void SimRun(wd_ty* wd, sim_peer_ty* peer, uint64_t end_ns)
+{
+	uint64_t next_ns[WD_MAX_TASKS];
+	size_t seen_seq[WD_MAX_TASKS];
+	size_t i;
+
+	memset(seen_seq, 0, sizeof(seen_seq));
+
+	for (;;)
+	{
+		uint64_t now = WdClockNow(wd->clock);
+		uint64_t event_ns = end_ns;
+		size_t next = WD_MAX_TASKS;
+		size_t seq = 0;
+
+		for (i = 0; i < WD_MAX_TASKS; ++i)
+		{
+			wd_task_ty* slot = &wd->tasks[i];
+
+			if (NULL == slot->task)
+			{
+				continue;
+			}
+			if (seen_seq[i] != slot->seq)
+			{
+				seen_seq[i] = slot->seq;
+				next_ns[i] = now + slot->interval * WD_NS_PER_SEC;
+			}
+			if (WD_MAX_TASKS == next || next_ns[i] < next_ns[next] ||
+			    (next_ns[i] == next_ns[next] &&
+			     slot->seq < wd->tasks[next].seq))
+			{
+				next = i;
+			}
+		}
+
+		if (WD_MAX_TASKS != next)
+		{
+			event_ns = next_ns[next];
+		}
+
+		if (PEER_UP == peer->state && peer->crash_ns <= event_ns &&
+		    peer->crash_ns < end_ns)
+		{
+			WdClockSleep(wd->clock, peer->crash_ns - now);
+			peer->state = PEER_CRASHED;
+			peer->down_ns = peer->crash_ns;
+			peer->n_replies = 0;
+			++peer->crashes;
+			continue;
+		}
+
+		if (event_ns >= end_ns)
+		{
+			break;
+		}
+
+		WdClockSleep(wd->clock, event_ns - now);
+		seq = wd->tasks[next].seq;
+		WdDispatchTSK(&wd->tasks[next]);
+
+		if (NULL != wd->tasks[next].task && seq == wd->tasks[next].seq)
+		{
+			next_ns[next] += wd->tasks[next].interval * WD_NS_PER_SEC;
+		}
+	}
+}
+
+static int SimSignal(wd_ty* wd, int sig_num)
+{
+	sim_peer_ty* peer = (sim_peer_ty*) wd->sol_ctx;
+	uint64_t now = WdClockNow(wd->clock);
+	uint64_t reply_ns = 0;
+
+	if (SIGKILL == sig_num)
+	{
+		if (PEER_CRASHED == peer->state)
+		{
+			double latency = (double) (now - peer->down_ns) / WD_NS_PER_SEC;
+
+			++peer->detected;
+			peer->lat_sum_s += latency;
+			if (latency > peer->lat_max_s)
+			{
+				peer->lat_max_s = latency;
+			}
+		}
+		else if (PEER_UP == peer->state)
+		{
+			++peer->false_pos;
+		}
+		peer->state = PEER_KILLED;
+		peer->n_replies = 0;
+
+		return (0);
+	}
+
+	if (PEER_UP != peer->state || SimRandom(peer) < peer->script->loss ||
+	    SIM_MAX_REPLIES == peer->n_replies)
+	{
+		return (0);
+	}
+
+	/* a starting or stalled peer answers once it runs again */
+	reply_ns = now > peer->ready_ns ? now : peer->ready_ns;
+	reply_ns = SimStallEnd(peer, reply_ns);
+	reply_ns += Ns(peer->script->delay_s +
+	               peer->script->jitter_s * SimRandom(peer));
+
+	/* a crash before the reply is sent swallows it */
+	if (reply_ns < peer->crash_ns)
+	{
+		peer->replies[peer->n_replies++] = reply_ns;
+	}
+
+	return (0);
+}
+
+static int SimPoll(wd_ty* wd)
+{
+	sim_peer_ty* peer = (sim_peer_ty*) wd->sol_ctx;
+	uint64_t now = WdClockNow(wd->clock);
+	int is_received = 0;
+	size_t i = 0;
+
+	while (i < peer->n_replies)
+	{
+		if (peer->replies[i] <= now)
+		{
+			peer->replies[i] = peer->replies[--peer->n_replies];
+			is_received = 1;
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	return (is_received);
+}
+
+/* Simulated counterpart of SpawnTargetTSK. */
+static int SimReviveTSK(void* args)
+{
+	wd_ty* wd = (wd_ty*) args;
+	sim_peer_ty* peer = (sim_peer_ty*) wd->sol_ctx;
+	uint64_t now = WdClockNow(wd->clock);
+
+	peer->state = PEER_UP;
+	peer->ready_ns = now + Ns(peer->script->startup_s);
+	SimPlanCrash(peer, peer->ready_ns);
+	wd->fails = 0;
+	SimAddTasks(wd, peer->config);
+
+	return (0);
+}
+
+static void SimAddTasks(wd_ty* wd, const sim_config_ty* config)
+{
+	WdAddTask(wd, SendSolTSK, config->send_interval);
+	WdAddTask(wd, CheckSolTSK, config->check_interval);
+	WdAddTask(wd, ReviveIfErrorTSK, config->revive_interval);
+}
+
+static void SimPlanCrash(sim_peer_ty* peer, uint64_t from_ns)
+{
+	if (peer->script->mtbf_s <= 0)
+	{
+		peer->crash_ns = (uint64_t) -1;
+		return;
+	}
+
+	/* exponential inter-crash times */
+	peer->crash_ns = from_ns +
+	                 Ns(-log(1.0 - SimRandom(peer)) * peer->script->mtbf_s);
+}
+
+static uint64_t SimStallEnd(const sim_peer_ty* peer, uint64_t now_ns)
+{
+	uint64_t every = Ns(peer->script->stall_every_s);
+	uint64_t len = Ns(peer->script->stall_len_s);
+
+	if (0 == every || 0 == len || now_ns % every >= len)
+	{
+		return (now_ns);
+	}
+
+	return (now_ns - now_ns % every + len);
+}
+
+/* xorshift64*: deterministic for a given seed */
+static double SimRandom(sim_peer_ty* peer)
+{
+	peer->rng ^= peer->rng >> 12;
+	peer->rng ^= peer->rng << 25;
+	peer->rng ^= peer->rng >> 27;
+
+	return ((double) ((peer->rng * 0x2545F4914F6CDD1Dull) >> 11) /
+	        (double) (1ull << 53));
+}
+
+static uint64_t Ns(double seconds)
+{
+	return ((uint64_t) (seconds * WD_NS_PER_SEC));
+}
@@ -0,0 +1,308 @@
+/**
+ * @file watchdog_state.c
+ * @brief Generation- and lease-based state block shared by a client/watchdog pair.
+ *
+ * Every field is read and written with atomic builtins, since the two
+ * processes (and, in the client, the watchdog thread and the app) access
+ * the block concurrently. Only the generation needs a compare-and-swap;
+ * the other fields belong to the current holder of a role or to its peer.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>         /* using getenv, setenv */
+#include <stdio.h>          /* using sprintf        */
+#include <string.h>         /* using memset         */
+#include <fcntl.h>          /* using O_RDWR         */
+#include <unistd.h>         /* using ftruncate      */
+#include <sys/mman.h>       /* using shm_open, mmap */
+#include <sys/stat.h>       /* using fstat          */
+
+#include "watchdog_state.h"
+#include "watchdog_trace.h"
+
+#define WD_STATE_NAME_MAX   (64)
+
+#define LOAD(p)         __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE(p, v)     __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static wd_state_role_ty*    Own     (const wd_ty* wd);
+static wd_state_role_ty*    Target  (const wd_ty* wd);
+static void                 Follow  (wd_ty* wd);
+
+wd_state_ty* WdStateOpen(int may_create)
+{
+	char name[WD_STATE_NAME_MAX];
+	const char* env = getenv(WD_STATE_ENV);
+	wd_state_ty* state = NULL;
+	struct stat st;
+	int fd = -1;
+
+	if (NULL == env || '\0' == *env)
+	{
+		if (!may_create)
+		{
+			return (NULL);
+		}
+		sprintf(name, "/wd_state.%d", (int) getpid());
+		setenv(WD_STATE_ENV, name, 1);
+		env = name;
+	}
+
+	fd = shm_open(env, O_RDWR | O_CREAT, 0600);
+	if (fd < 0)
+	{
+		printf("state shm_open() failed\n");
+		return (NULL);
+	}
+
+	/* the creator sizes the block; a racing opener waits for the size */
+	if (fstat(fd, &st) || ((size_t) st.st_size < sizeof(wd_state_ty) &&
+	                       ftruncate(fd, sizeof(wd_state_ty))))
+	{
+		printf("state ftruncate() failed\n");
+		close(fd);
+		return (NULL);
+	}
+
+	state = (wd_state_ty*) mmap(NULL, sizeof(wd_state_ty),
+	                            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == state)
+	{
+		printf("state mmap() failed\n");
+		return (NULL);
+	}
+
+	if (WD_STATE_MAGIC != LOAD(&state->magic) ||
+	    WD_STATE_VERSION != state->version)
+	{
+		memset(state->roles, 0, sizeof(state->roles));
+		/* the first client runs already; generation 0 was never started */
+		state->roles[WD_ROLE_CLIENT].generation = 1;
+		state->version = WD_STATE_VERSION;
+		state->created_ns = WdClockNow(WdClockReal());
+		STORE(&state->magic, WD_STATE_MAGIC);
+	}
+
+	return (state);
+}
+
+const wd_state_ty* WdStateOpenByName(const char* name)
+{
+	const wd_state_ty* state = NULL;
+	int fd = shm_open(name, O_RDONLY, 0);
+
+	if (fd < 0)
+	{
+		return (NULL);
+	}
+
+	state = (const wd_state_ty*) mmap(NULL, sizeof(wd_state_ty), PROT_READ,
+	                                  MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == state)
+	{
+		return (NULL);
+	}
+
+	if (WD_STATE_MAGIC != LOAD(&state->magic))
+	{
+		WdStateClose(state);
+		return (NULL);
+	}
+
+	return (state);
+}
+
+void WdStateClose(const wd_state_ty* state)
+{
+	munmap((void*) state, sizeof(wd_state_ty));
+}
+
+void WdStateRemove(void)
+{
+	const char* env = getenv(WD_STATE_ENV);
+
+	if (NULL != env && '\0' != *env)
+	{
+		shm_unlink(env);
+	}
+}
+
+void WdStateAttach(wd_ty* wd, wd_state_ty* state, int role)
+{
+	wd_state_role_ty* own = NULL;
+	wd_state_role_ty* target = NULL;
+	uint64_t fails = 0;
+
+	wd->state = state;
+	wd->role = role;
+	own = Own(wd);
+	target = Target(wd);
+
+	wd->generation = LOAD(&own->generation);
+	STORE(&own->pid, (int32_t) getpid());
+	STORE(&own->lease_ns, WdClockNow(wd->clock) + WD_STATE_LEASE_NS);
+
+	/* the peer may have been watched by our previous instance */
+	Follow(wd);
+	fails = LOAD(&target->fails);
+	if (fails < wd->max_fails)
+	{
+		wd->fails = (unsigned long) fails;
+	}
+
+	WD_TRACE_I("state attached", wd->generation);
+}
+
+int WdStateBeginRevive(wd_ty* wd)
+{
+	wd_state_role_ty* target = Target(wd);
+	uint32_t seen = wd->target_generation;
+
+	if (!__atomic_compare_exchange_n(&target->generation, &seen, seen + 1, 0,
+	                                 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{
+		WD_TRACE_I("revive lost", seen);
+		Follow(wd);
+		return (1);
+	}
+
+	wd->target_generation = seen + 1;
+	wd->fails = 0;
+	STORE(&target->pid, (int32_t) 0);
+	STORE(&target->lease_ns, (uint64_t) 0);
+	STORE(&target->fails, (uint64_t) 0);
+	STORE(&target->last_revive_ns, WdClockNow(wd->clock));
+	STORE(&target->ready_at_ns, (uint64_t) 0);
+	STORE(&target->time_to_ready_ns, (uint64_t) 0);
+	if (0 != seen)
+	{
+		__atomic_add_fetch(&target->revives, 1, __ATOMIC_ACQ_REL);
+	}
+
+	return (0);
+}
+
+int WdStateIsSuperseded(const wd_ty* wd)
+{
+	return (LOAD(&Own(wd)->generation) != wd->generation);
+}
+
+int WdStateIsTargetLeased(const wd_ty* wd)
+{
+	const wd_state_role_ty* target = Target(wd);
+
+	return (LOAD(&target->generation) == wd->target_generation &&
+	        LOAD(&target->lease_ns) > WdClockNow(wd->clock));
+}
+
+int WdStateFollowTarget(wd_ty* wd)
+{
+	if (LOAD(&Target(wd)->generation) == wd->target_generation)
+	{
+		return (0);
+	}
+
+	Follow(wd);
+
+	return (1);
+}
+
+void WdStateSaveFails(wd_ty* wd, int is_heartbeat)
+{
+	wd_state_role_ty* target = Target(wd);
+
+	if (LOAD(&target->generation) != wd->target_generation)
+	{
+		return;
+	}
+
+	STORE(&target->fails, (uint64_t) wd->fails);
+	if (is_heartbeat)
+	{
+		STORE(&target->last_heartbeat_ns, WdClockNow(wd->clock));
+	}
+}
+
+void WdStateSetReadyAt(wd_ty* wd, uint64_t ready_ns)
+{
+	STORE(&Own(wd)->ready_at_ns, ready_ns);
+}
+
+uint64_t WdStateGetTargetReadyAt(const wd_ty* wd)
+{
+	const wd_state_role_ty* target = Target(wd);
+
+	return (LOAD(&target->generation) == wd->target_generation ?
+	        LOAD(&target->ready_at_ns) : 0);
+}
+
+uint64_t WdStateGetTargetStartedNs(const wd_ty* wd)
+{
+	return (LOAD(&Target(wd)->last_revive_ns));
+}
+
+void WdStateSaveStartup(wd_ty* wd, uint64_t time_to_ready_ns, int is_ready)
+{
+	wd_state_role_ty* target = Target(wd);
+
+	if (!is_ready)
+	{
+		__atomic_add_fetch(&target->deadline_misses, 1, __ATOMIC_ACQ_REL);
+		return;
+	}
+
+	STORE(&target->time_to_ready_ns, time_to_ready_ns);
+	if (time_to_ready_ns > LOAD(&target->max_time_to_ready_ns))
+	{
+		STORE(&target->max_time_to_ready_ns, time_to_ready_ns);
+	}
+	__atomic_add_fetch(&target->total_time_to_ready_ns, time_to_ready_ns,
+	                   __ATOMIC_ACQ_REL);
+	__atomic_add_fetch(&target->readies, 1, __ATOMIC_ACQ_REL);
+}
+
+int WdStateLeaseTSK(void* args)
+{
+	wd_ty* wd = (wd_ty*) args;
+
+	if (WdStateIsSuperseded(wd))
+	{
+		/* a newer instance of our role runs; there must be only one */
+		printf("superseded by generation %u, exiting\n",
+		       (unsigned int) LOAD(&Own(wd)->generation));
+		WD_TRACE_I("superseded", wd->generation);
+		fflush(stdout);
+		_exit(EXIT_FAILURE);
+	}
+
+	STORE(&Own(wd)->lease_ns, WdClockNow(wd->clock) + WD_STATE_LEASE_NS);
+
+	return (1);
+}
+
+static wd_state_role_ty* Own(const wd_ty* wd)
+{
+	return (&wd->state->roles[wd->role]);
+}
+
+static wd_state_role_ty* Target(const wd_ty* wd)
+{
+	return (&wd->state->roles[WD_ROLES - 1 - wd->role]);
+}
+
+/* Adopts the peer's current generation and, once known, its pid. */
+static void Follow(wd_ty* wd)
+{
+	wd_state_role_ty* target = Target(wd);
+	pid_t pid = (pid_t) LOAD(&target->pid);
+
+	wd->target_generation = LOAD(&target->generation);
+	if (pid > 0)
+	{
+		wd->target_pid = pid;
+	}
+	wd->fails = 0;
+}
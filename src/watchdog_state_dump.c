@@ -0,0 +1,112 @@
+/**
+ * @file watchdog_state_dump.c
+ * @brief Prints the shared state blocks of client/watchdog pairs.
+ *
+ * Without arguments, prints every block found in /dev/shm. Times that
+ * never happened print as -1.
+ *
+ * Usage:
+ *      ./watchdog_state_dump [/wd_state.<pid> ...]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>      /* using printf     */
+#include <string.h>     /* using strncmp    */
+#include <dirent.h>     /* using opendir    */
+
+#include "watchdog_state.h"
+
+#define DUMP_NAME_MAX   (288)
+
+static int      Dump    (const char* name);
+static double   Ago     (uint64_t now, uint64_t then_ns);
+static double   Sec     (uint64_t ns);
+
+static const char* g_role_names[WD_ROLES] = {"client", "watchdog"};
+
+int main(int argc, char* argv[])
+{
+	char name[DUMP_NAME_MAX];
+	struct dirent* entry = NULL;
+	DIR* dir = NULL;
+	int status = 0;
+	int i;
+
+	for (i = 1; i < argc; ++i)
+	{
+		status |= Dump(argv[i]);
+	}
+	if (argc > 1)
+	{
+		return (status);
+	}
+
+	dir = opendir("/dev/shm");
+	if (NULL == dir)
+	{
+		printf("opendir() failed\n");
+		return (1);
+	}
+	while (NULL != (entry = readdir(dir)))
+	{
+		if (0 == strncmp(entry->d_name, "wd_state.", 9))
+		{
+			sprintf(name, "/%.255s", entry->d_name);
+			status |= Dump(name);
+		}
+	}
+	closedir(dir);
+
+	return (status);
+}
+
+static int Dump(const char* name)
+{
+	const wd_state_ty* state = WdStateOpenByName(name);
+	uint64_t now = WdClockNow(WdClockReal());
+	int r;
+
+	if (NULL == state)
+	{
+		printf("%s: no state block\n", name);
+		return (1);
+	}
+
+	printf("%s (age %.1f s)\n", name,
+	       (double) (now - state->created_ns) / WD_NS_PER_SEC);
+	for (r = 0; r < WD_ROLES; ++r)
+	{
+		const wd_state_role_ty* role = &state->roles[r];
+
+		printf("  %-8s gen %-4u pid %-7d lease %-8s fails %-3lu revives %-4lu "
+		       "revived %.1f s ago, heartbeat %.1f s ago\n",
+		       g_role_names[r], (unsigned int) role->generation,
+		       (int) role->pid, role->lease_ns > now ? "live" : "expired",
+		       (unsigned long) role->fails, (unsigned long) role->revives,
+		       Ago(now, role->last_revive_ns),
+		       Ago(now, role->last_heartbeat_ns));
+		printf("           ready in %.3f s (mean %.3f s, max %.3f s) "
+		       "readies %-4lu deadline misses %lu\n",
+		       Sec(role->time_to_ready_ns),
+		       0 == role->readies ? 0.0 :
+		       Sec(role->total_time_to_ready_ns) / role->readies,
+		       Sec(role->max_time_to_ready_ns),
+		       (unsigned long) role->readies,
+		       (unsigned long) role->deadline_misses);
+	}
+
+	WdStateClose(state);
+
+	return (0);
+}
+
+static double Ago(uint64_t now, uint64_t then_ns)
+{
+	return (0 == then_ns ? -1.0 : (double) (now - then_ns) / WD_NS_PER_SEC);
+}
+
+static double Sec(uint64_t ns)
+{
+	return ((double) ns / WD_NS_PER_SEC);
+}
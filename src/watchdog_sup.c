@@ -0,0 +1,280 @@
+/**
+ * @file watchdog_sup.c
+ * @brief Supervisor process started from a declarative process graph file.
+ *
+ * Each non-empty, non-comment line of the graph declares one child:
+ *
+ *      # name    depends_on    ready     command
+ *      db        -             ready     ./db_server --port 5432
+ *      cache     -             ready     ./cache
+ *      api       db,cache      ready     ./api --listen 8080
+ *      metrics   -             noready   ./metrics_agent
+ *
+ * `depends_on` is "-" or a comma-separated list of children declared above.
+ * `ready` means the child calls `WdNotifyReady`; `noready` children count
+ * as ready once spawned. The command runs through `/bin/sh -c exec ...`,
+ * so the child's pid is the command's.
+ *
+ * After the cold start the supervisor prints each child's startup time,
+ * the total cold start time and the sum of all startups, then keeps
+ * supervising until SIGINT/SIGTERM, when it kills every child and exits.
+ * A child restarted more than `-m` times within `-p` seconds is given up
+ * on; if that happens during the cold start, or the cold start takes
+ * longer than `-t` seconds, the supervisor kills every child and exits 1.
+ *
+ * Usage:
+ *      ./watchdog_sup [-s one-for-one|one-for-all|rest-for-one]
+ *                     [-r report_interval_s] [-m max_restarts]
+ *                     [-p period_s] [-t start_timeout_s] graph_file
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>      /* using fopen, fgets       */
+#include <stdlib.h>     /* using malloc, strtoul    */
+#include <string.h>     /* using strcmp, strdup     */
+#include <signal.h>     /* using sigaction          */
+#include <unistd.h>     /* using getopt             */
+
+#include "scheduler.h"
+#include "watchdog_utils.h"
+#include "watchdog_supervisor.h"
+
+#define SUP_MAX_CHILDREN    (256)
+#define SUP_LINE_MAX        (1024)
+
+static int  LoadGraph       (const char* path);
+static int  ParseLine       (char* line, wd_child_spec_ty* spec);
+static int  StopIfAskedTSK  (void* args);
+static int  ReportTSK       (void* args);
+static void StopHandler     (int sig_num);
+static int  Usage           (const char* name);
+
+static wd_child_spec_ty     g_specs[SUP_MAX_CHILDREN];
+static size_t               g_n_specs = 0;
+static scheduler_ty*        g_scheduler = NULL;
+static volatile int         g_is_stop_req = 0;
+
+int main(int argc, char* argv[])
+{
+	wd_sup_strategy_ty strategy = WD_SUP_ONE_FOR_ONE;
+	unsigned long report_s = 0;
+	unsigned long max_restarts = WD_SUP_MAX_RESTARTS;
+	unsigned long period_s = WD_SUP_RESTART_PERIOD_S;
+	unsigned long start_timeout_s = WD_SUP_START_TIMEOUT_S;
+	wd_sup_ty* sup = NULL;
+	struct sigaction sa;
+	uint64_t start_ns = 0;
+	uint64_t sum_ns = 0;
+	size_t i;
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "s:r:m:p:t:")))
+	{
+		switch (opt)
+		{
+			case 's':
+				if (0 == strcmp(optarg, "one-for-all"))
+				{
+					strategy = WD_SUP_ONE_FOR_ALL;
+				}
+				else if (0 == strcmp(optarg, "rest-for-one"))
+				{
+					strategy = WD_SUP_REST_FOR_ONE;
+				}
+				else if (0 != strcmp(optarg, "one-for-one"))
+				{
+					fprintf(stderr, "unknown strategy: %s\n", optarg);
+					return (1);
+				}
+				break;
+			case 'r': report_s = strtoul(optarg, NULL, 10); break;
+			case 'm': max_restarts = strtoul(optarg, NULL, 10); break;
+			case 'p': period_s = strtoul(optarg, NULL, 10); break;
+			case 't': start_timeout_s = strtoul(optarg, NULL, 10); break;
+			default: return (Usage(argv[0]));
+		}
+	}
+	if (optind != argc - 1)
+	{
+		return (Usage(argv[0]));
+	}
+
+	if (LoadGraph(argv[optind]))
+	{
+		return (1);
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = StopHandler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	g_scheduler = SchedCreate();
+	if (NULL == g_scheduler)
+	{
+		printf("SchedCreate failed\n");
+		return (1);
+	}
+	sup = WdSupCreate(g_specs, g_n_specs, strategy, g_scheduler);
+	if (NULL == sup)
+	{
+		SchedDestroy(g_scheduler);
+		return (1);
+	}
+
+	WdSupSetLimits(sup, max_restarts, period_s, start_timeout_s);
+
+	start_ns = WdClockNow(WdClockReal());
+	if (WdSupStart(sup))
+	{
+		WdSupReport(sup);
+		WdSupDestroy(sup);
+		SchedDestroy(g_scheduler);
+		return (1);
+	}
+	WdSupReport(sup);
+	for (i = 0; i < g_n_specs; ++i)
+	{
+		sum_ns += WdSupGetStartupNs(sup, i);
+	}
+	printf("cold start: %.3f s (sum of startups: %.3f s)\n",
+	       (double) (WdClockNow(WdClockReal()) - start_ns) / WD_NS_PER_SEC,
+	       (double) sum_ns / WD_NS_PER_SEC);
+
+	SchedAddTask(g_scheduler, WdSupTickTSK, DoNothingTSK, sup, NULL, 1);
+	SchedAddTask(g_scheduler, StopIfAskedTSK, DoNothingTSK, sup, NULL, 1);
+	if (report_s > 0)
+	{
+		SchedAddTask(g_scheduler, ReportTSK, DoNothingTSK, sup, NULL, report_s);
+	}
+	SchedRun(g_scheduler);
+
+	WdSupDestroy(sup);
+	SchedDestroy(g_scheduler);
+
+	return (0);
+}
+
+static int LoadGraph(const char* path)
+{
+	char line[SUP_LINE_MAX];
+	FILE* file = fopen(path, "r");
+	size_t line_no = 0;
+
+	if (NULL == file)
+	{
+		printf("fopen() failed: %s\n", path);
+		return (1);
+	}
+
+	while (NULL != fgets(line, sizeof(line), file))
+	{
+		char* start = line + strspn(line, " \t");
+
+		++line_no;
+		start[strcspn(start, "\r\n")] = '\0';
+		if ('\0' == *start || '#' == *start)
+		{
+			continue;
+		}
+
+		if (SUP_MAX_CHILDREN == g_n_specs ||
+		    ParseLine(start, &g_specs[g_n_specs]))
+		{
+			printf("%s:%lu: bad child declaration\n", path,
+			       (unsigned long) line_no);
+			fclose(file);
+			return (1);
+		}
+		++g_n_specs;
+	}
+
+	fclose(file);
+
+	return (0);
+}
+
+/* name depends_on ready|noready command... */
+static int ParseLine(char* line, wd_child_spec_ty* spec)
+{
+	char* fields[3];
+	char* command = NULL;
+	char** args = NULL;
+	size_t i;
+
+	for (i = 0; i < 3; ++i)
+	{
+		line += strspn(line, " \t");
+		fields[i] = line;
+		line += strcspn(line, " \t");
+		if ('\0' == *line)
+		{
+			return (1);
+		}
+		*line++ = '\0';
+	}
+	line += strspn(line, " \t");
+	if ('\0' == *line)
+	{
+		return (1);
+	}
+
+	command = (char*) malloc(strlen("exec ") + strlen(line) + 1);
+	args = (char**) malloc(4 * sizeof(char*));
+	if (NULL == command || NULL == args)
+	{
+		printf("malloc failed\n");
+		return (1);
+	}
+	sprintf(command, "exec %s", line);
+	args[0] = "/bin/sh";
+	args[1] = "-c";
+	args[2] = command;
+	args[3] = NULL;
+
+	spec->name = strdup(fields[0]);
+	spec->depends_on = 0 == strcmp(fields[1], "-") ? NULL : strdup(fields[1]);
+	spec->reports_ready = (0 == strcmp(fields[2], "ready"));
+	spec->args = args;
+
+	return (!spec->reports_ready && 0 != strcmp(fields[2], "noready"));
+}
+
+static int StopIfAskedTSK(void* args)
+{
+	wd_sup_ty* sup = (wd_sup_ty*) args;
+
+	if (g_is_stop_req)
+	{
+		WdSupStopAll(sup);
+		SchedStop(g_scheduler);
+
+		return (0);
+	}
+
+	return (1);
+}
+
+static int ReportTSK(void* args)
+{
+	WdSupReport((wd_sup_ty*) args);
+
+	return (1);
+}
+
+static void StopHandler(int sig_num)
+{
+	(void) sig_num;
+
+	g_is_stop_req = 1;
+}
+
+static int Usage(const char* name)
+{
+	fprintf(stderr, "usage: %s [-s one-for-one|one-for-all|rest-for-one] "
+	        "[-r report_interval_s] [-m max_restarts] [-p period_s] "
+	        "[-t start_timeout_s] graph_file\n", name);
+
+	return (1);
+}
@@ -0,0 +1,543 @@
+/**
+ * @file watchdog_supervisor.c
+ * @brief Dependency-ordered startup and restart strategies for a group of processes.
+ *
+ * Each child is a `wd_ty` whose target is the child process, all sharing
+ * the supervisor's scheduler. A child moves WAITING -> STARTING (spawned,
+ * not ready yet) -> READY, and back to WAITING when it exits or is killed
+ * by a restart strategy, or to FAILED for good when it exits too often.
+ * `Advance` spawns every WAITING child whose
+ * dependencies are READY; since dependencies are declared first, one pass
+ * in declaration order starts everything startable. With `WD_CAPTURE`
+ * set, each child's output goes to `<WD_CAPTURE>/<name>.log`.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>     /* using malloc             */
+#include <stdio.h>      /* using printf             */
+#include <string.h>     /* using strcmp, strchr     */
+#include <poll.h>       /* using poll               */
+#include <signal.h>     /* using SIGKILL            */
+#include <unistd.h>     /* using close              */
+#include <sys/wait.h>   /* using waitpid            */
+
+#include "watchdog_supervisor.h"
+#include "watchdog_utils.h"
+#include "watchdog_trace.h"
+#include "watchdog_ready.h"
+#include "watchdog_capture.h"
+
+#define WD_SUP_POLL_MS          (100)
+#define WD_SUP_MIN_RESPAWN_NS   (WD_NS_PER_SEC)     /* crash-loop brake */
+#define WD_SUP_MAX_POLL         (256)
+
+typedef enum wd_sup_state
+{
+	CHILD_WAITING,
+	CHILD_STARTING,
+	CHILD_READY,
+	CHILD_FAILED
+} wd_sup_state_ty;
+
+typedef struct wd_sup_child
+{
+	const wd_child_spec_ty* spec;
+	wd_ty*          wd;
+	size_t          deps[WD_SUP_MAX_DEPS];
+	size_t          n_deps;
+	wd_sup_state_ty state;
+	int             ready_fd;           /* read end while STARTING */
+	uint64_t        spawned_ns;
+	uint64_t        startup_ns;         /* spawn to ready, last start */
+	unsigned long   restarts;
+	uint64_t        restart_ns[WD_SUP_RESTARTS_KEPT]; /* by restart count */
+} wd_sup_child_ty;
+
+struct wd_sup
+{
+	wd_sup_child_ty*    children;
+	size_t              n_children;
+	wd_sup_strategy_ty  strategy;
+	scheduler_ty*       scheduler;
+	wd_capture_ty*      capture;        /* children's output, or NULL */
+	unsigned long       max_restarts;
+	uint64_t            period_ns;
+	uint64_t            start_timeout_ns;
+	const char*         failed;         /* child given up on, or NULL */
+};
+
+static int      ResolveDeps     (wd_sup_ty* sup, size_t i);
+static size_t   Advance         (wd_sup_ty* sup);
+static int      Spawn           (wd_sup_child_ty* child);
+static void     CollectReady    (wd_sup_ty* sup, int timeout_ms);
+static void     ReapExited      (wd_sup_ty* sup);
+static void     Restart         (wd_sup_ty* sup, size_t i);
+static int      IsTooOften      (const wd_sup_ty* sup,
+                                 wd_sup_child_ty* child);
+static const char* FindBlocker  (const wd_sup_ty* sup);
+static void     Kill            (wd_sup_child_ty* child);
+static void     Reset           (wd_sup_child_ty* child);
+static void     MarkReady       (wd_sup_child_ty* child, uint64_t ready_ns);
+
+static char* g_wd_args[] = {"supervisor", "1", "1", NULL};
+
+static const char* g_state_names[] = {"waiting", "starting", "ready",
+                                      "failed"};
+
+wd_sup_ty* WdSupCreate(const wd_child_spec_ty* specs, size_t n,
+                       wd_sup_strategy_ty strategy, scheduler_ty* scheduler)
+{
+	wd_sup_ty* sup = NULL;
+	size_t i;
+
+	sup = (wd_sup_ty*) malloc(sizeof(wd_sup_ty));
+	if (NULL == sup)
+	{
+		printf("malloc failed\n");
+		return (NULL);
+	}
+
+	sup->children = (wd_sup_child_ty*) calloc(n, sizeof(wd_sup_child_ty));
+	if (NULL == sup->children)
+	{
+		printf("malloc failed\n");
+		free(sup);
+		return (NULL);
+	}
+	sup->n_children = n;
+	sup->strategy = strategy;
+	sup->scheduler = scheduler;
+	sup->capture = NULL != getenv(WD_CAPTURE_ENV) ? WdCaptureCreate() : NULL;
+	sup->failed = NULL;
+	WdSupSetLimits(sup, WD_SUP_MAX_RESTARTS, WD_SUP_RESTART_PERIOD_S,
+	               WD_SUP_START_TIMEOUT_S);
+
+	for (i = 0; i < n; ++i)
+	{
+		wd_sup_child_ty* child = &sup->children[i];
+
+		child->spec = &specs[i];
+		child->state = CHILD_WAITING;
+		child->ready_fd = -1;
+		child->wd = WdCreateShared(g_wd_args, scheduler);
+		if (NULL == child->wd || ResolveDeps(sup, i))
+		{
+			sup->n_children = i + (NULL != child->wd);
+			WdSupDestroy(sup);
+			return (NULL);
+		}
+		child->wd->target_args = specs[i].args;
+		if (NULL != sup->capture)
+		{
+			WdCaptureAttach(sup->capture, child->wd, specs[i].name);
+		}
+	}
+
+	return (sup);
+}
+
+void WdSupDestroy(wd_sup_ty* sup)
+{
+	size_t i;
+
+	WdSupStopAll(sup);
+	for (i = 0; i < sup->n_children; ++i)
+	{
+		WdDestroy(sup->children[i].wd);
+	}
+	if (NULL != sup->capture)
+	{
+		WdCaptureDestroy(sup->capture);
+	}
+	free(sup->children);
+	free(sup);
+}
+
+void WdSupSetLimits(wd_sup_ty* sup, unsigned long max_restarts,
+                    unsigned long period_s, unsigned long start_timeout_s)
+{
+	sup->max_restarts = max_restarts < WD_SUP_RESTARTS_KEPT ?
+	                    max_restarts : WD_SUP_RESTARTS_KEPT - 1;
+	sup->period_ns = (uint64_t) period_s * WD_NS_PER_SEC;
+	sup->start_timeout_ns = (uint64_t) start_timeout_s * WD_NS_PER_SEC;
+}
+
+int WdSupStart(wd_sup_ty* sup)
+{
+	uint64_t deadline = WdClockNow(WdClockReal()) + sup->start_timeout_ns;
+
+	while (0 != Advance(sup))
+	{
+		if (NULL != sup->failed)
+		{
+			printf("WdSupStart failed: %s restarted too often\n",
+			       sup->failed);
+			return (1);
+		}
+		if (WdClockNow(WdClockReal()) >= deadline)
+		{
+			sup->failed = FindBlocker(sup);
+			printf("WdSupStart failed: %s not ready in time\n",
+			       sup->failed);
+			return (1);
+		}
+		CollectReady(sup, WD_SUP_POLL_MS);
+		ReapExited(sup);
+	}
+
+	return (WdNotifyReady());
+}
+
+const char* WdSupGetFailed(const wd_sup_ty* sup)
+{
+	return (sup->failed);
+}
+
+int WdSupTickTSK(void* args)
+{
+	wd_sup_ty* sup = (wd_sup_ty*) args;
+
+	ReapExited(sup);
+	CollectReady(sup, 0);
+	Advance(sup);
+
+	return (1);
+}
+
+void WdSupStopAll(wd_sup_ty* sup)
+{
+	size_t i;
+
+	for (i = sup->n_children; i > 0; --i)
+	{
+		Kill(&sup->children[i - 1]);
+	}
+}
+
+void WdSupReport(const wd_sup_ty* sup)
+{
+	size_t i;
+
+	for (i = 0; i < sup->n_children; ++i)
+	{
+		const wd_sup_child_ty* child = &sup->children[i];
+
+		printf("%-16s pid %-7d %-8s restarts %-4lu startup %.3f s\n",
+		       child->spec->name, (int) child->wd->target_pid,
+		       g_state_names[child->state], child->restarts,
+		       (double) child->startup_ns / WD_NS_PER_SEC);
+	}
+}
+
+uint64_t WdSupGetStartupNs(const wd_sup_ty* sup, size_t i)
+{
+	return (sup->children[i].startup_ns);
+}
+
+/* Maps the child's comma-separated dependency names to earlier indexes. */
+static int ResolveDeps(wd_sup_ty* sup, size_t i)
+{
+	wd_sup_child_ty* child = &sup->children[i];
+	const char* name = child->spec->depends_on;
+	size_t j;
+
+	while (NULL != name && '\0' != *name)
+	{
+		const char* end = strchr(name, ',');
+		size_t len = NULL != end ? (size_t) (end - name) : strlen(name);
+
+		for (j = 0; j < i; ++j)
+		{
+			const char* other = sup->children[j].spec->name;
+
+			if (len == strlen(other) && 0 == strncmp(other, name, len))
+			{
+				break;
+			}
+		}
+
+		if (j == i || WD_SUP_MAX_DEPS == child->n_deps)
+		{
+			printf("WdSupCreate failed: bad dependency of %s: %.*s\n",
+			       child->spec->name, (int) len, name);
+			return (1);
+		}
+		child->deps[child->n_deps++] = j;
+
+		name = NULL != end ? end + 1 : NULL;
+	}
+
+	return (0);
+}
+
+/* Spawns every startable child; returns how many children are not ready. */
+static size_t Advance(wd_sup_ty* sup)
+{
+	size_t not_ready = 0;
+	size_t i;
+	size_t d;
+
+	for (i = 0; i < sup->n_children; ++i)
+	{
+		wd_sup_child_ty* child = &sup->children[i];
+
+		if (CHILD_WAITING == child->state)
+		{
+			for (d = 0; d < child->n_deps; ++d)
+			{
+				if (CHILD_READY != sup->children[child->deps[d]].state)
+				{
+					break;
+				}
+			}
+			if (d == child->n_deps)
+			{
+				Spawn(child);
+			}
+		}
+
+		not_ready += (CHILD_READY != child->state);
+	}
+
+	return (not_ready);
+}
+
+static int Spawn(wd_sup_child_ty* child)
+{
+	int fds[2] = {-1, -1};
+	uint64_t now = WdClockNow(child->wd->clock);
+
+	if (0 != child->spawned_ns &&
+	    now - child->spawned_ns < WD_SUP_MIN_RESPAWN_NS)
+	{
+		return (1);
+	}
+
+	if (child->spec->reports_ready && WdReadyExport(child->wd, fds))
+	{
+		return (1);
+	}
+
+	WdSpawnTarget(child->wd);
+	child->spawned_ns = now;
+
+	if (child->spec->reports_ready)
+	{
+		WdReadyUnexport(child->wd, fds);
+	}
+
+	if (child->wd->target_pid <= 0)
+	{
+		if (fds[0] >= 0)
+		{
+			close(fds[0]);
+		}
+		return (1);
+	}
+
+	child->ready_fd = fds[0];
+	child->state = CHILD_STARTING;
+	if (!child->spec->reports_ready)
+	{
+		MarkReady(child, now);
+	}
+
+	return (0);
+}
+
+/* Waits up to timeout_ms for STARTING children to report ready. */
+static void CollectReady(wd_sup_ty* sup, int timeout_ms)
+{
+	struct pollfd pfds[WD_SUP_MAX_POLL];
+	size_t index[WD_SUP_MAX_POLL];
+	nfds_t n = 0;
+	nfds_t k;
+	size_t i;
+	uint64_t ready_ns = 0;
+
+	for (i = 0; i < sup->n_children && n < WD_SUP_MAX_POLL; ++i)
+	{
+		if (CHILD_STARTING == sup->children[i].state &&
+		    sup->children[i].ready_fd >= 0)
+		{
+			pfds[n].fd = sup->children[i].ready_fd;
+			pfds[n].events = POLLIN;
+			pfds[n].revents = 0;
+			index[n++] = i;
+		}
+	}
+
+	/* with nothing starting this still paces WdSupStart's loop */
+	if (poll(pfds, n, timeout_ms) <= 0)
+	{
+		return;
+	}
+
+	for (k = 0; k < n; ++k)
+	{
+		wd_sup_child_ty* child = &sup->children[index[k]];
+
+		if (0 == pfds[k].revents)
+		{
+			continue;
+		}
+
+		if (1 == WdReadyRead(child->ready_fd, &ready_ns))
+		{
+			MarkReady(child, ready_ns);
+		}
+		else
+		{
+			/* closed without reporting: its exit will be reaped */
+			close(child->ready_fd);
+			child->ready_fd = -1;
+		}
+	}
+}
+
+static void ReapExited(wd_sup_ty* sup)
+{
+	size_t i;
+
+	for (i = 0; i < sup->n_children; ++i)
+	{
+		wd_sup_child_ty* child = &sup->children[i];
+
+		if (child->wd->target_pid > 0 &&
+		    child->wd->target_pid == waitpid(child->wd->target_pid, NULL,
+		                                     WNOHANG))
+		{
+			WD_TRACE_I("exit confirmed", child->wd->target_pid);
+			printf("supervisor: %s (pid %d) exited\n", child->spec->name,
+			       (int) child->wd->target_pid);
+			Reset(child);
+			++child->restarts;
+			if (IsTooOften(sup, child))
+			{
+				printf("supervisor: %s restarted too often, giving up\n",
+				       child->spec->name);
+				child->state = CHILD_FAILED;
+				sup->failed = child->spec->name;
+			}
+			Restart(sup, i);
+		}
+	}
+}
+
+/* Applies the strategy to the exit of child i; Advance respawns. */
+static void Restart(wd_sup_ty* sup, size_t i)
+{
+	size_t j;
+
+	switch (sup->strategy)
+	{
+		case WD_SUP_ONE_FOR_ALL:
+			for (j = sup->n_children; j > 0; --j)
+			{
+				Kill(&sup->children[j - 1]);
+			}
+			break;
+
+		case WD_SUP_REST_FOR_ONE:
+			for (j = sup->n_children; j > i + 1; --j)
+			{
+				Kill(&sup->children[j - 1]);
+			}
+			break;
+
+		case WD_SUP_ONE_FOR_ONE:
+		default:
+			break;
+	}
+}
+
+/* Records the restart just counted in the ring of the last restart
+ * times; true if it is one too many within the sliding period. */
+static int IsTooOften(const wd_sup_ty* sup, wd_sup_child_ty* child)
+{
+	uint64_t now = WdClockNow(WdClockReal());
+	unsigned long oldest = 0;
+
+	child->restart_ns[(child->restarts - 1) % WD_SUP_RESTARTS_KEPT] = now;
+	if (child->restarts <= sup->max_restarts)
+	{
+		return (0);
+	}
+
+	/* the restart max_restarts before this one */
+	oldest = child->restarts - 1 - sup->max_restarts;
+
+	return (now - child->restart_ns[oldest % WD_SUP_RESTARTS_KEPT] <
+	        sup->period_ns);
+}
+
+/* The first child holding up the start: one whose own dependencies are
+ * ready, but which is not. */
+static const char* FindBlocker(const wd_sup_ty* sup)
+{
+	size_t i;
+	size_t d;
+
+	for (i = 0; i < sup->n_children; ++i)
+	{
+		const wd_sup_child_ty* child = &sup->children[i];
+
+		if (CHILD_READY == child->state)
+		{
+			continue;
+		}
+		for (d = 0; d < child->n_deps; ++d)
+		{
+			if (CHILD_READY != sup->children[child->deps[d]].state)
+			{
+				break;
+			}
+		}
+		if (d == child->n_deps)
+		{
+			return (child->spec->name);
+		}
+	}
+
+	return (sup->children[0].spec->name);
+}
+
+static void Kill(wd_sup_child_ty* child)
+{
+	/* given up on: no strategy brings it back */
+	if (CHILD_FAILED == child->state)
+	{
+		return;
+	}
+
+	if (child->wd->target_pid > 0)
+	{
+		WdSendSignal(child->wd, SIGKILL);
+		WdWaitPid(child->wd);
+	}
+	Reset(child);
+}
+
+static void Reset(wd_sup_child_ty* child)
+{
+	if (child->ready_fd >= 0)
+	{
+		close(child->ready_fd);
+		child->ready_fd = -1;
+	}
+	child->wd->target_pid = -1;
+	child->state = CHILD_WAITING;
+}
+
+static void MarkReady(wd_sup_child_ty* child, uint64_t ready_ns)
+{
+	if (child->ready_fd >= 0)
+	{
+		close(child->ready_fd);
+		child->ready_fd = -1;
+	}
+	child->startup_ns = ready_ns > child->spawned_ns ?
+	                    ready_ns - child->spawned_ns : 0;
+	child->state = CHILD_READY;
+}
@@ -0,0 +1,221 @@
+/**
+ * @file watchdog_trace.c
+ * @brief Per-thread binary ring buffers for watchdog execution tracing.
+ *
+ * Each thread lazily maps its own ring file `<WD_TRACE>/wd_trace.<pid>.<tid>.bin`
+ * with `MAP_SHARED`. Writing an event is a plain memory store into the
+ * mapping, so no system call is made on the hot path and the data reaches
+ * the page cache even if the process is killed right after.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>     /* using getenv             */
+#include <stdio.h>      /* using sprintf            */
+#include <string.h>     /* using strncpy            */
+#include <time.h>       /* using clock_gettime      */
+#include <fcntl.h>      /* using open               */
+#include <unistd.h>     /* using ftruncate, syscall */
+#include <pthread.h>    /* using pthread_key_t      */
+#include <sys/mman.h>   /* using mmap               */
+#include <sys/stat.h>   /* using fstat              */
+#include <sys/syscall.h>/* using SYS_gettid         */
+
+#include "watchdog_trace.h"
+
+#define WD_TRACE_ENV        "WD_TRACE"
+#define WD_TRACE_PATH_MAX   (512)
+
+typedef struct wd_trace_ring
+{
+	wd_trace_hdr_ty   hdr;
+	wd_trace_event_ty events[WD_TRACE_CAPACITY];
+} wd_trace_ring_ty;
+
+static wd_trace_ring_ty* CreateRing     (void);
+static void              DestroyRing    (void* ring);
+static void              CreateKey      (void);
+static void              ResetInChild   (void);
+
+int g_wd_trace_on = 0;
+
+static const char*      g_trace_dir = NULL;
+static pthread_key_t    g_ring_key;
+static pthread_once_t   g_key_once = PTHREAD_ONCE_INIT;
+
+void WdTraceInit(void)
+{
+	const char* dir = getenv(WD_TRACE_ENV);
+
+	if (g_wd_trace_on || NULL == dir || '\0' == *dir)
+	{
+		return;
+	}
+
+	pthread_once(&g_key_once, CreateKey);
+	g_trace_dir = dir;
+	g_wd_trace_on = 1;
+}
+
+void WdTraceRecord(int phase, const char* name, long arg)
+{
+	wd_trace_ring_ty* ring = NULL;
+	wd_trace_event_ty* event = NULL;
+	struct timespec now;
+	uint64_t seq = 0;
+
+	ring = (wd_trace_ring_ty*) pthread_getspecific(g_ring_key);
+	if (NULL == ring)
+	{
+		ring = CreateRing();
+		if (NULL == ring)
+		{
+			return;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	seq = ring->hdr.head + 1;
+	event = &ring->events[(seq - 1) % WD_TRACE_CAPACITY];
+	/* a reader that sees `seq` unchanged around its copy has a whole event */
+	__atomic_store_n(&event->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	event->ts_ns = (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+	event->arg = arg;
+	event->phase = (uint32_t) phase;
+	strncpy(event->name, name, WD_TRACE_NAME_LEN - 1);
+	event->name[WD_TRACE_NAME_LEN - 1] = '\0';
+	__atomic_store_n(&event->seq, seq, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->hdr.head, seq, __ATOMIC_RELEASE);
+}
+
+uint64_t WdTraceLastEventNs(const char* path, const char* name)
+{
+	const wd_trace_ring_ty* ring = NULL;
+	uint64_t found_ns = 0;
+	uint64_t seq = 0;
+	uint64_t first = 0;
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+	{
+		return (0);
+	}
+
+	if (fstat(fd, &st) || (size_t) st.st_size < sizeof(wd_trace_ring_ty))
+	{
+		close(fd);
+		return (0);
+	}
+
+	ring = (const wd_trace_ring_ty*) mmap(NULL, sizeof(wd_trace_ring_ty),
+	                                      PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == ring)
+	{
+		return (0);
+	}
+
+	if (WD_TRACE_MAGIC == ring->hdr.magic &&
+	    WD_TRACE_CAPACITY == ring->hdr.capacity)
+	{
+		seq = __atomic_load_n(&ring->hdr.head, __ATOMIC_ACQUIRE);
+		first = seq > WD_TRACE_CAPACITY ? seq - WD_TRACE_CAPACITY : 0;
+		for (; seq > first && 0 == found_ns; --seq)
+		{
+			const wd_trace_event_ty* event =
+			                &ring->events[(seq - 1) % WD_TRACE_CAPACITY];
+
+			if (__atomic_load_n(&event->seq, __ATOMIC_ACQUIRE) == seq &&
+			    0 == strncmp(event->name, name, WD_TRACE_NAME_LEN))
+			{
+				found_ns = event->ts_ns;
+				__atomic_thread_fence(__ATOMIC_ACQUIRE);
+				if (__atomic_load_n(&event->seq, __ATOMIC_RELAXED) != seq)
+				{
+					found_ns = 0;
+				}
+			}
+		}
+	}
+
+	munmap((void*) ring, sizeof(wd_trace_ring_ty));
+
+	return (found_ns);
+}
+
+static wd_trace_ring_ty* CreateRing(void)
+{
+	char path[WD_TRACE_PATH_MAX];
+	wd_trace_ring_ty* ring = NULL;
+	pid_t tid = (pid_t) syscall(SYS_gettid);
+	int fd = -1;
+
+	sprintf(path, "%.400s/wd_trace.%d.%d.bin", g_trace_dir, (int) getpid(),
+	        (int) tid);
+
+	fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+	{
+		printf("trace open() failed\n");
+		return (NULL);
+	}
+
+	if (ftruncate(fd, sizeof(wd_trace_ring_ty)))
+	{
+		printf("trace ftruncate() failed\n");
+		close(fd);
+		return (NULL);
+	}
+
+	ring = (wd_trace_ring_ty*) mmap(NULL, sizeof(wd_trace_ring_ty),
+	                                PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == ring)
+	{
+		printf("trace mmap() failed\n");
+		return (NULL);
+	}
+
+	/* after execv() the same pid/tid keeps appending to its ring */
+	if (WD_TRACE_MAGIC != ring->hdr.magic ||
+	    WD_TRACE_VERSION != ring->hdr.version ||
+	    WD_TRACE_CAPACITY != ring->hdr.capacity)
+	{
+		ring->hdr.magic = WD_TRACE_MAGIC;
+		ring->hdr.version = WD_TRACE_VERSION;
+		ring->hdr.capacity = WD_TRACE_CAPACITY;
+		ring->hdr.head = 0;
+	}
+	ring->hdr.pid = (uint32_t) getpid();
+	ring->hdr.tid = (uint32_t) tid;
+
+	pthread_setspecific(g_ring_key, ring);
+
+	return (ring);
+}
+
+static void DestroyRing(void* ring)
+{
+	munmap(ring, sizeof(wd_trace_ring_ty));
+}
+
+static void CreateKey(void)
+{
+	pthread_key_create(&g_ring_key, DestroyRing);
+	pthread_atfork(NULL, NULL, ResetInChild);
+}
+
+/* The forking thread's ring belongs to the parent; the child gets its own. */
+static void ResetInChild(void)
+{
+	void* ring = pthread_getspecific(g_ring_key);
+
+	if (NULL != ring)
+	{
+		DestroyRing(ring);
+		pthread_setspecific(g_ring_key, NULL);
+	}
+}
@@ -0,0 +1,126 @@
+/**
+ * @file watchdog_trace_dump.c
+ * @brief Converts watchdog trace ring files into Chrome trace JSON.
+ *
+ * Usage:
+ *      ./watchdog_trace_dump $WD_TRACE/wd_trace.*.bin > trace.json
+ *
+ * The output can be opened in Perfetto (https://ui.perfetto.dev) or in
+ * chrome://tracing. All rings use CLOCK_MONOTONIC, so events from the
+ * client and from `watchdog_exec` line up on a single timeline.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>      /* using fopen, printf  */
+#include <stdlib.h>     /* using malloc         */
+
+#include "watchdog_trace.h"
+
+static int  DumpFile    (const char* path, int* is_first);
+static void PrintName   (const char* name);
+
+int main(int argc, char* argv[])
+{
+	int is_first = 1;
+	int status = 0;
+	int i;
+
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <wd_trace.*.bin>...\n", argv[0]);
+		return (1);
+	}
+
+	printf("{\"traceEvents\":[\n");
+	for (i = 1; i < argc; ++i)
+	{
+		status |= DumpFile(argv[i], &is_first);
+	}
+	printf("\n],\"displayTimeUnit\":\"ms\"}\n");
+
+	return (status);
+}
+
+static int DumpFile(const char* path, int* is_first)
+{
+	FILE* file = NULL;
+	wd_trace_hdr_ty hdr;
+	wd_trace_event_ty* events = NULL;
+	uint64_t first = 0;
+	uint64_t seq = 0;
+
+	file = fopen(path, "rb");
+	if (NULL == file)
+	{
+		perror(path);
+		return (1);
+	}
+
+	if (1 != fread(&hdr, sizeof(hdr), 1, file) ||
+	    WD_TRACE_MAGIC != hdr.magic || WD_TRACE_VERSION != hdr.version)
+	{
+		fprintf(stderr, "%s: not a watchdog trace file\n", path);
+		fclose(file);
+		return (1);
+	}
+
+	events = (wd_trace_event_ty*) malloc(hdr.capacity * sizeof(*events));
+	if (NULL == events ||
+	    hdr.capacity != fread(events, sizeof(*events), hdr.capacity, file))
+	{
+		fprintf(stderr, "%s: truncated trace file\n", path);
+		free(events);
+		fclose(file);
+		return (1);
+	}
+	fclose(file);
+
+	first = hdr.head > hdr.capacity ? hdr.head - hdr.capacity + 1 : 1;
+	for (seq = first; seq <= hdr.head; ++seq)
+	{
+		wd_trace_event_ty* event = &events[(seq - 1) % hdr.capacity];
+
+		/* skip a slot torn by a kill in the middle of a write */
+		if (event->seq != seq)
+		{
+			continue;
+		}
+
+		printf("%s{\"name\":", *is_first ? "" : ",\n");
+		PrintName(event->name);
+		printf(",\"cat\":\"watchdog\",\"ph\":\"%c\",\"ts\":%lu.%03lu,"
+		       "\"pid\":%u,\"tid\":%u",
+		       (char) event->phase,
+		       (unsigned long) (event->ts_ns / 1000),
+		       (unsigned long) (event->ts_ns % 1000),
+		       hdr.pid, hdr.tid);
+		if (WD_TRACE_INSTANT == event->phase)
+		{
+			printf(",\"s\":\"t\"");
+		}
+		printf(",\"args\":{\"arg\":%ld}}", (long) event->arg);
+		*is_first = 0;
+	}
+
+	free(events);
+
+	return (0);
+}
+
+static void PrintName(const char* name)
+{
+	putchar('"');
+	for (; '\0' != *name; ++name)
+	{
+		if ('"' == *name || '\\' == *name)
+		{
+			putchar('\\');
+		}
+		if ((unsigned char) *name >= 0x20)
+		{
+			putchar(*name);
+		}
+	}
+	putchar('"');
+}
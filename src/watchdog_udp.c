@@ -0,0 +1,508 @@
+/**
+ * @file watchdog_udp.c
+ * @brief Batched, sequence-numbered UDP heartbeats over a single socket.
+ *
+ * Peers are found on receive through an open-addressing hash table keyed
+ * by (from_id, to_id), and outgoing entries are grouped per destination
+ * address so one datagram carries up to `WD_UDP_MAX_ENTRIES` heartbeats.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>         /* using malloc, realloc    */
+#include <stdio.h>          /* using printf             */
+#include <string.h>         /* using memset, memcpy     */
+#include <errno.h>          /* using errno              */
+#include <signal.h>         /* using SIGUSR1            */
+#include <unistd.h>         /* using close              */
+#include <fcntl.h>          /* using fcntl              */
+#include <time.h>           /* using clock_gettime      */
+#include <sys/socket.h>     /* using socket, sendto     */
+#include <netinet/in.h>     /* using sockaddr_in        */
+#include <arpa/inet.h>      /* using inet_pton, htonl   */
+
+#include "watchdog_udp.h"
+
+#define WD_UDP_HDR_SIZE     (12)
+#define WD_UDP_ENTRY_SIZE   (12)
+#define WD_UDP_MAX_ENTRIES  ((WD_UDP_MAX_PAYLOAD - WD_UDP_HDR_SIZE) / \
+                             WD_UDP_ENTRY_SIZE)
+#define WD_UDP_PUMP_NS      (1000000ull)    /* drain at most once per ms */
+#define WD_UDP_RCVBUF       (1 << 20)       /* room for bursts of batches */
+
+typedef struct wd_udp_dest
+{
+	struct sockaddr_in  addr;
+	size_t              n_entries;
+	unsigned char       buf[WD_UDP_MAX_PAYLOAD];
+} wd_udp_dest_ty;
+
+typedef struct wd_udp_peer
+{
+	wd_udp_ty*  hub;
+	size_t      dest;           /* index in hub->dests */
+	uint32_t    local_id;
+	uint32_t    remote_id;
+	uint32_t    tx_seq;         /* last sequence sent */
+	uint32_t    rx_seq;         /* last sequence accepted */
+	uint32_t    rx_epoch;       /* sender's epoch of `rx_seq` */
+	int         has_rx;
+	int         is_received;    /* heartbeat since the last poll */
+} wd_udp_peer_ty;
+
+struct wd_udp
+{
+	int                 fd;
+	unsigned short      port;
+	uint32_t            epoch;      /* this hub's instance, sent along */
+	wd_udp_dest_ty*     dests;
+	size_t              n_dests;
+	wd_udp_peer_ty**    peers;      /* in attach order, owns the peers */
+	size_t              n_peers;
+	wd_udp_peer_ty**    table;      /* hash table, capacity power of 2 */
+	size_t              table_cap;
+	uint64_t            last_pump_ns;
+	wd_udp_stats_ty     stats;
+};
+
+static int              UdpSignal   (wd_ty* wd, int sig_num);
+static int              UdpPoll     (wd_ty* wd);
+static void             UdpReset    (wd_ty* wd);
+static void             FlushDest   (wd_udp_ty* hub, wd_udp_dest_ty* dest);
+static void             FlushAll    (wd_udp_ty* hub);
+static void             Apply       (wd_udp_ty* hub, uint32_t epoch,
+                                     uint32_t from_id, uint32_t to_id,
+                                     uint32_t seq);
+static uint32_t         NewEpoch    (void);
+static int              FindDest    (wd_udp_ty* hub,
+                                     const struct sockaddr_in* addr);
+static int              Insert      (wd_udp_ty* hub, wd_udp_peer_ty* peer);
+static wd_udp_peer_ty*  Lookup      (const wd_udp_ty* hub, uint32_t from_id,
+                                     uint32_t to_id);
+static size_t           Hash        (uint32_t from_id, uint32_t to_id);
+static void             PutU32      (unsigned char* buf, uint32_t val);
+static uint32_t         GetU32      (const unsigned char* buf);
+
+static const wd_sol_ops_ty g_udp_sol_ops = {UdpSignal, UdpPoll, UdpReset};
+
+wd_udp_ty* WdUdpCreate(const char* bind_ip, unsigned short port)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int rcvbuf = WD_UDP_RCVBUF;
+	wd_udp_ty* hub = (wd_udp_ty*) calloc(1, sizeof(wd_udp_ty));
+
+	if (NULL == hub)
+	{
+		printf("malloc failed\n");
+		return (NULL);
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (1 != inet_pton(AF_INET, bind_ip, &addr.sin_addr))
+	{
+		printf("inet_pton() failed\n");
+		free(hub);
+		return (NULL);
+	}
+
+	hub->fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (hub->fd < 0 ||
+	    bind(hub->fd, (struct sockaddr*) &addr, sizeof(addr)) ||
+	    fcntl(hub->fd, F_SETFL, fcntl(hub->fd, F_GETFL) | O_NONBLOCK) ||
+	    getsockname(hub->fd, (struct sockaddr*) &addr, &len))
+	{
+		perror("udp hub socket");
+		if (hub->fd >= 0)
+		{
+			close(hub->fd);
+		}
+		free(hub);
+		return (NULL);
+	}
+	hub->port = ntohs(addr.sin_port);
+	hub->epoch = NewEpoch();
+
+	/* best effort; the kernel caps it at net.core.rmem_max */
+	setsockopt(hub->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	return (hub);
+}
+
+void WdUdpDestroy(wd_udp_ty* hub)
+{
+	size_t i;
+
+	for (i = 0; i < hub->n_peers; ++i)
+	{
+		free(hub->peers[i]);
+	}
+	free(hub->peers);
+	free(hub->table);
+	free(hub->dests);
+	close(hub->fd);
+	free(hub);
+}
+
+unsigned short WdUdpGetPort(const wd_udp_ty* hub)
+{
+	return (hub->port);
+}
+
+int WdUdpAttach(wd_udp_ty* hub, wd_ty* wd, const char* remote_ip,
+                unsigned short remote_port, uint32_t local_id,
+                uint32_t remote_id)
+{
+	struct sockaddr_in addr;
+	wd_udp_peer_ty** peers = NULL;
+	wd_udp_peer_ty* peer = NULL;
+	int dest = 0;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(remote_port);
+	if (1 != inet_pton(AF_INET, remote_ip, &addr.sin_addr))
+	{
+		printf("inet_pton() failed\n");
+		return (1);
+	}
+
+	dest = FindDest(hub, &addr);
+	peer = (wd_udp_peer_ty*) calloc(1, sizeof(wd_udp_peer_ty));
+	peers = (wd_udp_peer_ty**) realloc(hub->peers,
+	                                   (hub->n_peers + 1) * sizeof(*peers));
+	if (dest < 0 || NULL == peer || NULL == peers)
+	{
+		printf("malloc failed\n");
+		free(peer);
+		if (NULL != peers)
+		{
+			hub->peers = peers;
+		}
+		return (1);
+	}
+	hub->peers = peers;
+
+	peer->hub = hub;
+	peer->dest = (size_t) dest;
+	peer->local_id = local_id;
+	peer->remote_id = remote_id;
+	if (Insert(hub, peer))
+	{
+		free(peer);
+		return (1);
+	}
+	hub->peers[hub->n_peers++] = peer;
+
+	wd->sol_ops = &g_udp_sol_ops;
+	wd->sol_ctx = peer;
+
+	return (0);
+}
+
+int WdUdpFlushTSK(void* args)
+{
+	FlushAll((wd_udp_ty*) args);
+
+	return (1);
+}
+
+int WdUdpPump(wd_udp_ty* hub)
+{
+	unsigned char buf[WD_UDP_MAX_PAYLOAD];
+	int n_datagrams = 0;
+	ssize_t len = 0;
+
+	while ((len = recv(hub->fd, buf, sizeof(buf), 0)) >= 0)
+	{
+		uint32_t epoch = 0;
+		size_t count = 0;
+		size_t i;
+
+		if (len < WD_UDP_HDR_SIZE || WD_UDP_MAGIC != GetU32(buf) ||
+		    WD_UDP_VERSION != ((buf[4] << 8) | buf[5]))
+		{
+			++hub->stats.entries_dropped;
+			continue;
+		}
+
+		count = (buf[6] << 8) | buf[7];
+		if (WD_UDP_HDR_SIZE + count * WD_UDP_ENTRY_SIZE > (size_t) len)
+		{
+			++hub->stats.entries_dropped;
+			continue;
+		}
+
+		epoch = GetU32(buf + 8);
+		++n_datagrams;
+		++hub->stats.datagrams_received;
+		for (i = 0; i < count; ++i)
+		{
+			const unsigned char* entry = buf + WD_UDP_HDR_SIZE +
+			                             i * WD_UDP_ENTRY_SIZE;
+
+			Apply(hub, epoch, GetU32(entry), GetU32(entry + 4),
+			      GetU32(entry + 8));
+		}
+	}
+
+	return (n_datagrams);
+}
+
+void WdUdpGetStats(const wd_udp_ty* hub, wd_udp_stats_ty* stats)
+{
+	*stats = hub->stats;
+}
+
+static int UdpSignal(wd_ty* wd, int sig_num)
+{
+	wd_udp_peer_ty* peer = (wd_udp_peer_ty*) wd->sol_ctx;
+	wd_udp_dest_ty* dest = &peer->hub->dests[peer->dest];
+	unsigned char* entry = NULL;
+
+	if (SIGUSR1 != sig_num)
+	{
+		errno = ENOTSUP;
+		return (-1);
+	}
+
+	if (WD_UDP_MAX_ENTRIES == dest->n_entries)
+	{
+		FlushDest(peer->hub, dest);
+	}
+
+	entry = dest->buf + WD_UDP_HDR_SIZE + dest->n_entries * WD_UDP_ENTRY_SIZE;
+	PutU32(entry, peer->local_id);
+	PutU32(entry + 4, peer->remote_id);
+	PutU32(entry + 8, ++peer->tx_seq);
+	++dest->n_entries;
+
+	return (0);
+}
+
+static int UdpPoll(wd_ty* wd)
+{
+	wd_udp_peer_ty* peer = (wd_udp_peer_ty*) wd->sol_ctx;
+	wd_udp_ty* hub = peer->hub;
+	uint64_t now = WdClockNow(wd->clock);
+	int is_received = 0;
+
+	/* many peers check in the same tick; one drain serves them all */
+	if (now - hub->last_pump_ns >= WD_UDP_PUMP_NS)
+	{
+		hub->last_pump_ns = now;
+		WdUdpPump(hub);
+	}
+
+	is_received = peer->is_received;
+	peer->is_received = 0;
+
+	return (is_received);
+}
+
+static void UdpReset(wd_ty* wd)
+{
+	wd_udp_peer_ty* peer = (wd_udp_peer_ty*) wd->sol_ctx;
+
+	peer->has_rx = 0;
+	peer->is_received = 0;
+}
+
+static void FlushDest(wd_udp_ty* hub, wd_udp_dest_ty* dest)
+{
+	size_t len = WD_UDP_HDR_SIZE + dest->n_entries * WD_UDP_ENTRY_SIZE;
+
+	PutU32(dest->buf, WD_UDP_MAGIC);
+	dest->buf[4] = (unsigned char) (WD_UDP_VERSION >> 8);
+	dest->buf[5] = (unsigned char) WD_UDP_VERSION;
+	dest->buf[6] = (unsigned char) (dest->n_entries >> 8);
+	dest->buf[7] = (unsigned char) dest->n_entries;
+	PutU32(dest->buf + 8, hub->epoch);
+
+	/* a full socket buffer loses the batch; the receiver sees a gap */
+	if (sendto(hub->fd, dest->buf, len, 0, (struct sockaddr*) &dest->addr,
+	           sizeof(dest->addr)) == (ssize_t) len)
+	{
+		++hub->stats.datagrams_sent;
+		hub->stats.entries_sent += dest->n_entries;
+	}
+
+	dest->n_entries = 0;
+}
+
+static void FlushAll(wd_udp_ty* hub)
+{
+	size_t i;
+
+	for (i = 0; i < hub->n_dests; ++i)
+	{
+		if (hub->dests[i].n_entries)
+		{
+			FlushDest(hub, &hub->dests[i]);
+		}
+	}
+}
+
+static void Apply(wd_udp_ty* hub, uint32_t epoch, uint32_t from_id,
+                  uint32_t to_id, uint32_t seq)
+{
+	wd_udp_peer_ty* peer = Lookup(hub, from_id, to_id);
+
+	/* a restarted sender counts from 1 again: nothing old to compare with */
+	if (NULL != peer && peer->has_rx && epoch != peer->rx_epoch)
+	{
+		peer->has_rx = 0;
+		++hub->stats.peer_restarts;
+	}
+
+	/* signed distance handles sequence wrap-around */
+	if (NULL == peer || (peer->has_rx && (int32_t) (seq - peer->rx_seq) <= 0))
+	{
+		++hub->stats.entries_dropped;
+		return;
+	}
+
+	if (peer->has_rx)
+	{
+		hub->stats.entries_lost += seq - peer->rx_seq - 1;
+	}
+	peer->rx_seq = seq;
+	peer->rx_epoch = epoch;
+	peer->has_rx = 1;
+	peer->is_received = 1;
+	++hub->stats.entries_received;
+}
+
+/* Differs between instances of a host's hub, even within one second. */
+static uint32_t NewEpoch(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	return ((uint32_t) Hash((uint32_t) getpid(),
+	                        (uint32_t) now.tv_sec ^ (uint32_t) now.tv_nsec));
+}
+
+static int FindDest(wd_udp_ty* hub, const struct sockaddr_in* addr)
+{
+	wd_udp_dest_ty* dests = NULL;
+	size_t i;
+
+	for (i = 0; i < hub->n_dests; ++i)
+	{
+		if (hub->dests[i].addr.sin_port == addr->sin_port &&
+		    hub->dests[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr)
+		{
+			return ((int) i);
+		}
+	}
+
+	dests = (wd_udp_dest_ty*) realloc(hub->dests,
+	                                  (hub->n_dests + 1) * sizeof(*dests));
+	if (NULL == dests)
+	{
+		return (-1);
+	}
+	hub->dests = dests;
+	hub->dests[hub->n_dests].addr = *addr;
+	hub->dests[hub->n_dests].n_entries = 0;
+
+	return ((int) hub->n_dests++);
+}
+
+/* Keyed by the ids as they appear on the wire: from = remote, to = local. */
+static int Insert(wd_udp_ty* hub, wd_udp_peer_ty* peer)
+{
+	size_t i;
+
+	if (2 * (hub->n_peers + 1) > hub->table_cap)
+	{
+		size_t cap = hub->table_cap ? hub->table_cap * 2 : 64;
+		wd_udp_peer_ty** table =
+		        (wd_udp_peer_ty**) calloc(cap, sizeof(wd_udp_peer_ty*));
+
+		if (NULL == table)
+		{
+			printf("malloc failed\n");
+			return (1);
+		}
+
+		for (i = 0; i < hub->n_peers; ++i)
+		{
+			wd_udp_peer_ty* old = hub->peers[i];
+			size_t slot = Hash(old->remote_id, old->local_id) & (cap - 1);
+
+			while (NULL != table[slot])
+			{
+				slot = (slot + 1) & (cap - 1);
+			}
+			table[slot] = old;
+		}
+
+		free(hub->table);
+		hub->table = table;
+		hub->table_cap = cap;
+	}
+
+	i = Hash(peer->remote_id, peer->local_id) & (hub->table_cap - 1);
+	while (NULL != hub->table[i])
+	{
+		i = (i + 1) & (hub->table_cap - 1);
+	}
+	hub->table[i] = peer;
+
+	return (0);
+}
+
+static wd_udp_peer_ty* Lookup(const wd_udp_ty* hub, uint32_t from_id,
+                              uint32_t to_id)
+{
+	size_t i = 0;
+
+	if (0 == hub->table_cap)
+	{
+		return (NULL);
+	}
+
+	i = Hash(from_id, to_id) & (hub->table_cap - 1);
+	while (NULL != hub->table[i])
+	{
+		if (hub->table[i]->remote_id == from_id &&
+		    hub->table[i]->local_id == to_id)
+		{
+			return (hub->table[i]);
+		}
+		i = (i + 1) & (hub->table_cap - 1);
+	}
+
+	return (NULL);
+}
+
+static size_t Hash(uint32_t from_id, uint32_t to_id)
+{
+	uint64_t key = ((uint64_t) from_id << 32) | to_id;
+
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDull;
+	key ^= key >> 33;
+
+	return ((size_t) key);
+}
+
+static void PutU32(unsigned char* buf, uint32_t val)
+{
+	val = htonl(val);
+	memcpy(buf, &val, sizeof(val));
+}
+
+static uint32_t GetU32(const unsigned char* buf)
+{
+	uint32_t val = 0;
+
+	memcpy(&val, buf, sizeof(val));
+
+	return (ntohl(val));
+}
@@ -0,0 +1,262 @@
+/**
+ * @file watchdog_udp_loopback.c
+ * @brief Exercises the UDP heartbeat transport over the loopback interface.
+ *
+ * Two hubs on 127.0.0.1 stand for two hosts. Each of the N peer pairs is
+ * supervised from both sides with the regular `SendSolTSK`, `CheckSolTSK`
+ * and `ReviveIfErrorTSK`, all on one shared scheduler. A quarter of the
+ * way through, the first host restarts: its hub and peers are replaced
+ * by new ones on the same port, whose sequences start over. Halfway
+ * through, K peers of the first host go silent; the second host must
+ * detect exactly those K, and nothing else.
+ *
+ * Usage:
+ *      ./watchdog_udp_loopback [-n peers] [-k silenced] [-d duration_s]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>      /* using printf     */
+#include <stdlib.h>     /* using malloc     */
+#include <unistd.h>     /* using getopt     */
+
+#include "scheduler.h"
+#include "watchdog_utils.h"
+#include "watchdog_udp.h"
+
+#define REMOTE_ID_BASE  (100000u)
+
+static int  RestartTSK      (void* args);
+static int  FlushTSK        (void* args);
+static int  SilenceTSK      (void* args);
+static int  StopTSK         (void* args);
+static int  PeerLostTSK     (void* args);
+static void AddPeerTasks    (wd_ty* wd);
+static int  AttachHostA     (void);
+
+static scheduler_ty*    g_scheduler = NULL;
+static wd_udp_ty*       g_hub_a = NULL;
+static wd_udp_ty*       g_hub_b = NULL;
+static wd_ty**          g_host_a = NULL;    /* host A supervising B's peers */
+static wd_ty**          g_host_b = NULL;    /* host B supervising A's peers */
+static wd_ty**          g_old_host_a = NULL; /* host A before its restart */
+static size_t           g_n_peers = 200;
+static size_t           g_n_silenced = 10;
+static unsigned long    g_lost_a = 0;
+static unsigned long    g_lost_b = 0;
+static unsigned long    g_lost_b_expected = 0;
+static unsigned long    g_false_pos = 0;
+static char*            g_args[] = {"udp_loopback", "1", "3", NULL};
+
+int main(int argc, char* argv[])
+{
+	wd_udp_stats_ty stats_a;
+	wd_udp_stats_ty stats_b;
+	unsigned long duration_s = 20;
+	size_t i;
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "n:k:d:")))
+	{
+		switch (opt)
+		{
+			case 'n': g_n_peers = strtoul(optarg, NULL, 10); break;
+			case 'k': g_n_silenced = strtoul(optarg, NULL, 10); break;
+			case 'd': duration_s = strtoul(optarg, NULL, 10); break;
+			default:
+				fprintf(stderr, "usage: %s [-n peers] [-k silenced] "
+				        "[-d duration_s]\n", argv[0]);
+				return (1);
+		}
+	}
+	if (g_n_silenced > g_n_peers)
+	{
+		g_n_silenced = g_n_peers;
+	}
+
+	g_scheduler = SchedCreate();
+	g_hub_a = WdUdpCreate("127.0.0.1", 0);
+	g_hub_b = WdUdpCreate("127.0.0.1", 0);
+	g_host_a = (wd_ty**) calloc(g_n_peers, sizeof(wd_ty*));
+	g_host_b = (wd_ty**) calloc(g_n_peers, sizeof(wd_ty*));
+	g_old_host_a = (wd_ty**) calloc(g_n_peers, sizeof(wd_ty*));
+	if (NULL == g_scheduler || NULL == g_hub_a || NULL == g_hub_b ||
+	    NULL == g_host_a || NULL == g_host_b || NULL == g_old_host_a)
+	{
+		printf("setup failed\n");
+		return (1);
+	}
+
+	for (i = 0; i < g_n_peers; ++i)
+	{
+		g_host_b[i] = WdCreateShared(g_args, g_scheduler);
+		if (NULL == g_host_b[i] ||
+		    WdUdpAttach(g_hub_b, g_host_b[i], "127.0.0.1",
+		                WdUdpGetPort(g_hub_a), REMOTE_ID_BASE + (uint32_t) i,
+		                (uint32_t) i))
+		{
+			printf("attach failed\n");
+			return (1);
+		}
+		AddPeerTasks(g_host_b[i]);
+	}
+	if (AttachHostA())
+	{
+		return (1);
+	}
+
+	SchedAddTask(g_scheduler, FlushTSK, DoNothingTSK, NULL, NULL, 1);
+	SchedAddTask(g_scheduler, WdUdpFlushTSK, DoNothingTSK, g_hub_b, NULL, 1);
+	SchedAddTask(g_scheduler, RestartTSK, DoNothingTSK, NULL, NULL,
+	             duration_s / 4);
+	SchedAddTask(g_scheduler, SilenceTSK, DoNothingTSK, NULL, NULL,
+	             duration_s / 2);
+	SchedAddTask(g_scheduler, StopTSK, DoNothingTSK, NULL, NULL, duration_s);
+
+	SchedRun(g_scheduler);
+
+	WdUdpGetStats(g_hub_a, &stats_a);
+	WdUdpGetStats(g_hub_b, &stats_b);
+
+	printf("peers: %lu, silenced: %lu\n", (unsigned long) g_n_peers,
+	       (unsigned long) g_n_silenced);
+	printf("host B detected %lu of %lu silenced peers, %lu false positives, "
+	       "host A lost %lu\n", g_lost_b, g_lost_b_expected, g_false_pos,
+	       g_lost_a);
+	printf("host A sent %lu entries in %lu datagrams (%.1f per datagram)\n",
+	       stats_a.entries_sent, stats_a.datagrams_sent,
+	       stats_a.datagrams_sent ?
+	       (double) stats_a.entries_sent / stats_a.datagrams_sent : 0.0);
+	printf("host B received %lu entries, %lu lost, %lu dropped, "
+	       "%lu of %lu peer restarts seen\n", stats_b.entries_received,
+	       stats_b.entries_lost, stats_b.entries_dropped,
+	       stats_b.peer_restarts, (unsigned long) g_n_peers);
+
+	SchedDestroy(g_scheduler);
+	for (i = 0; i < g_n_peers; ++i)
+	{
+		WdDestroy(g_host_a[i]);
+		WdDestroy(g_host_b[i]);
+		WdDestroy(g_old_host_a[i]);
+	}
+	free(g_host_a);
+	free(g_host_b);
+	free(g_old_host_a);
+	WdUdpDestroy(g_hub_a);
+	WdUdpDestroy(g_hub_b);
+
+	return (g_lost_b == g_lost_b_expected && 0 == g_false_pos &&
+	        0 == g_lost_a && g_n_peers == stats_b.peer_restarts ? 0 : 1);
+}
+
+/* Host A's peers, supervising host B's through `g_hub_a`. */
+static int AttachHostA(void)
+{
+	size_t i;
+
+	for (i = 0; i < g_n_peers; ++i)
+	{
+		g_host_a[i] = WdCreateShared(g_args, g_scheduler);
+		if (NULL == g_host_a[i] ||
+		    WdUdpAttach(g_hub_a, g_host_a[i], "127.0.0.1",
+		                WdUdpGetPort(g_hub_b), (uint32_t) i,
+		                REMOTE_ID_BASE + (uint32_t) i))
+		{
+			printf("attach failed\n");
+			return (1);
+		}
+		AddPeerTasks(g_host_a[i]);
+	}
+
+	return (0);
+}
+
+static void AddPeerTasks(wd_ty* wd)
+{
+	wd->revive_task = PeerLostTSK;
+	WdAddTask(wd, SendSolTSK, 1);
+	WdAddTask(wd, CheckSolTSK, 1);
+	WdAddTask(wd, ReviveIfErrorTSK, 1);
+}
+
+/* Host A comes back as a new process would: a new hub on the same port,
+ * new peers whose sequences start at 1. Host B must not mistake their
+ * heartbeats for duplicates of the old ones. */
+static int RestartTSK(void* args)
+{
+	unsigned short port = WdUdpGetPort(g_hub_a);
+	size_t i;
+
+	(void) args;
+
+	for (i = 0; i < g_n_peers; ++i)
+	{
+		WdClearTasks(g_host_a[i]);
+		g_old_host_a[i] = g_host_a[i];
+	}
+	WdUdpDestroy(g_hub_a);
+
+	g_hub_a = WdUdpCreate("127.0.0.1", port);
+	if (NULL == g_hub_a || AttachHostA())
+	{
+		printf("restart failed\n");
+		SchedStop(g_scheduler);
+	}
+
+	return (0);
+}
+
+static int FlushTSK(void* args)
+{
+	(void) args;
+
+	return (WdUdpFlushTSK(g_hub_a));
+}
+
+/* The first K peers of host A stop sending heartbeats. */
+static int SilenceTSK(void* args)
+{
+	size_t i;
+	(void) args;
+
+	for (i = 0; i < g_n_silenced; ++i)
+	{
+		WdClearTasks(g_host_a[i]);
+	}
+	g_lost_b_expected = (unsigned long) g_n_silenced;
+
+	return (0);
+}
+
+static int StopTSK(void* args)
+{
+	(void) args;
+
+	SchedStop(g_scheduler);
+
+	return (0);
+}
+
+static int PeerLostTSK(void* args)
+{
+	wd_ty* wd = (wd_ty*) args;
+	size_t i;
+
+	for (i = 0; i < g_n_peers; ++i)
+	{
+		if (g_host_b[i] == wd)
+		{
+			if (i >= g_n_silenced)
+			{
+				++g_false_pos;
+				return (0);
+			}
+			++g_lost_b;
+			return (0);
+		}
+	}
+
+	++g_lost_a;
+
+	return (0);
+}
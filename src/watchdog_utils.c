@@ -1,252 +1,645 @@
-/**
- * @file watchdog_utils.c
- * @brief Implementation of the internal watchdog logic and process management.
- *
- * This file defines the behavior of the watchdog system, including:
- *  - Creating and monitoring a target process
- *  - Scheduling heartbeat signals
- *  - Reacting to process failure
- *  - Handling POSIX signals for inter-process communication
- */
- 
-#define _POSIX_C_SOURCE 199506L
-
-#include <stdlib.h>
-#include <errno.h>
-#include <stdio.h>
-#include <signal.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/wait.h>
-
-#include "scheduler.h"
-#include "watchdog_utils.h"
-#include "uid.h"
-
-static volatile sig_atomic_t g_is_sol_received = 0;
-
-wd_ty* WdCreate(char** args)
-{
-	wd_ty* wd = NULL;
-	
-	wd = (wd_ty*) malloc(sizeof(wd_ty));
-	if (NULL == wd)
-	{
-		printf("malloc failed\n");
-        /* exit(0); */
-	}
-
-	wd->scheduler = SchedCreate();
-	if (NULL == wd->scheduler)
-	{
-		free(wd);
-		printf("SchedCreate failed\n");
-        /* exit(0); */
-	}
-
-	wd->interval = strtoul(args[1], NULL, 10);
-	wd->max_fails = strtoul(args[2], NULL, 10);
-	wd->fails = 0;
-	wd->target_pid = -1;
-	wd->target_args = args;
-	wd->revive_task = NULL;
-		
-	return (wd);
-}
-
-void WdDestroy(wd_ty* wd)
-{
-	SchedDestroy(wd->scheduler);
-	free(wd);
-	g_is_sol_received = 0;
-}
-
-int WdAddTask(wd_ty* wd, int (*task)(void *), unsigned long interval)
-{
-	uid_ty uid = SchedAddTask(wd->scheduler, task, DoNothingTSK, wd, NULL,
-                              interval);
-	if (UIDIsSame(uid, GetBadUID()) != 0)
-	{
-		printf("SchedAddTask failed\n");
-        /* exit(0); */
-	}
-	
-	return 0;
-}
-
-void WdClearTasks(wd_ty* wd)
-{
-	SchedClear(wd->scheduler);
-}
-
-void WdStart(wd_ty* wd)
-{
-	SchedRun(wd->scheduler);
-}
-
-void WdStop(wd_ty* wd)
-{
-	SchedStop(wd->scheduler);
-}
-
-void WdSendSignal(wd_ty* wd, int sig_num)
-{
-	int status = kill(wd->target_pid, sig_num);
-
-	if (EPERM == status || ESRCH == status)
-	{
-		printf("kill() failed\n");
-        /* exit(0); */
-	}
-}
-
-void WdExecTarget(wd_ty* wd)
-{
-	execv(wd->target_args[0], wd->target_args);
-	
-	printf("execv() failed\n");
-}
-
-void WdSpawnTarget(wd_ty* wd)
-{
-	pid_t pid = 0;
-	
-	pid = fork();
-	
-	if (pid < 0)
-	{
-		printf("fork() failed\n");
-		/* exit(0); */
-	}
-	else if (0 == pid)
-	{
-		WdExecTarget(wd);
-	}
-	
-	wd->target_pid = pid;
-}
-
-int WdWaitPid(wd_ty* wd)
-{
-	int status = 0;
-	
-	do
-	{
-		status = waitpid(wd->target_pid, NULL, 0);
-	}
-	while (status && EINTR == errno);
-	
-	return (status ? 0 : 1);
-}
-
-int SendSolTSK(void* args)
-{
-	wd_ty* wd = (wd_ty*) args;
-
-	WdSendSignal(wd, SIGUSR1);
-
-	return 1;
-}
-
-int CheckSolTSK(void* args)
-{
-	wd_ty* wd = (wd_ty*) args;
-	
-	if (g_is_sol_received == 1)
-	{
-		wd->fails = 0;
-		g_is_sol_received = 0;
-	}
-	else
-	{
-		++wd->fails;
-	}
-	
-	return 1;
-}
-
-int ReviveIfErrorTSK(void* args)
-{
-	wd_ty* wd = (wd_ty*) args;
-
-	printf("ps in watchdog_utils.c ReviveIfErrorTSK\n");
-    system("ps");
-
-	if (wd->fails == wd->max_fails)
-	{
-		WdSendSignal(wd, SIGKILL);
-		WdClearTasks(wd);
-		WdAddTask(wd, wd->revive_task, 1);
-	}
-	
-	return 1;
-}
-
-void DoNothingTSK(void* args)
-{
-	(void)args;
-}
-
-void SIGUSR1Handler(int sig_num)
-{
-	(void) sig_num;
-	
-	g_is_sol_received = 1;
-
-	if (sig_num == SIGUSR1)
-    {
-        printf("Received SIGUSR1!\n");
-    }
-}
-
-int SetSignalMask(int sig_num, int val)
-{
-	sigset_t sig_set;
-	
-	if (sigemptyset(&sig_set))
-	{
-		printf("sigemptyset() failed\n");
-		/* exit(0); */
-	}
-	
-	if (sigaddset(&sig_set, sig_num))
-	{
-		printf("sigaddset() failed\n");
-		/* exit(0); */
-	}
-	
-	if (pthread_sigmask(val, &sig_set, NULL))
-	{
-		printf("pthread_sigmask() failed\n");
-		/* exit(0); */
-	}
-	
-	return 0;
-}
-
-int SetSignalHandler(int sig_num, void (*handler)(int))
-{
-	struct sigaction sa;
-	
-	sa.sa_handler = handler;
-	sa.sa_flags = 0;
-	
-	if (sigemptyset(&sa.sa_mask))
-	{
-		printf("sigemptyset() failed\n");
-		/* exit(0); */
-	}
-	
-	if (sigaction(sig_num, &sa, NULL))
-	{
-		printf("sigaction() failed\n");
-		/* exit(0); */
-	}
-	
-	return 0;
-}
-
-int GetSol(void)
-{
-	return (g_is_sol_received);
-}
+/**
+ * @file watchdog_utils.c
+ * @brief Implementation of the internal watchdog logic and process management.
+ *
+ * This file defines the behavior of the watchdog system, including:
+ *  - Creating and monitoring a target process
+ *  - Scheduling heartbeat signals
+ *  - Reacting to process failure
+ *  - Handling POSIX signals for inter-process communication
+ */
+ 
+#define _POSIX_C_SOURCE 199506L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "scheduler.h"
+#include "watchdog_utils.h"
+#include "uid.h"
+#include "watchdog_trace.h"
+#include "watchdog_flight.h"
+#include "watchdog_state.h"
+#include "watchdog_ready.h"
+#include "watchdog_pressure.h"
+#include "watchdog_profile.h"
+#include "watchdog_cmd.h"
+#include "watchdog_capture.h"
+
+static int      SignalPeer      (wd_ty* wd, int sig_num);
+static int      PollSol         (wd_ty* wd);
+static char**   BuildEnv        (wd_ty* wd);
+static void     ExecWithEnv     (wd_ty* wd, char** envp);
+static char*    FindChildEnv    (wd_ty* wd, const char* name);
+static int      IsSameName      (const char* var, const char* child_var);
+
+extern char** environ;
+
+static volatile sig_atomic_t g_is_sol_received = 0;
+
+static const wd_sol_ops_ty g_signal_sol_ops = {SignalPeer, PollSol, NULL};
+
+wd_ty* WdCreate(char** args)
+{
+	wd_ty* wd = NULL;
+	scheduler_ty* scheduler = SchedCreate();
+
+	if (NULL == scheduler)
+	{
+		WdCaptureDiag("SchedCreate failed\n");
+		return (NULL);
+	}
+
+	wd = WdCreateShared(args, scheduler);
+	if (NULL == wd)
+	{
+		SchedDestroy(scheduler);
+		return (NULL);
+	}
+	wd->owns_scheduler = 1;
+
+	return (wd);
+}
+
+wd_ty* WdCreateShared(char** args, scheduler_ty* scheduler)
+{
+	wd_ty* wd = NULL;
+	
+	WdTraceInit();
+
+	wd = (wd_ty*) malloc(sizeof(wd_ty));
+	if (NULL == wd)
+	{
+		WdCaptureDiag("malloc failed\n");
+		return (NULL);
+	}
+
+	wd->scheduler = scheduler;
+	wd->owns_scheduler = 0;
+	wd->interval = strtoul(args[1], NULL, 10);
+	wd->max_fails = strtoul(args[2], NULL, 10);
+	wd->fails = 0;
+	wd->probe_fails = 0;
+	wd->target_pid = -1;
+	wd->target_args = args;
+	wd->out_fd = -1;
+	wd->revive_task = NULL;
+	memset(wd->tasks, 0, sizeof(wd->tasks));
+	wd->task_seq = 0;
+	wd->clock = WdClockReal();
+	wd->sol_ops = &g_signal_sol_ops;
+	wd->sol_ctx = NULL;
+	wd->state = NULL;
+	wd->role = 0;
+	wd->generation = 0;
+	wd->target_generation = 0;
+	wd->is_target_ready = 1;
+	wd->ready_fd = -1;
+	wd->target_started_ns = 0;
+	wd->ready_deadline_ns = 0;
+	wd->revive_after_ns = 0;
+	memset(wd->revive_ns, 0, sizeof(wd->revive_ns));
+	wd->cmds = NULL;
+	memset(wd->child_env, 0, sizeof(wd->child_env));
+	wd->child_fd = -1;
+		
+	return (wd);
+}
+
+void WdDestroy(wd_ty* wd)
+{
+	if (wd->ready_fd >= 0)
+	{
+		close(wd->ready_fd);
+	}
+	if (wd->owns_scheduler)
+	{
+		SchedDestroy(wd->scheduler);
+	}
+	free(wd);
+	g_is_sol_received = 0;
+}
+
+int WdAddNamedTask(wd_ty* wd, int (*task)(void *), const char* name,
+                   unsigned long interval)
+{
+	wd_task_ty* slot = NULL;
+	uid_ty uid;
+	size_t i = 0;
+
+	while (i < WD_MAX_TASKS && NULL != wd->tasks[i].task)
+	{
+		++i;
+	}
+	if (WD_MAX_TASKS == i)
+	{
+		WdCaptureDiag("WdAddTask failed: no free task slot\n");
+		return 1;
+	}
+
+	slot = &wd->tasks[i];
+	slot->task = task;
+	slot->name = name;
+	slot->wd = wd;
+	slot->seq = ++wd->task_seq;
+	slot->interval = interval;
+	slot->is_cancelled = 0;
+
+	uid = SchedAddTask(wd->scheduler, WdDispatchTSK, DoNothingTSK, slot, NULL,
+                       interval);
+	slot->uid = uid;
+	if (UIDIsSame(uid, GetBadUID()) != 0)
+	{
+		slot->task = NULL;
+		WdCaptureDiag("SchedAddTask failed\n");
+        /* exit(0); */
+	}
+	
+	return 0;
+}
+
+int WdDispatchTSK(void* args)
+{
+	wd_task_ty* slot = (wd_task_ty*) args;
+	const char* name = slot->name;
+	size_t seq = slot->seq;
+	int status = 0;
+
+	/* commands from other threads apply between tasks; they may have
+	 * cleared this very slot */
+	if (NULL != slot->wd->cmds &&
+	    0 != WdCmdDrain(slot->wd->cmds, slot->wd) &&
+	    (seq != slot->seq || NULL == slot->task))
+	{
+		return 0;
+	}
+
+	if (slot->is_cancelled)
+	{
+		slot->task = NULL;
+		slot->is_cancelled = 0;
+		return 0;
+	}
+
+	WD_TRACE_B(name, slot->wd->target_pid);
+	status = slot->task(slot->wd);
+	WD_TRACE_E(name, status);
+
+	/* the task may have cleared and refilled the slots while it ran */
+	if (seq == slot->seq && (0 == status || slot->is_cancelled))
+	{
+		slot->task = NULL;
+		slot->is_cancelled = 0;
+		status = 0;
+	}
+
+	return status;
+}
+
+void WdClearTasks(wd_ty* wd)
+{
+	size_t i;
+
+	if (NULL != wd->sol_ops->reset)
+	{
+		wd->sol_ops->reset(wd);
+	}
+
+	if (wd->owns_scheduler)
+	{
+		SchedClear(wd->scheduler);
+		memset(wd->tasks, 0, sizeof(wd->tasks));
+		return;
+	}
+
+	/* other watchdogs' tasks stay; ours drop out at their next dispatch */
+	for (i = 0; i < WD_MAX_TASKS; ++i)
+	{
+		if (NULL != wd->tasks[i].task)
+		{
+			wd->tasks[i].is_cancelled = 1;
+		}
+	}
+}
+
+void WdStart(wd_ty* wd)
+{
+	SchedRun(wd->scheduler);
+}
+
+void WdStop(wd_ty* wd)
+{
+	SchedStop(wd->scheduler);
+}
+
+void WdSendSignal(wd_ty* wd, int sig_num)
+{
+	int status = 0;
+
+	WD_TRACE_I(SIGKILL == sig_num ? "kill" : "signal", wd->target_pid);
+	status = wd->sol_ops->signal(wd, sig_num);
+
+	if (EPERM == status || ESRCH == status)
+	{
+		WdCaptureDiag("kill() failed\n");
+        /* exit(0); */
+	}
+}
+
+void WdExecTarget(wd_ty* wd)
+{
+	char** envp = BuildEnv(wd);
+
+	if (NULL == envp)
+	{
+		WdCaptureDiag("malloc failed\n");
+		return;
+	}
+
+	ExecWithEnv(wd, envp);
+	free(envp);
+}
+
+char* WdSetChildEnv(wd_ty* wd, const char* name, const char* value)
+{
+	size_t name_len = strlen(name);
+	char* slot = FindChildEnv(wd, name);
+	size_t i;
+
+	for (i = 0; NULL == slot && i < WD_CHILD_ENV_MAX; ++i)
+	{
+		if ('\0' == wd->child_env[i][0])
+		{
+			slot = wd->child_env[i];
+		}
+	}
+
+	if (NULL == slot || name_len + 1 + strlen(value) >= WD_CHILD_ENV_LEN)
+	{
+		WdCaptureDiag("WdSetChildEnv failed\n");
+		return (NULL);
+	}
+	sprintf(slot, "%s=%s", name, value);
+
+	return (slot + name_len + 1);
+}
+
+char* WdGetChildEnv(wd_ty* wd, const char* name)
+{
+	char* slot = FindChildEnv(wd, name);
+
+	return (NULL != slot ? slot + strlen(name) + 1 : NULL);
+}
+
+void WdUnsetChildEnv(wd_ty* wd, const char* name)
+{
+	char* slot = FindChildEnv(wd, name);
+
+	if (NULL != slot)
+	{
+		slot[0] = '\0';
+	}
+}
+
+void WdSpawnTarget(wd_ty* wd)
+{
+	pid_t pid = 0;
+	char** envp = NULL;
+	
+	WD_TRACE_B("fork", 0);
+	WdProfileExport(wd);
+	/* the child of a threaded process may not malloc: built here */
+	envp = BuildEnv(wd);
+	pid = NULL != envp ? fork() : -1;
+	
+	if (pid < 0)
+	{
+		WdCaptureDiag("fork() failed\n");
+		/* exit(0); */
+	}
+	else if (0 == pid)
+	{
+		if (wd->out_fd >= 0)
+		{
+			dup2(wd->out_fd, STDOUT_FILENO);
+			dup2(wd->out_fd, STDERR_FILENO);
+		}
+		WdProfileStampChild(wd);
+		ExecWithEnv(wd, envp);
+		_exit(127);
+	}
+	
+	free(envp);
+	WdProfileUnexport(wd);
+	WD_TRACE_E("fork", pid);
+	wd->target_pid = pid;
+}
+
+int WdWaitPid(wd_ty* wd)
+{
+	int status = 0;
+	
+	do
+	{
+		status = waitpid(wd->target_pid, NULL, 0);
+	}
+	while (status && EINTR == errno);
+	WD_TRACE_I("exit confirmed", wd->target_pid);
+	
+	return (status ? 0 : 1);
+}
+
+int SendSolTSK(void* args)
+{
+	wd_ty* wd = (wd_ty*) args;
+
+	WdSendSignal(wd, SIGUSR1);
+
+	return 1;
+}
+
+int CheckSolTSK(void* args)
+{
+	wd_ty* wd = (wd_ty*) args;
+	int is_heartbeat = wd->sol_ops->poll(wd);
+	int was_ready = wd->is_target_ready;
+	int ready = WdPollReady(wd, is_heartbeat);
+
+	/* a starting peer is not expected to beat yet */
+	if (0 == ready || (!was_ready && 1 == ready && !is_heartbeat))
+	{
+		return 1;
+	}
+	if (ready < 0)
+	{
+		wd->fails = WdPressureMaxFails(wd);
+	}
+	else if (is_heartbeat)
+	{
+		WD_TRACE_I("heartbeat", wd->target_pid);
+		if (wd->fails)
+		{
+			WD_TRACE_I("heartbeat restored", wd->fails);
+		}
+		/* a heartbeat does not vouch for a wedged request path */
+		wd->fails = wd->probe_fails;
+		WdProfileHeartbeat(wd);
+	}
+	else
+	{
+		++wd->fails;
+		WD_TRACE_I("heartbeat missed", wd->fails);
+	}
+
+	if (NULL != wd->state)
+	{
+		WdStateSaveFails(wd, is_heartbeat);
+	}
+	
+	return 1;
+}
+
+int ReviveIfErrorTSK(void* args)
+{
+	wd_ty* wd = (wd_ty*) args;
+
+	if (wd->fails < WdPressureMaxFails(wd))
+	{
+		wd->revive_after_ns = 0;
+		wd->revive_ns[WD_PHASE_DETECTED] = 0;
+	}
+	else
+	{
+		int is_followed = (NULL != wd->state && WdStateFollowTarget(wd));
+
+		/* a new instance starts over; the old one's startup says nothing */
+		if (is_followed)
+		{
+			WdAwaitHeartbeatReady(wd, WdStateGetTargetStartedNs(wd));
+		}
+
+		/* the peer was already replaced, or only its heartbeats get lost */
+		if (is_followed ||
+		    (NULL != wd->state && wd->is_target_ready &&
+		     0 == wd->probe_fails && WdStateIsTargetLeased(wd)))
+		{
+			WD_TRACE_I("revive skipped", wd->target_pid);
+			wd->fails = 0;
+			wd->probe_fails = 0;
+			WdStateSaveFails(wd, 0);
+			return 1;
+		}
+
+		/* a staggered revive was detected when it first became due */
+		if (0 == wd->revive_ns[WD_PHASE_DETECTED])
+		{
+			WdProfileMark(wd, WD_PHASE_DETECTED);
+		}
+
+		/* under host pressure, revives wait their turn */
+		if (WdPressureDeferRevive(wd))
+		{
+			return 1;
+		}
+
+		WD_TRACE_I("revive", wd->target_pid);
+		WdFlightDump(wd->target_pid, "revive");
+		WdSendSignal(wd, SIGKILL);
+		WdProfileMark(wd, WD_PHASE_KILL_SENT);
+		if (&g_signal_sol_ops == wd->sol_ops)
+		{
+			WdProfileCheckExit(wd);
+		}
+		wd->probe_fails = 0;
+		WdClearTasks(wd);
+		WdAddTask(wd, wd->revive_task, 1);
+	}
+	
+	return 1;
+}
+
+void DoNothingTSK(void* args)
+{
+	(void)args;
+}
+
+void SIGUSR1Handler(int sig_num)
+{
+	int saved_errno = errno;
+	ssize_t written = 0;
+
+	g_is_sol_received = 1;
+
+	/* straight to the fd: stdio is not async-signal-safe, and a captured
+	 * stdout may be a full pipe; a line that does not fit is dropped */
+	if (sig_num == SIGUSR1)
+	{
+		written = write(WdCaptureDiagFd(), "Received SIGUSR1!\n", 18);
+	}
+	(void) written;
+	errno = saved_errno;
+}
+
+int SetSignalMask(int sig_num, int val)
+{
+	sigset_t sig_set;
+	
+	if (sigemptyset(&sig_set))
+	{
+		WdCaptureDiag("sigemptyset() failed\n");
+		/* exit(0); */
+	}
+	
+	if (sigaddset(&sig_set, sig_num))
+	{
+		WdCaptureDiag("sigaddset() failed\n");
+		/* exit(0); */
+	}
+	
+	if (pthread_sigmask(val, &sig_set, NULL))
+	{
+		WdCaptureDiag("pthread_sigmask() failed\n");
+		/* exit(0); */
+	}
+	
+	return 0;
+}
+
+int SetSignalHandler(int sig_num, void (*handler)(int))
+{
+	struct sigaction sa;
+	
+	sa.sa_handler = handler;
+	sa.sa_flags = 0;
+	
+	if (sigemptyset(&sa.sa_mask))
+	{
+		WdCaptureDiag("sigemptyset() failed\n");
+		/* exit(0); */
+	}
+	
+	if (sigaction(sig_num, &sa, NULL))
+	{
+		WdCaptureDiag("sigaction() failed\n");
+		/* exit(0); */
+	}
+	
+	return 0;
+}
+
+static int SignalPeer(wd_ty* wd, int sig_num)
+{
+	return (kill(wd->target_pid, sig_num));
+}
+
+static int PollSol(wd_ty* wd)
+{
+	(void) wd;
+
+	if (g_is_sol_received == 1)
+	{
+		g_is_sol_received = 0;
+		return (1);
+	}
+
+	return (0);
+}
+
+int GetSol(void)
+{
+	return (g_is_sol_received);
+}
+
+/* This process' environment minus the names in `child_env`, plus
+ * `child_env`. The slots are referenced, not copied, so a forked child may
+ * still rewrite them before exec. */
+static char** BuildEnv(wd_ty* wd)
+{
+	char** envp = NULL;
+	size_t n_env = 0;
+	size_t n = 0;
+	size_t i;
+	size_t j;
+
+	while (NULL != environ[n_env])
+	{
+		++n_env;
+	}
+	envp = (char**) malloc((n_env + WD_CHILD_ENV_MAX + 1) * sizeof(char*));
+	if (NULL == envp)
+	{
+		return (NULL);
+	}
+
+	for (i = 0; i < n_env; ++i)
+	{
+		for (j = 0; j < WD_CHILD_ENV_MAX; ++j)
+		{
+			if (IsSameName(environ[i], wd->child_env[j]))
+			{
+				break;
+			}
+		}
+		if (WD_CHILD_ENV_MAX == j)
+		{
+			envp[n++] = environ[i];
+		}
+	}
+	for (j = 0; j < WD_CHILD_ENV_MAX; ++j)
+	{
+		if ('\0' != wd->child_env[j][0])
+		{
+			envp[n++] = wd->child_env[j];
+		}
+	}
+	envp[n] = NULL;
+
+	return (envp);
+}
+
+/* No malloc and no locks before exec: may run in the forked child of a
+ * threaded process. */
+static void ExecWithEnv(wd_ty* wd, char** envp)
+{
+	if (wd->child_fd >= 0)
+	{
+		fcntl(wd->child_fd, F_SETFD, 0);
+	}
+
+	WD_TRACE_I("execv", 0);
+	execve(wd->target_args[0], wd->target_args, envp);
+
+	WdCaptureDiag("execv() failed\n");
+}
+
+static char* FindChildEnv(wd_ty* wd, const char* name)
+{
+	size_t name_len = strlen(name);
+	size_t i;
+
+	for (i = 0; i < WD_CHILD_ENV_MAX; ++i)
+	{
+		if (0 == strncmp(wd->child_env[i], name, name_len) &&
+		    '=' == wd->child_env[i][name_len])
+		{
+			return (wd->child_env[i]);
+		}
+	}
+
+	return (NULL);
+}
+
+static int IsSameName(const char* var, const char* child_var)
+{
+	const char* eq = strchr(child_var, '=');
+
+	return (NULL != eq &&
+	        0 == strncmp(var, child_var, (size_t) (eq - child_var + 1)));
+}